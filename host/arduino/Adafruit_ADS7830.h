@@ -0,0 +1,25 @@
+/* Filename: Adafruit_ADS7830.h (host)
+ * Author: Liam Warner
+ * Purpose: simulated ADS7830. Each single-ended read costs one I2C register read and
+ *          returns whatever sim::adc_model reports for the channel at that instant.
+ */
+
+#ifndef ADAFRUIT_ADS7830_H
+#define ADAFRUIT_ADS7830_H
+
+#include "Arduino.h"
+#include "Wire.h"
+
+class Adafruit_ADS7830 {
+public:
+  bool begin(uint8_t i2c_address = 0x48, TwoWire* wire = &Wire){
+    (void)i2c_address;
+    (void)wire;
+    return true;
+  }
+  uint8_t readADCsingle(uint8_t ch){
+    return sim::adc_read(ch & 7);
+  }
+};
+
+#endif
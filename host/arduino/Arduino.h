@@ -0,0 +1,223 @@
+/* Filename: Arduino.h (host)
+ * Author: Liam Warner
+ * Purpose: the subset of the Arduino core used by the orchestrion firmware, implemented on
+ *          top of the simulated board in sim/sim_core.h. Force-included ahead of the sketch
+ *          the same way the Arduino builder does.
+ */
+
+#ifndef ARDUINO_H
+#define ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include <cmath>
+#include <algorithm>
+#include <vector>
+#include <deque>
+#include <string>
+#include <iostream>
+#include <functional>
+
+#include "../sim/sim_core.h"
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+
+#define CHANGE 2
+#define FALLING 3
+#define RISING 4
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+#define digitalPinToInterrupt(p) (p)
+
+// Same shape as the SAMD core: mixed-type min/max and a round() macro returning long
+template<class T, class L>
+auto min(const T& a, const L& b) -> decltype((b < a) ? b : a){
+  return (b < a) ? b : a;
+}
+
+template<class T, class L>
+auto max(const T& a, const L& b) -> decltype((b < a) ? b : a){
+  return (a < b) ? b : a;
+}
+
+#define round(x) ((x)>=0?(long)((x)+0.5):(long)((x)-0.5))
+
+/***********************************************************
+ * Time
+ ***********************************************************/
+inline uint32_t millis(){
+  sim::stats.clock_reads++;
+  sim::advance(sim::costs.clock_read_ns);
+  return static_cast<uint32_t>(sim::now_ns / 1000000ULL);
+}
+
+inline uint32_t micros(){
+  sim::stats.clock_reads++;
+  sim::advance(sim::costs.clock_read_ns);
+  return static_cast<uint32_t>(sim::now_ns / 1000ULL);
+}
+
+inline void delay(uint32_t ms){
+  sim::advance(static_cast<uint64_t>(ms) * 1000000ULL);
+}
+
+inline void delayMicroseconds(uint32_t us){
+  sim::advance(static_cast<uint64_t>(us) * 1000ULL);
+}
+
+/***********************************************************
+ * Digital I/O and interrupts
+ ***********************************************************/
+inline void pinMode(int pin, int mode){
+  if(pin >= 0 && pin < sim::NUM_PINS){
+    sim::pin_mode[pin] = mode;
+    if(mode == INPUT_PULLUP && !sim::pin_driven[pin]){
+      sim::pin_level[pin] = HIGH;
+    }
+  }
+}
+
+inline void digitalWrite(int pin, int level){
+  sim::advance(sim::costs.digital_io_ns);
+  sim::write_output(pin, level);
+}
+
+inline int digitalRead(int pin){
+  sim::advance(sim::costs.digital_io_ns);
+  if(pin < 0 || pin >= sim::NUM_PINS){
+    return LOW;
+  }
+  return sim::pin_level[pin];
+}
+
+inline void attachInterrupt(int irq, void (*fn)(), int mode){
+  if(irq >= 0 && irq < sim::NUM_PINS){
+    sim::isr_slots[irq].fn = fn;
+    sim::isr_slots[irq].mode = mode;
+  }
+}
+
+inline void detachInterrupt(int irq){
+  if(irq >= 0 && irq < sim::NUM_PINS){
+    sim::isr_slots[irq] = sim::IsrSlot();
+  }
+}
+
+inline void noInterrupts(){ sim::interrupts_enabled = false; }
+inline void interrupts(){
+  sim::interrupts_enabled = true;
+  sim::run_pending_isrs();
+}
+
+/***********************************************************
+ * Print / Serial
+ ***********************************************************/
+class Print {
+public:
+  virtual ~Print(){}
+  virtual size_t write(uint8_t c) = 0;
+
+  size_t write(const char* str){
+    size_t n = 0;
+    while(*str){
+      n += write(static_cast<uint8_t>(*str++));
+    }
+    return n;
+  }
+
+  size_t write(const uint8_t* buf, size_t len){
+    for(size_t i = 0; i < len; i++){
+      write(buf[i]);
+    }
+    return len;
+  }
+
+  size_t print(const char* str){ return write(str); }
+  size_t print(const std::string& str){ return write(str.c_str()); }
+  size_t print(char c){ return write(static_cast<uint8_t>(c)); }
+  size_t print(unsigned char n, int base = DEC){ return printNumber(n, base); }
+  size_t print(int n, int base = DEC){ return printSigned(n, base); }
+  size_t print(unsigned int n, int base = DEC){ return printNumber(n, base); }
+  size_t print(long n, int base = DEC){ return printSigned(n, base); }
+  size_t print(unsigned long n, int base = DEC){ return printNumber(n, base); }
+  size_t print(long long n, int base = DEC){ return printSigned(n, base); }
+  size_t print(unsigned long long n, int base = DEC){ return printNumber(n, base); }
+  size_t print(double n, int digits = 2){
+    char buf[48];
+    snprintf(buf, sizeof(buf), "%.*f", digits, n);
+    return write(buf);
+  }
+
+  size_t println(){ return write("\r\n"); }
+  template<class T>
+  size_t println(T v){ size_t n = print(v); return n + println(); }
+  template<class T>
+  size_t println(T v, int fmt){ size_t n = print(v, fmt); return n + println(); }
+
+private:
+  size_t printNumber(unsigned long long n, int base){
+    char buf[8 * sizeof(n) + 1];
+    char* p = &buf[sizeof(buf) - 1];
+    *p = '\0';
+    if(base < 2){
+      base = 10;
+    }
+    do {
+      int d = static_cast<int>(n % base);
+      n /= base;
+      *--p = static_cast<char>(d < 10 ? '0' + d : 'A' + d - 10);
+    } while(n);
+    return write(p);
+  }
+
+  size_t printSigned(long long n, int base){
+    if(base == DEC && n < 0){
+      return print('-') + printNumber(static_cast<unsigned long long>(-n), base);
+    }
+    if(base != DEC){
+      // two's complement of the native width, like the Arduino core
+      return printNumber(static_cast<unsigned long long>(static_cast<uint32_t>(n)), base);
+    }
+    return printNumber(static_cast<unsigned long long>(n), base);
+  }
+};
+
+class SimSerial : public Print {
+public:
+  using Print::write;
+  void begin(unsigned long baud){ sim::costs.serial_baud = static_cast<uint32_t>(baud); }
+  void end(){}
+  size_t write(uint8_t c){ sim::serial_write(c); return 1; }
+  int availableForWrite(){ return sim::serial_available_for_write(); }
+  int available(){ return static_cast<int>(sim::serial_rx.size()); }
+  int read(){
+    if(sim::serial_rx.empty()){
+      return -1;
+    }
+    int c = sim::serial_rx.front();
+    sim::serial_rx.pop_front();
+    return c;
+  }
+  void flush(){ sim::advance_to(sim::serial_idle_at_ns); }
+  operator bool(){ return true; }
+};
+
+static SimSerial Serial;
+
+#endif
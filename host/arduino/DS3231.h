@@ -0,0 +1,30 @@
+/* Filename: DS3231.h (host)
+ * Author: Liam Warner
+ * Purpose: simulated DS3231 real time clock. Time of day starts at
+ *          sim::rtc_start_seconds and follows the virtual clock, every getter is one I2C
+ *          register read.
+ */
+
+#ifndef DS3231_H
+#define DS3231_H
+
+#include "Arduino.h"
+#include "Wire.h"
+
+class DS3231 {
+public:
+  byte getSecond(){ return static_cast<byte>(sim::rtc_seconds_of_day() % 60); }
+  byte getMinute(){ return static_cast<byte>((sim::rtc_seconds_of_day() / 60) % 60); }
+  byte getHour(bool& h12, bool& PM_time){
+    h12 = false;
+    uint32_t hour = sim::rtc_seconds_of_day() / 3600;
+    PM_time = hour >= 12;
+    return static_cast<byte>(hour);
+  }
+  byte getDoW(){ return 1; }
+  byte getDate(){ return 1; }
+  byte getMonth(bool& Century){ Century = false; return 1; }
+  byte getYear(){ return 26; }
+};
+
+#endif
@@ -0,0 +1,41 @@
+/* Filename: FlashStorage.h (host)
+ * Author: Liam Warner
+ * Purpose: simulated FlashStorage (cmaglie's SAMD library). Each store keeps its bytes for
+ *          the life of the process, sim::reset() doesn't touch them, so a second power up
+ *          in the same run reads what the first one wrote. Starts out zeroed, like the flash
+ *          right after an upload. A write costs a row erase and program.
+ */
+
+#ifndef FLASH_STORAGE_H
+#define FLASH_STORAGE_H
+
+#include "Arduino.h"
+
+#define FLASH_STORAGE_WRITE_NS 6000000ULL // erase + program of one 256 byte row
+
+template<class T>
+class FlashStorageClass {
+public:
+  FlashStorageClass() : writes(0) { memset(&data, 0, sizeof(T)); }
+
+  void read(T* value){ memcpy(value, &data, sizeof(T)); }
+  T read(){
+    T value;
+    read(&value);
+    return value;
+  }
+  void write(T value){
+    sim::advance(FLASH_STORAGE_WRITE_NS);
+    memcpy(&data, &value, sizeof(T));
+    writes++;
+  }
+
+  uint32_t writes; // erase cycles used, the real part is good for about 10000
+
+private:
+  T data;
+};
+
+#define FlashStorage(name, T) FlashStorageClass<T> name
+
+#endif
@@ -0,0 +1,38 @@
+/* Filename: MIDIUSB.h (host)
+ * Author: Liam Warner
+ * Purpose: simulated USB MIDI endpoint. Packets are injected with sim::schedule_midi and
+ *          become readable once the virtual clock reaches their arrival time.
+ */
+
+#ifndef MIDIUSB_H
+#define MIDIUSB_H
+
+#include "Arduino.h"
+
+typedef struct {
+  uint8_t header;
+  uint8_t byte1;
+  uint8_t byte2;
+  uint8_t byte3;
+} midiEventPacket_t;
+
+class MIDI_ {
+public:
+  midiEventPacket_t read(){
+    midiEventPacket_t rx = {0, 0, 0, 0};
+    sim::MidiPacket p;
+    if(sim::midi_pop(p)){
+      rx.header = p.header;
+      rx.byte1 = p.byte1;
+      rx.byte2 = p.byte2;
+      rx.byte3 = p.byte3;
+    }
+    return rx;
+  }
+  void sendMIDI(midiEventPacket_t){}
+  void flush(){}
+};
+
+static MIDI_ MidiUSB;
+
+#endif
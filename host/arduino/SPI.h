@@ -0,0 +1,40 @@
+/* Filename: SPI.h (host)
+ * Author: Liam Warner
+ * Purpose: simulated SPI master. Bytes are clocked at the transaction's clock rate and
+ *          shifted into every TPIC whose chip select is low (see sim::spi_transfer).
+ */
+
+#ifndef SPI_H
+#define SPI_H
+
+#include "Arduino.h"
+
+#define MSBFIRST 1
+#define LSBFIRST 0
+#define SPI_MODE0 0x00
+#define SPI_MODE1 0x04
+#define SPI_MODE2 0x08
+#define SPI_MODE3 0x0C
+
+class SPISettings {
+public:
+  SPISettings() : clock(4000000), bitOrder(MSBFIRST), dataMode(SPI_MODE0) {}
+  SPISettings(uint32_t clock_hz, uint8_t bit_order, uint8_t data_mode)
+    : clock(clock_hz), bitOrder(bit_order), dataMode(data_mode) {}
+  uint32_t clock;
+  uint8_t bitOrder;
+  uint8_t dataMode;
+};
+
+class SPIClass {
+public:
+  void begin(){}
+  void end(){}
+  void beginTransaction(SPISettings settings){ sim::spi_begin_transaction(settings.clock); }
+  void endTransaction(){ sim::spi_end_transaction(); }
+  uint8_t transfer(uint8_t data){ return sim::spi_transfer(data); }
+};
+
+static SPIClass SPI;
+
+#endif
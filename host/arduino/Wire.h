@@ -0,0 +1,21 @@
+/* Filename: Wire.h (host)
+ * Author: Liam Warner
+ * Purpose: simulated I2C master. Only the bus clock matters to the simulation, device
+ *          reads are costed by the peripheral models in sim/sim_core.h.
+ */
+
+#ifndef WIRE_H
+#define WIRE_H
+
+#include "Arduino.h"
+
+class TwoWire {
+public:
+  void begin(){}
+  void end(){}
+  void setClock(uint32_t hz){ sim::i2c_clock_hz = hz ? hz : 100000; }
+};
+
+static TwoWire Wire;
+
+#endif
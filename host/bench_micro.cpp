@@ -0,0 +1,217 @@
+/* Filename: bench_micro.cpp
+ * Author: Liam Warner
+ * Purpose: host microbenchmarks for the hot functions in midi_autonomous_performance_v4.h,
+ *          to have a baseline before and after every change to it. Each benchmark runs a
+ *          fixed number of operations several times and reports the median host ns/op and
+ *          the heap allocations per op: every malloc/calloc/realloc made from this program,
+ *          the firmware included, is counted (the Makefile links it with --wrap for them),
+ *          and global operator new goes through malloc.
+ *          The last one runs a full simulated hour of autonomous mode (licks) in virtual time.
+ *          Output is CSV on stdout: benchmark,iterations,ns_per_op,allocs_per_op
+ *          Host ns/op are only comparable between runs on the same machine.
+ *
+ *   usage: bench_micro [--filter SUBSTRING] [--repeats N] [--hour-seconds S]
+ */
+
+#include "../orchestrion_control_v4.ino"
+#include "sim/board.h"
+
+#include <chrono>
+#include <new>
+#include <string>
+
+/***********************************************************
+ * Allocation counting
+ ***********************************************************/
+static uint64_t heap_allocs = 0;
+
+// -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc sends this program's calls here
+extern "C" {
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* p, size_t size);
+
+void* __wrap_malloc(size_t size){
+  heap_allocs++;
+  return __real_malloc(size);
+}
+void* __wrap_calloc(size_t count, size_t size){
+  heap_allocs++;
+  return __real_calloc(count, size);
+}
+void* __wrap_realloc(void* p, size_t size){
+  heap_allocs++;
+  return __real_realloc(p, size);
+}
+}
+
+void* operator new(size_t size){
+  void* p = malloc(size ? size : 1);
+  if(!p){
+    throw std::bad_alloc();
+  }
+  return p;
+}
+void* operator new[](size_t size){
+  void* p = malloc(size ? size : 1);
+  if(!p){
+    throw std::bad_alloc();
+  }
+  return p;
+}
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+
+static volatile int32_t sink = 0; // results go here so nothing is optimized out
+
+static std::string filter;
+static int repeats = 5;
+
+struct BenchResult {
+  uint64_t iterations;
+  double ns_per_op;
+  double allocs_per_op;
+};
+
+static void print_result(const char* name, const BenchResult& r){
+  printf("%s,%llu,%.2f,%.3f\n", name, (unsigned long long)r.iterations, r.ns_per_op, r.allocs_per_op);
+  fflush(stdout);
+}
+
+static bool selected(const char* name){
+  return filter.empty() || std::string(name).find(filter) != std::string::npos;
+}
+
+/***********************************************************
+ * Runs op(i) for i in [0, iterations) repeats times, reports
+ * the median time per op and allocations over all repeats.
+ ***********************************************************/
+template<class Op>
+static void bench(const char* name, uint64_t iterations, Op op){
+  if(!selected(name)){
+    return;
+  }
+  std::vector<double> ns;
+  uint64_t allocs_before = heap_allocs;
+  for(int r = 0; r < repeats; r++){
+    auto start = std::chrono::steady_clock::now();
+    for(uint64_t i = 0; i < iterations; i++){
+      op(i);
+    }
+    auto end = std::chrono::steady_clock::now();
+    ns.push_back(std::chrono::duration<double, std::nano>(end - start).count() / iterations);
+  }
+  std::sort(ns.begin(), ns.end());
+  BenchResult res = {iterations, ns[ns.size() / 2],
+                     static_cast<double>(heap_allocs - allocs_before) / (static_cast<double>(iterations) * repeats)};
+  print_result(name, res);
+}
+
+int main(int argc, char** argv){
+  double hour_seconds = 3600;
+
+  for(int i = 1; i < argc; i++){
+    std::string a = argv[i];
+    bool has_val = i + 1 < argc;
+    if(a == "--filter" && has_val){
+      filter = argv[++i];
+    }else if(a == "--repeats" && has_val){
+      repeats = atoi(argv[++i]);
+    }else if(a == "--hour-seconds" && has_val){
+      hour_seconds = atof(argv[++i]);
+    }else{
+      fprintf(stderr, "usage: bench_micro [--filter SUBSTRING] [--repeats N] [--hour-seconds S]\n");
+      return 2;
+    }
+  }
+  if(repeats < 1 || hour_seconds <= 0){
+    fprintf(stderr, "bad arguments\n");
+    return 2;
+  }
+
+  board::reset(board::MODE_MIDI, 1);
+  setup();
+  printf("benchmark,iterations,ns_per_op,allocs_per_op\n");
+
+  // every note against every velocity (0 = off) of the other note on its chip
+  bench("get_SPI_message", 1 << 20, [](uint64_t i){
+    int note = i & 7;
+    int vel = (i >> 3) & 3;
+    int other_vel = (i >> 5) & 3;
+    tpic_shadow[get_tpic(note)] = static_cast<byte>(get_velocity_bits(other_vel) << ((note % 2) ? 0 : 3));
+    Note n = {note, 0, vel};
+    sink += get_SPI_message(n);
+  });
+
+  bench("getStartNoteIndex", 1 << 20, [](uint64_t){
+    sink += getStartNoteIndex(R);
+  });
+
+  // every history the model order has, at each energy level
+  bench("getNextNoteIndex", 1 << 20, [](uint64_t i){
+    NoteHistory h = {static_cast<uint16_t>(i % NGRAM_CONTEXTS)};
+    sink += getNextNoteIndex(h, 1 + (i / NGRAM_CONTEXTS) % 3, R);
+  });
+
+  // every energy level with the time signatures in the bank and one that has no licks
+  bench("pick_licks_by_criteria", 1 << 20, [](uint64_t i){
+    static const int sigs[3][2] = {{4, 4}, {3, 4}, {5, 4}};
+    const int* sig = sigs[(i >> 2) % 3];
+    LickSpan span = pick_licks_by_criteria(1 + (i & 3), sig[0], sig[1]);
+    sink += span.count;
+  });
+
+  // on a fresh copy of a bank lick each time, the copy is part of the cost
+  static std::vector<const Lick*> bank_licks;
+  for(int i = 0; i < BoL_len; i++){
+    if(Bank_of_licks_orig[i].num_notes > 0){ //the bank array has unused slots at the end
+      bank_licks.push_back(&Bank_of_licks_orig[i]);
+    }
+  }
+  bench("add_subtract_note_to_lick", 1 << 18, [](uint64_t i){
+    Lick lick = *bank_licks[i % bank_licks.size()];
+    add_note_to_lick(lick, static_cast<int>(i % lick.num_notes));
+    subtract_note_from_lick(lick);
+    sink += lick.num_notes;
+  });
+
+  // all 256 presence patterns
+  bench("get_next_note_idx_from_sensors", 1 << 20, [](uint64_t i){
+    sensor_presence_band.mask = static_cast<uint8_t>(i * 37);
+    sink += get_next_note_idx_from_sensors();
+  });
+
+  // one simulated hour of autonomous playing at the busiest schedule band, sensors waving
+  if(selected("play_licks_hour")){
+    board::reset(board::MODE_AUTO, 1);
+    sim::rtc_start_seconds = 14 * 3600;
+    sim::adc_model = board::adc_wave;
+    // keep the simulator's own bookkeeping off the allocation count
+    sim::capture_spi = false;
+    board::onsets.reserve(static_cast<size_t>(hour_seconds * 50));
+    uint64_t allocs_before = heap_allocs;
+    uint64_t end_ns = static_cast<uint64_t>(hour_seconds * 1e9);
+    board::schedule_stop(end_ns, 120000000000ULL);
+    auto start = std::chrono::steady_clock::now();
+    try {
+      setup();
+      while(sim::now_ns < end_ns){
+        loop();
+      }
+    } catch(const sim::Timeout&){
+      fprintf(stderr, "play_licks_hour: hard deadline hit\n");
+    }
+    auto end = std::chrono::steady_clock::now();
+    double total_ns = std::chrono::duration<double, std::nano>(end - start).count();
+    uint64_t allocs = heap_allocs - allocs_before;
+    BenchResult hour = {1, total_ns, static_cast<double>(allocs)};
+    print_result("play_licks_hour", hour);
+    size_t onsets = board::onsets.size();
+    BenchResult per_onset = {onsets, onsets ? total_ns / onsets : 0.0,
+                             onsets ? static_cast<double>(allocs) / onsets : 0.0};
+    print_result("play_licks_hour_per_onset", per_onset);
+  }
+  return 0;
+}
@@ -0,0 +1,281 @@
+/* Filename: bench_midi.cpp
+ * Author: Liam Warner
+ * Purpose: live MIDI input benchmark. Feeds a synthetic note stream (note-on plus a
+ *          note-off 40 ms later, cycling through the drum's pitches) into the simulated USB
+ *          endpoint with the board in MIDI mode, and reports how many packets per second
+ *          the input stage gets through and the latency from a note-on packet arriving to
+ *          its TPIC byte latching. Every note-on is followed through the chord window and
+ *          the retrigger queue, so each onset is timed from the packet that produced it, and
+ *          note-ons struck at once and ones struck later from the retrigger queue are
+ *          reported apart. Virtual time only counts modelled costs (bus time, clock
+ *          reads, ...), host time shows the firmware's own processing cost.
+ *          With --chord-size N > 1 the stream is N-note chords instead (--rate is then
+ *          chords per second), each note-on landing up to --chord-spread-us after the chord's
+ *          time, and it also reports how far apart the notes of each chord were struck.
+ *          --single-note sends every note-on to the same tongue (a roll), to measure the
+ *          retrigger queue and the fastest that one tongue actually repeats.
+ *          --calibrate runs the solenoid on-time sweep after a first power up, so the run uses
+ *          the calibrated on-times instead of the fixed ones.
+ *          --mode-switches N plays autonomous mode (2 pm, a hand waving over the sensors) for
+ *          2-6 s, then flips to MIDI mode and streams for 2 s, N times over (--seconds is
+ *          ignored). Mode-switch latency is how long the note-on sent right at each flip
+ *          waits before the firmware reads it.
+ *          Every run also reports the MIDI service latency, how long each packet sat in the
+ *          USB queue, measured at the end of the loop() call that read it.
+ *
+ *   usage: bench_midi [--rate HZ] [--seconds N] [--seed S] [--chord-size N]
+ *                     [--chord-spread-us U] [--single-note]
+ *                     [--calibrate] [--mode-switches N]
+ */
+
+#include "../orchestrion_control_v4.ino"
+#include "sim/board.h"
+
+#include <chrono>
+#include <deque>
+#include <string>
+
+static double percentile(std::vector<uint64_t> v, double p){
+  if(v.empty()){
+    return 0;
+  }
+  std::sort(v.begin(), v.end());
+  size_t idx = static_cast<size_t>(p * (v.size() - 1));
+  return static_cast<double>(v[idx]);
+}
+
+int main(int argc, char** argv){
+  double rate = 1000;
+  double seconds = 10;
+  uint64_t seed = 1;
+  int chord_size = 1;
+  double chord_spread_us = 500;
+  int num_pitches = 8;
+  bool calibrate = false;
+  int mode_switches = 0;
+
+  for(int i = 1; i < argc; i++){
+    std::string a = argv[i];
+    bool has_val = i + 1 < argc;
+    if(a == "--rate" && has_val){
+      rate = atof(argv[++i]);
+    }else if(a == "--seconds" && has_val){
+      seconds = atof(argv[++i]);
+    }else if(a == "--seed" && has_val){
+      seed = strtoull(argv[++i], nullptr, 10);
+    }else if(a == "--chord-size" && has_val){
+      chord_size = atoi(argv[++i]);
+    }else if(a == "--chord-spread-us" && has_val){
+      chord_spread_us = atof(argv[++i]);
+    }else if(a == "--single-note"){
+      num_pitches = 1;
+    }else if(a == "--calibrate"){
+      calibrate = true;
+    }else if(a == "--mode-switches" && has_val){
+      mode_switches = atoi(argv[++i]);
+    }else{
+      fprintf(stderr, "usage: bench_midi [--rate HZ] [--seconds N] [--seed S] [--chord-size N]\n"
+                      "                  [--chord-spread-us U] [--single-note] [--calibrate] [--mode-switches N]\n");
+      return 2;
+    }
+  }
+
+  if(calibrate){
+    board::power_up_calibration();
+  }
+  board::reset(mode_switches > 0 ? board::MODE_AUTO : board::MODE_MIDI, seed);
+  uint64_t start_ns = 10000000ULL;
+  uint64_t end_ns = static_cast<uint64_t>(seconds * 1e9);
+  std::vector<std::pair<uint64_t, uint64_t> > midi_phases; // [start, end) of each stretch of MIDI mode
+  if(mode_switches > 0){
+    sim::rtc_start_seconds = 14 * 3600;
+    sim::adc_model = board::adc_wave;
+    uint64_t t = start_ns;
+    for(int k = 0; k < mode_switches; k++){
+      uint64_t flip = t + 2000000000ULL + sim::rand32() % 4000000000U;
+      sim::schedule_pin(flip, AUTO_PIN, HIGH);
+      sim::schedule_pin(flip + 2000000000ULL, AUTO_PIN, LOW);
+      midi_phases.push_back(std::make_pair(flip, flip + 2000000000ULL));
+      t = flip + 2000000000ULL;
+    }
+    end_ns = t;
+  }else{
+    midi_phases.push_back(std::make_pair(start_ns, end_ns));
+  }
+  for(size_t k = 0; k < midi_phases.size(); k++){
+    if(chord_size > 1){
+      board::midi_chords(midi_phases[k].first, midi_phases[k].second, rate, chord_size,
+                         static_cast<uint64_t>(chord_spread_us * 1e3), available_notes, num_pitches);
+    }else{
+      board::midi_stream(midi_phases[k].first, midi_phases[k].second, rate, available_notes, num_pitches);
+    }
+  }
+  board::schedule_stop(end_ns, 1000000000ULL);
+
+  // every packet, the firmware reads them in this order
+  std::vector<sim::MidiPacket> packets(sim::midi_queue.begin(), sim::midi_queue.end());
+  std::vector<uint64_t> service_ns;
+  std::vector<uint64_t> switch_ns;
+  size_t next_phase = 0;
+
+  // Each note-on is followed the way the firmware handles it (noteOn, midi_chord_poll and the
+  // retrigger queue): held in the chord, then struck at once, queued or dropped. Each loop()
+  // reads its packets and polls the chord before the scheduler runs, so a note's state before
+  // the loop() is the state the chord was struck against.
+  bool chord_held[8] = {false};
+  uint64_t chord_at[8] = {0};
+  std::deque<uint64_t> waiting[8]; // arrival of each note-on in the retrigger queue, oldest first
+  std::vector<uint64_t> direct_ns;
+  std::vector<uint64_t> retrigger_ns;
+  size_t packets_followed = 0;
+  size_t onsets_followed = 0;
+
+  uint64_t loops = 0;
+  auto wall_start = std::chrono::steady_clock::now();
+  try {
+    setup();
+    while(sim::now_ns < end_ns){
+      bool inactive_before[8];
+      for(int i = 0; i < 8; i++){
+        inactive_before[i] = note_inactive_arr[i];
+      }
+      uint32_t chords_before = midi_stats.chords;
+      uint32_t retriggered_before = midi_stats.retriggered;
+      loop();
+      loops++;
+
+      // note-ons read this loop() join the chord, a second one for a held note is dropped
+      for(; packets_followed < midi_stats.packets && packets_followed < packets.size(); packets_followed++){
+        const sim::MidiPacket& p = packets[packets_followed];
+        int idx = is_valid_note(p.byte2);
+        if(p.header != 0x9 || p.byte3 == 0 || idx < 0 || velocity_level(p.byte3) == 0 || chord_held[idx]){
+          continue;
+        }
+        chord_held[idx] = true;
+        chord_at[idx] = p.t_ns;
+      }
+      bool direct[8] = {false};
+      if(midi_stats.chords != chords_before){
+        for(int i = 0; i < 8; i++){
+          if(!chord_held[i]){
+            continue;
+          }
+          if(inactive_before[i] && waiting[i].empty()){
+            direct[i] = true;
+          }else if(waiting[i].size() < RETRIGGER_DEPTH){
+            waiting[i].push_back(chord_at[i]);
+          }
+          chord_held[i] = false;
+        }
+      }else if(midi_chord.count == 0){
+        std::fill(chord_held, chord_held + 8, false); //midi_input_drop(), out of MIDI mode
+      }
+      uint32_t retriggers = midi_stats.retriggered - retriggered_before;
+      for(; onsets_followed < board::onsets.size(); onsets_followed++){
+        const board::Onset& o = board::onsets[onsets_followed];
+        int i = o.note_index;
+        if(i < 8 && direct[i]){
+          direct_ns.push_back(o.t_ns - chord_at[i]);
+          direct[i] = false;
+        }else if(i < 8 && retriggers > 0 && !waiting[i].empty()){
+          retrigger_ns.push_back(o.t_ns - waiting[i].front());
+          waiting[i].pop_front();
+          retriggers--;
+        }
+        //anything else is autonomous mode's own
+      }
+      for(int i = 0; i < 8; i++){
+        while(waiting[i].size() > note_retrigger[i].count){
+          waiting[i].pop_back(); //given up: scheduler full, or midi_input_drop()
+        }
+      }
+
+      while(service_ns.size() < midi_stats.packets && service_ns.size() < packets.size()){
+        size_t k = service_ns.size();
+        service_ns.push_back(sim::now_ns - packets[k].t_ns);
+        if(mode_switches > 0 && next_phase < midi_phases.size() && packets[k].t_ns >= midi_phases[next_phase].first){
+          switch_ns.push_back(service_ns.back()); //first packet after a flip to MIDI mode
+          next_phase++;
+        }
+      }
+    }
+  } catch(const sim::Timeout&){
+    fprintf(stderr, "hard deadline hit\n");
+    return 1;
+  }
+  double wall_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+  double stream_s = 0;
+  for(size_t k = 0; k < midi_phases.size(); k++){
+    stream_s += (midi_phases[k].second - midi_phases[k].first) / 1e9;
+  }
+
+  if(mode_switches > 0){
+    printf("mode switches       %d, auto -> MIDI latency p50 %.1f us, max %.1f us\n", mode_switches,
+           percentile(switch_ns, 0.5) / 1e3, percentile(switch_ns, 1.0) / 1e3);
+  }
+  if(chord_size > 1){
+    printf("stream              %.0f chords/s of %d notes, spread over %.0f us, for %.3f s\n",
+           rate, chord_size, chord_spread_us, stream_s);
+  }else{
+    printf("stream              %.0f note-ons/s for %.3f s\n", rate, stream_s);
+  }
+  printf("loop() calls        %llu (%.1f /s)\n", (unsigned long long)loops, loops / (sim::now_ns / 1e9));
+  printf("packets             %lu received, %.1f /s virtual, %.0f /s host\n",
+         (unsigned long)midi_stats.packets, midi_stats.packets / stream_s,
+         wall_s > 0 ? midi_stats.packets / wall_s : 0.0);
+  printf("note events         %lu queued, %lu struck in %lu groups, %lu note-offs, %lu ignored, %lu full batches\n",
+         (unsigned long)midi_stats.queued, (unsigned long)midi_stats.struck, (unsigned long)midi_stats.chords,
+         (unsigned long)midi_stats.note_offs, (unsigned long)midi_stats.ignored,
+         (unsigned long)midi_stats.batches_full);
+  printf("busy note-ons       %lu deferred (%lu struck on retrigger), %lu dropped\n",
+         (unsigned long)midi_stats.deferred, (unsigned long)midi_stats.retriggered,
+         (unsigned long)midi_stats.dropped_busy);
+
+  // time between strikes of the same tongue
+  std::vector<uint64_t> repeat_ns;
+  uint64_t last_onset_ns[16] = {0};
+  for(const board::Onset& o : board::onsets){
+    if(last_onset_ns[o.note_index]){
+      repeat_ns.push_back(o.t_ns - last_onset_ns[o.note_index]);
+    }
+    last_onset_ns[o.note_index] = o.t_ns;
+  }
+  double min_repeat_ns = repeat_ns.empty() ? 0 : percentile(repeat_ns, 0.0);
+  printf("same-tongue repeat  min %.1f ms (%.1f Hz max), p50 %.1f ms\n", min_repeat_ns / 1e6,
+         min_repeat_ns > 0 ? 1e9 / min_repeat_ns : 0.0, percentile(repeat_ns, 0.5) / 1e6);
+  if(chord_size > 1){
+    // first to last onset of each chord, chords are one period apart
+    uint64_t period = static_cast<uint64_t>(1e9 / rate);
+    std::vector<uint64_t> spread_ns;
+    size_t o = 0;
+    while(o < board::onsets.size()){
+      uint64_t chord = (board::onsets[o].t_ns - start_ns) / period;
+      uint64_t first = board::onsets[o].t_ns;
+      uint64_t last = first;
+      while(o < board::onsets.size() && (board::onsets[o].t_ns - start_ns) / period == chord){
+        last = board::onsets[o].t_ns;
+        o++;
+      }
+      spread_ns.push_back(last - first);
+    }
+    printf("chord onset spread  p50 %.1f us, p99 %.1f us, max %.1f us over %zu chords\n",
+           percentile(spread_ns, 0.5) / 1e3, percentile(spread_ns, 0.99) / 1e3,
+           percentile(spread_ns, 1.0) / 1e3, spread_ns.size());
+  }
+  printf("MIDI service        p50 %.1f us, p99 %.1f us, max %.1f us over %zu packets\n",
+         percentile(service_ns, 0.5) / 1e3, percentile(service_ns, 0.99) / 1e3,
+         percentile(service_ns, 1.0) / 1e3, service_ns.size());
+  printf("MIDI->SPI struck    p50 %.1f us, p99 %.1f us, max %.1f us over %zu onsets struck at once\n",
+         percentile(direct_ns, 0.5) / 1e3, percentile(direct_ns, 0.99) / 1e3,
+         percentile(direct_ns, 1.0) / 1e3, direct_ns.size());
+  printf("MIDI->SPI retrigger p50 %.1f ms, p99 %.1f ms, max %.1f ms over %zu onsets from the retrigger queue\n",
+         percentile(retrigger_ns, 0.5) / 1e6, percentile(retrigger_ns, 0.99) / 1e6,
+         percentile(retrigger_ns, 1.0) / 1e6, retrigger_ns.size());
+  if(direct_ns.size() != midi_stats.struck || retrigger_ns.size() != midi_stats.retriggered){
+    printf("warning             %zu + %zu onsets followed, the firmware counted %lu + %lu\n", direct_ns.size(),
+           retrigger_ns.size(), (unsigned long)midi_stats.struck, (unsigned long)midi_stats.retriggered);
+  }
+  printf("SPI                 %llu transactions, %.3f ms on the bus\n",
+         (unsigned long long)sim::stats.spi_transactions, sim::stats.spi_bus_ns / 1e6);
+  return 0;
+}
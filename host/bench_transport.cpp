@@ -0,0 +1,187 @@
+/* Filename: bench_transport.cpp
+ * Author: Liam Warner
+ * Purpose: playback timing benchmark. Plays the same long random note sequence twice on the
+ *          simulated board, once the old way (wait a note's duration from when it actually
+ *          fired) and once on the transport (transport_strike), with random stalls injected
+ *          into the idle work to stand in for loop overruns and Serial stalls. Halfway
+ *          through, the tempo changes. Reports cumulative drift (last onset against the
+ *          ideal grid) and per-onset jitter (error of each inter-onset interval) from the
+ *          TPIC latch times. The run starts a few seconds before micros() wraps.
+ *
+ *   usage: bench_transport [--notes N] [--bpm B] [--bpm-change B] [--stall-ms M]
+ *                          [--stalls-per-s R] [--seed S]
+ */
+
+#include "../orchestrion_control_v4.ino"
+#include "sim/board.h"
+
+#include <string>
+
+static double stall_max_ns = 3e6;
+static double stalls_per_s = 10;
+static uint64_t next_stall_ns = 0;
+
+// idle work as in playback, plus at random times a stall the deadline can't see coming
+static void stalling_idle_work(){
+  read_sensor_vals();
+  if(sim::now_ns >= next_stall_ns){
+    sim::advance(static_cast<uint64_t>(sim::rand32() % static_cast<uint32_t>(stall_max_ns)));
+    next_stall_ns = sim::now_ns + sim::rand32() % static_cast<uint32_t>(2e9 / stalls_per_s);
+  }
+}
+
+static double percentile(std::vector<double> v, double p){
+  if(v.empty()){
+    return 0;
+  }
+  std::sort(v.begin(), v.end());
+  size_t idx = static_cast<size_t>(p * (v.size() - 1));
+  return v[idx];
+}
+
+struct RunResult {
+  double drift_us;       // last onset minus its ideal time
+  double max_late_us;    // worst onset error
+  std::vector<double> jitter_us; // |actual interval - ideal interval| per onset
+  uint32_t resyncs;
+};
+
+/***********************************************************
+ * Runs the sequence and compares the onsets with the ideal
+ * times. Ideal: each note lasts its ticks at the tempo in
+ * effect, the new tempo starting at the first beat boundary
+ * at or after the note where it was requested (both runs are
+ * measured against this same grid).
+ ***********************************************************/
+static RunResult run(const std::vector<Note>& seq, int bpm, int bpm_change, bool use_transport){
+  size_t first_onset = board::onsets.size();
+  size_t change_at = seq.size() / 2;
+
+  scheduler_idle_work = stalling_idle_work;
+  scheduler_wait_until(micros() + 100000UL); //settle, let earlier notes release
+
+  Transport transport;
+  transport_start(transport, bpm);
+  int cur_bpm = bpm;
+  for(size_t i = 0; i < seq.size(); i++){
+    if(use_transport){
+      transport_strike(transport, seq[i]);
+      if(i + 1 == change_at){
+        transport_set_bpm(transport, bpm_change);
+      }
+    }else{
+      scheduler_wait_for_release(seq[i].note_index);
+      strike_note(seq[i]);
+      scheduler_run_due();
+      uint32_t on_us = micros();
+      if(i + 1 == change_at){
+        cur_bpm = bpm_change; //took effect right away
+      }
+      scheduler_wait_until(on_us + get_note_duration_us(seq[i], cur_bpm));
+    }
+  }
+  scheduler_idle_work = NULL;
+
+  // ideal onset times (ns from the first onset's ideal time)
+  std::vector<double> ideal(seq.size());
+  double origin_ns = 0;
+  uint32_t origin_tick = 0;
+  uint32_t tick = 0;
+  int ideal_bpm = bpm;
+  bool change_pending = false;
+  for(size_t i = 0; i < seq.size(); i++){
+    ideal[i] = origin_ns + (tick - origin_tick) * 60e9 / (ideal_bpm * TICKS_PER_QUARTER);
+    uint32_t next = tick + seq[i].duration_ticks;
+    if(change_pending){
+      uint32_t beat = (tick + TICKS_PER_QUARTER - 1) / TICKS_PER_QUARTER * TICKS_PER_QUARTER;
+      if(beat <= next){
+        origin_ns += (beat - origin_tick) * 60e9 / (ideal_bpm * TICKS_PER_QUARTER);
+        origin_tick = beat;
+        ideal_bpm = bpm_change;
+        change_pending = false;
+      }
+    }
+    tick = next;
+    if(i + 1 == change_at){
+      change_pending = true;
+    }
+  }
+
+  RunResult r = {0, 0, std::vector<double>(), transport.resyncs};
+  if(board::onsets.size() - first_onset != seq.size()){
+    fprintf(stderr, "expected %zu onsets, got %zu\n", seq.size(), board::onsets.size() - first_onset);
+    return r;
+  }
+  // the first onset fixes the grid's position, the strike itself costs a few us of bus time
+  double t0 = static_cast<double>(board::onsets[first_onset].t_ns);
+  for(size_t i = 0; i < seq.size(); i++){
+    double late = (board::onsets[first_onset + i].t_ns - t0 - ideal[i]) / 1e3;
+    r.max_late_us = std::max(r.max_late_us, std::fabs(late));
+    if(i > 0){
+      double actual_ioi = static_cast<double>(board::onsets[first_onset + i].t_ns - board::onsets[first_onset + i - 1].t_ns);
+      r.jitter_us.push_back(std::fabs(actual_ioi - (ideal[i] - ideal[i - 1])) / 1e3);
+    }
+    r.drift_us = late;
+  }
+  return r;
+}
+
+static void report(const char* name, const RunResult& r){
+  printf("%-10s drift %+.1f us, worst onset error %.1f us, jitter p50 %.1f us, p99 %.1f us, max %.1f us, %lu resyncs\n",
+         name, r.drift_us, r.max_late_us, percentile(r.jitter_us, 0.5), percentile(r.jitter_us, 0.99),
+         percentile(r.jitter_us, 1.0), (unsigned long)r.resyncs);
+}
+
+int main(int argc, char** argv){
+  int notes = 10000;
+  int bpm = 120;
+  int bpm_change = 96;
+  uint64_t seed = 1;
+
+  for(int i = 1; i < argc; i++){
+    std::string a = argv[i];
+    bool has_val = i + 1 < argc;
+    if(a == "--notes" && has_val){
+      notes = atoi(argv[++i]);
+    }else if(a == "--bpm" && has_val){
+      bpm = atoi(argv[++i]);
+    }else if(a == "--bpm-change" && has_val){
+      bpm_change = atoi(argv[++i]);
+    }else if(a == "--stall-ms" && has_val){
+      stall_max_ns = atof(argv[++i]) * 1e6;
+    }else if(a == "--stalls-per-s" && has_val){
+      stalls_per_s = atof(argv[++i]);
+    }else if(a == "--seed" && has_val){
+      seed = strtoull(argv[++i], nullptr, 10);
+    }else{
+      fprintf(stderr, "usage: bench_transport [--notes N] [--bpm B] [--bpm-change B] [--stall-ms M]\n"
+                      "                       [--stalls-per-s R] [--seed S]\n");
+      return 2;
+    }
+  }
+  if(notes < 2 || bpm <= 0 || bpm_change <= 0 || stall_max_ns < 1 || stalls_per_s <= 0){
+    fprintf(stderr, "bad arguments\n");
+    return 2;
+  }
+
+  board::reset(board::MODE_MIDI, seed);
+  setup();
+  sim::advance_to((1ULL << 32) * 1000ULL - 5000000000ULL); //5 s before micros() wraps
+
+  // sixteenths, eighths, triplet eighths and dotted eighths
+  const uint8_t durations[4] = {TICKS_PER_SIXTEENTH, 2 * TICKS_PER_SIXTEENTH, TICKS_PER_QUARTER / 3, 3 * TICKS_PER_SIXTEENTH};
+  std::vector<Note> seq;
+  for(int i = 0; i < notes; i++){
+    Note n = {static_cast<int>(sim::rand32() % 8), 0, 2, 100};
+    n.duration_ticks = durations[sim::rand32() % 4];
+    seq.push_back(n);
+  }
+
+  printf("sequence   %d notes at %d bpm, %d bpm from note %d, %.1f stalls/s of up to %.1f ms\n",
+         notes, bpm, bpm_change, notes / 2, stalls_per_s, stall_max_ns / 1e6);
+  RunResult relative = run(seq, bpm, bpm_change, false);
+  report("relative", relative);
+  RunResult grid = run(seq, bpm, bpm_change, true);
+  report("transport", grid);
+  return 0;
+}
@@ -0,0 +1,76 @@
+/* Filename: ngram_fallback_test.cpp
+ * Author: Liam Warner
+ * Purpose: checks both paths of getNextNoteIndex(). The generated tables trained on the lick
+ *          banks have a row for every history, so the firmware built with them never takes
+ *          the hand-typed fallback; a corpus that leaves a level or a note out does. This
+ *          program builds the firmware against a small table of its own instead, where some
+ *          histories have a row and the rest are NGRAM_NO_ROW, and checks that every draw
+ *          comes from the row or from next_note_cdf exactly as the table says, with the same
+ *          random numbers. Exits 0 if all of them do, 1 if not.
+ *
+ *   usage: ngram_fallback_test
+ */
+
+// Stands in for orchestrion_ngram_tables.h, whose include guard this defines. Order 1, so a
+// history is just the last note: at every level notes 0-3 have a row that always draws note 7,
+// notes 4-7 have none. Level 1 (energy 2) has no rows at all, like a corpus without it.
+#define ORCHESTRION_NGRAM_TABLES_H
+#define NGRAM_ORDER 1
+#define NGRAM_LEVELS 3
+#define NGRAM_CONTEXTS 8
+#define NGRAM_NUM_ROWS 1
+#define NGRAM_NO_ROW 0xFF
+
+typedef uint8_t ngram_row_t;
+
+static const ngram_row_t ngram_context_row[NGRAM_LEVELS][NGRAM_CONTEXTS] = {
+  {0, 0, 0, 0, NGRAM_NO_ROW, NGRAM_NO_ROW, NGRAM_NO_ROW, NGRAM_NO_ROW},
+  {NGRAM_NO_ROW, NGRAM_NO_ROW, NGRAM_NO_ROW, NGRAM_NO_ROW, NGRAM_NO_ROW, NGRAM_NO_ROW, NGRAM_NO_ROW, NGRAM_NO_ROW},
+  {0, 0, 0, 0, NGRAM_NO_ROW, NGRAM_NO_ROW, NGRAM_NO_ROW, NGRAM_NO_ROW}
+};
+
+static const uint8_t ngram_rows[NGRAM_NUM_ROWS][7] = {
+  {0, 0, 0, 0, 0, 0, 0}
+};
+
+#include "../orchestrion_control_v4.ino"
+#include "sim/board.h"
+
+#define DRAWS 2000
+
+int main(){
+  int failures = 0;
+  uint32_t fallback_draws = 0;
+  uint32_t row_draws = 0;
+  for(int energy = 1; energy <= 3; energy++){
+    int level = energy - 1;
+    for(int last = 0; last < 8; last++){
+      NoteHistory history;
+      note_history_start(history, last);
+      Rng R;
+      Rng expect;
+      rng_seed(R, 1234 + energy * 8 + last);
+      rng_seed(expect, 1234 + energy * 8 + last);
+      bool has_row = ngram_context_row[level][last] != NGRAM_NO_ROW;
+      int bad = 0;
+      for(int k = 0; k < DRAWS; k++){
+        int got = getNextNoteIndex(history, energy, R);
+        int want = has_row ? sample_ngram_row(ngram_rows[0], expect) : sample_note_cdf(next_note_cdf[level][last], expect);
+        bad += got != want;
+      }
+      if(has_row){
+        row_draws += DRAWS;
+      }else{
+        fallback_draws += DRAWS;
+      }
+      if(bad){
+        printf("energy %d, last note %d: %d of %d draws not from the %s\n", energy, last, bad, DRAWS,
+               has_row ? "trained row" : "hand-typed matrix");
+        failures++;
+      }
+    }
+  }
+  printf("getNextNoteIndex    %lu draws from trained rows, %lu from the hand-typed fallback, %s\n",
+         (unsigned long)row_draws, (unsigned long)fallback_draws, failures ? "FAILED" : "ok");
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,620 @@
+/* Filename: ngram_train.cpp
+ * Author: Liam Warner
+ * Purpose: trains the n-gram note models that getNextNoteIndex() samples and writes them out
+ *          as orchestrion_ngram_tables.h. Melodies come from Standard MIDI Files under the
+ *          given directories: each file's note-ons (drum channel 10 left out) are reduced to
+ *          one line, the highest pitch at each tick, and mapped onto available_notes with
+ *          the pitch map policy (snap to scale by default, so every pitch plays). A file in a
+ *          directory named 1, 2 or 3 (or energy1...) trains that energy level; any other file
+ *          goes by its note density, under 1 onset per quarter note is level 1, under 2 is
+ *          level 2, anything busier level 3. With no MIDI files the licks and chimes in the
+ *          firmware's banks are the corpus.
+ *
+ *          The model of order N conditions on the last N notes. Each order's counts are
+ *          smoothed towards the order below (add --prior pseudo-counts spread like the lower
+ *          order's row), and order 0 is the hand-typed matrix row of the last note, so a
+ *          history the corpus never had backs off to the longest part of it that it did have.
+ *          Rows are stored only for histories with counts at some order, as 7 cumulative
+ *          thresholds out of 255, and identical rows are shared. A history with no counts at
+ *          any order (its last note was never followed by another at that level) gets no row
+ *          and draws from the hand-typed matrix. Every note of every level comes up in the
+ *          lick banks, so trained on them every history has a row; ngram_fallback_test checks
+ *          the fallback with a table of its own. The index from history to row is dense, so a
+ *          draw is one index load and one row of compares.
+ *
+ *          --report prints, for each model order, the histories the corpus had, the rows and
+ *          bytes the tables take against a dense table, and the training set's bits per note.
+ *
+ *   usage: ngram_train [--order N] [--prior K] [--pitch-map drop|fold|snap] [--report]
+ *                      [--out FILE] [DIR...]
+ */
+
+#include "../orchestrion_control_v4.ino"
+#include "sim/board.h"
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <numeric>
+#include <string>
+
+#define MAX_ORDER 4
+#define LEVELS NGRAM_LEVELS
+
+struct Melody {
+  std::string source;
+  int level;                  // 0-2, energy 1, 2, 3 and up
+  std::vector<int> notes;     // available_notes indexes
+};
+
+/***********************************************************
+ * Standard MIDI File reading
+ ***********************************************************/
+struct MidiOnset {
+  uint32_t tick;
+  int pitch;
+};
+
+static bool read_vlq(const std::vector<uint8_t>& d, size_t& pos, size_t end, uint32_t& value){
+  value = 0;
+  for(int i = 0; i < 4; i++){
+    if(pos >= end){
+      return false;
+    }
+    uint8_t b = d[pos++];
+    value = (value << 7) | (b & 0x7F);
+    if(!(b & 0x80)){
+      return true;
+    }
+  }
+  return false;
+}
+
+static uint32_t read_be(const std::vector<uint8_t>& d, size_t pos, int bytes){
+  uint32_t v = 0;
+  for(int i = 0; i < bytes; i++){
+    v = (v << 8) | d[pos + i];
+  }
+  return v;
+}
+
+/***********************************************************
+ * Reads every note-on of a MIDI file into onsets, with the
+ * ticks per quarter note. False if the file isn't one.
+ ***********************************************************/
+static bool read_midi_file(const std::string& path, std::vector<MidiOnset>& onsets, uint32_t& division){
+  std::ifstream f(path.c_str(), std::ios::binary);
+  std::vector<uint8_t> d((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+  if(d.size() < 14 || memcmp(&d[0], "MThd", 4) != 0){
+    return false;
+  }
+  uint32_t header_len = read_be(d, 4, 4);
+  division = read_be(d, 12, 2);
+  if(division & 0x8000){
+    division = 480; //SMPTE time, only the density estimate uses it
+  }
+  size_t pos = 8 + header_len;
+  while(pos + 8 <= d.size()){
+    uint32_t len = read_be(d, pos + 4, 4);
+    size_t end = std::min(d.size(), pos + 8 + static_cast<size_t>(len));
+    bool track = memcmp(&d[pos], "MTrk", 4) == 0;
+    size_t p = pos + 8;
+    pos = end;
+    if(!track){
+      continue;
+    }
+    uint32_t tick = 0;
+    uint8_t status = 0;
+    while(p < end){
+      uint32_t delta;
+      if(!read_vlq(d, p, end, delta) || p >= end){
+        break;
+      }
+      tick += delta;
+      if(d[p] & 0x80){
+        status = d[p++];
+      }else if(status == 0){
+        break; //running status with nothing to run on
+      }
+      if(status == 0xFF){
+        uint32_t skip;
+        if(p >= end || !read_vlq(d, ++p, end, skip)){
+          break;
+        }
+        p += skip;
+        status = 0;
+      }else if(status == 0xF0 || status == 0xF7){
+        uint32_t skip;
+        if(!read_vlq(d, p, end, skip)){
+          break;
+        }
+        p += skip;
+        status = 0;
+      }else{
+        int data_bytes = ((status & 0xF0) == 0xC0 || (status & 0xF0) == 0xD0) ? 1 : 2;
+        if(p + data_bytes > end){
+          break;
+        }
+        bool drums = (status & 0x0F) == 9;
+        if((status & 0xF0) == 0x90 && d[p + 1] > 0 && !drums){
+          MidiOnset o = {tick, d[p] & 0x7F};
+          onsets.push_back(o);
+        }
+        p += data_bytes;
+      }
+    }
+  }
+  return true;
+}
+
+static bool has_midi_extension(const std::string& name){
+  std::string lower;
+  for(char c : name){
+    lower += static_cast<char>(tolower(static_cast<unsigned char>(c)));
+  }
+  return (lower.size() > 4 && lower.compare(lower.size() - 4, 4, ".mid") == 0) ||
+         (lower.size() > 5 && lower.compare(lower.size() - 5, 5, ".midi") == 0);
+}
+
+static void find_midi_files(const std::string& dir, std::vector<std::string>& files){
+  DIR* dp = opendir(dir.c_str());
+  if(!dp){
+    fprintf(stderr, "can't open %s\n", dir.c_str());
+    return;
+  }
+  while(struct dirent* e = readdir(dp)){
+    std::string name = e->d_name;
+    if(name == "." || name == ".."){
+      continue;
+    }
+    std::string path = dir + "/" + name;
+    struct stat st;
+    if(stat(path.c_str(), &st) != 0){
+      continue;
+    }
+    if(S_ISDIR(st.st_mode)){
+      find_midi_files(path, files);
+    }else if(has_midi_extension(name)){
+      files.push_back(path);
+    }
+  }
+  closedir(dp);
+}
+
+// energy level from the file's directory name, -1 if it doesn't give one
+static int level_from_path(const std::string& path){
+  size_t slash = path.rfind('/');
+  if(slash == std::string::npos || slash == 0){
+    return -1;
+  }
+  size_t start = path.rfind('/', slash - 1);
+  std::string dir = path.substr(start == std::string::npos ? 0 : start + 1,
+                                slash - (start == std::string::npos ? 0 : start + 1));
+  if(dir.compare(0, 6, "energy") == 0){
+    dir = dir.substr(6);
+  }
+  if(dir.size() == 1 && dir[0] >= '1' && dir[0] <= '3'){
+    return dir[0] - '1';
+  }
+  return -1;
+}
+
+static bool melody_from_midi(const std::string& path, const int8_t* pitch_to_index, Melody& m){
+  std::vector<MidiOnset> onsets;
+  uint32_t division = 0;
+  if(!read_midi_file(path, onsets, division) || onsets.empty() || division == 0){
+    return false;
+  }
+  //highest pitch at each tick is the melody
+  std::stable_sort(onsets.begin(), onsets.end(), [](const MidiOnset& a, const MidiOnset& b){
+    return a.tick != b.tick ? a.tick < b.tick : a.pitch > b.pitch;
+  });
+  m.source = path;
+  m.notes.clear();
+  size_t line_onsets = 0;
+  for(size_t i = 0; i < onsets.size(); i++){
+    if(i > 0 && onsets[i].tick == onsets[i - 1].tick){
+      continue;
+    }
+    line_onsets++;
+    int idx = pitch_to_index[onsets[i].pitch];
+    if(idx >= 0){
+      m.notes.push_back(idx);
+    }
+  }
+  m.level = level_from_path(path);
+  if(m.level < 0){
+    double quarters = static_cast<double>(onsets.back().tick - onsets.front().tick) / division;
+    double density = quarters > 0 ? line_onsets / quarters : 0;
+    m.level = density < 1 ? 0 : (density < 2 ? 1 : 2);
+  }
+  return m.notes.size() >= 2;
+}
+
+// the firmware's own licks and chimes, unscrambled to available_notes indexes
+static void melodies_from_banks(std::vector<Melody>& melodies){
+  for(int i = 0; i < BoL_len; i++){
+    const Lick& lick = Bank_of_licks[i];
+    if(lick.num_notes < 2){
+      continue;
+    }
+    Melody m;
+    m.source = "lick " + std::to_string(i);
+    m.level = lick.energy_level <= 1 ? 0 : (lick.energy_level == 2 ? 1 : 2);
+    for(int j = 0; j < lick.num_notes; j++){
+      m.notes.push_back(get_unscrambled_idx(lick.data[j].note_index));
+    }
+    melodies.push_back(m);
+  }
+  //the chimes are the longest tunes there are, every level learns from them
+  for(int i = 0; i < 5; i++){
+    for(int level = 0; level < LEVELS; level++){
+      Melody m;
+      m.source = "chime " + std::to_string(i);
+      m.level = level;
+      for(int j = 0; j < Bank_of_chimes[i].num_notes; j++){
+        m.notes.push_back(get_unscrambled_idx(Bank_of_chimes[i].data[j].note_index));
+      }
+      melodies.push_back(m);
+    }
+  }
+}
+
+/***********************************************************
+ * Model
+ ***********************************************************/
+typedef std::vector<double> Row; // 8 probabilities
+
+static int contexts_of(int order){
+  return 1 << (3 * order);
+}
+
+// history as in the firmware: base-8 digits, newest lowest, padded with the first note
+static uint32_t context_start(int note, int order){
+  uint32_t ctx = 0;
+  for(int k = 0; k < order; k++){
+    ctx = (ctx << 3) | note;
+  }
+  return ctx;
+}
+
+struct Model {
+  int order;
+  double prior;
+  // counts[k][level][ctx * 8 + next] for each order k = 1..order
+  std::vector<std::vector<std::vector<uint32_t>>> counts;
+  std::vector<std::vector<Row>> rows;     // [level][ctx] smoothed at the top order
+  std::vector<std::vector<bool>> trained; // [level][ctx] some order had counts for it
+};
+
+static void count_melodies(Model& model, const std::vector<Melody>& melodies){
+  model.counts.assign(model.order + 1, std::vector<std::vector<uint32_t>>(LEVELS));
+  for(int k = 1; k <= model.order; k++){
+    for(int level = 0; level < LEVELS; level++){
+      model.counts[k][level].assign(contexts_of(k) * 8, 0);
+    }
+  }
+  for(const Melody& m : melodies){
+    for(int k = 1; k <= model.order; k++){
+      uint32_t ctx = context_start(m.notes[0], k);
+      for(size_t i = 1; i < m.notes.size(); i++){
+        model.counts[k][m.level][ctx * 8 + m.notes[i]]++;
+        ctx = ((ctx << 3) | m.notes[i]) & (contexts_of(k) - 1);
+      }
+    }
+  }
+}
+
+static Row hand_row(int level, int last){
+  Row r(8);
+  const NoteCdf& cdf = next_note_cdf[level][last];
+  uint16_t below = 0;
+  for(int i = 0; i < 8; i++){
+    r[i] = static_cast<double>(cdf.cdf[i] - below) / CDF_ONE;
+    below = cdf.cdf[i];
+  }
+  return r;
+}
+
+static void smooth(Model& model){
+  model.rows.assign(LEVELS, std::vector<Row>());
+  model.trained.assign(LEVELS, std::vector<bool>());
+  for(int level = 0; level < LEVELS; level++){
+    // rows of order k-1, starting from the hand-typed matrix at order 0
+    std::vector<Row> lower(8);
+    std::vector<bool> lower_trained(8, false);
+    for(int last = 0; last < 8; last++){
+      lower[last] = hand_row(level, last);
+    }
+    for(int k = 1; k <= model.order; k++){
+      int n = contexts_of(k);
+      std::vector<Row> rows(n, Row(8));
+      std::vector<bool> trained(n, false);
+      for(int ctx = 0; ctx < n; ctx++){
+        // order 0 is indexed by the last note, order k-1 by the newest k-1 notes
+        int suffix = k == 1 ? (ctx & 7) : (ctx & (contexts_of(k - 1) - 1));
+        const Row& below = lower[suffix];
+        const uint32_t* c = &model.counts[k][level][ctx * 8];
+        double total = 0;
+        for(int i = 0; i < 8; i++){
+          total += c[i];
+        }
+        for(int i = 0; i < 8; i++){
+          rows[ctx][i] = (c[i] + model.prior * below[i]) / (total + model.prior);
+        }
+        trained[ctx] = total > 0 || lower_trained[suffix];
+      }
+      lower.swap(rows);
+      lower_trained.swap(trained);
+    }
+    model.rows[level] = lower;
+    model.trained[level] = lower_trained;
+  }
+}
+
+/***********************************************************
+ * Quantizes a row to widths out of NGRAM_CDF_ONE: every note
+ * with any probability keeps at least one step, notes with
+ * none get no share, rounding goes to the largest remainders.
+ ***********************************************************/
+static std::vector<uint8_t> quantize_row(const Row& p){
+  int width[8];
+  double rem[8];
+  int sum = 0;
+  for(int i = 0; i < 8; i++){
+    double exact = p[i] * NGRAM_CDF_ONE;
+    width[i] = static_cast<int>(exact);
+    rem[i] = exact - width[i];
+    if(p[i] > 0 && width[i] == 0){
+      width[i] = 1;
+      rem[i] = 0;
+    }
+    sum += width[i];
+  }
+  while(sum < NGRAM_CDF_ONE){
+    int best = -1;
+    for(int i = 0; i < 8; i++){
+      if(p[i] > 0 && (best < 0 || rem[i] > rem[best])){
+        best = i;
+      }
+    }
+    width[best]++;
+    rem[best] = -1;
+    sum++;
+  }
+  while(sum > NGRAM_CDF_ONE){
+    int best = 0;
+    for(int i = 1; i < 8; i++){
+      if(width[i] > width[best]){
+        best = i;
+      }
+    }
+    width[best]--;
+    sum--;
+  }
+  std::vector<uint8_t> cdf(7);
+  int acc = 0;
+  for(int i = 0; i < 7; i++){
+    acc += width[i];
+    cdf[i] = static_cast<uint8_t>(acc);
+  }
+  return cdf;
+}
+
+struct Tables {
+  std::vector<std::vector<int>> context_row;   // [level][ctx], -1 = no row
+  std::vector<std::vector<uint8_t>> rows;
+};
+
+static Tables build_tables(const Model& model){
+  Tables t;
+  std::map<std::vector<uint8_t>, int> pool;
+  t.context_row.assign(LEVELS, std::vector<int>(contexts_of(model.order), -1));
+  for(int level = 0; level < LEVELS; level++){
+    for(int ctx = 0; ctx < contexts_of(model.order); ctx++){
+      if(!model.trained[level][ctx]){
+        continue;
+      }
+      std::vector<uint8_t> q = quantize_row(model.rows[level][ctx]);
+      auto it = pool.find(q);
+      if(it == pool.end()){
+        it = pool.insert(std::make_pair(q, static_cast<int>(t.rows.size()))).first;
+        t.rows.push_back(q);
+      }
+      t.context_row[level][ctx] = it->second;
+    }
+  }
+  return t;
+}
+
+static size_t index_bytes(const Tables& t){
+  return t.rows.size() < 255 ? 1 : 2;
+}
+
+static size_t table_bytes(const Tables& t, int order){
+  return LEVELS * contexts_of(order) * index_bytes(t) + t.rows.size() * 7;
+}
+
+// probability the quantized tables (with the hand-typed fallback) give each corpus note, in bits
+static double bits_per_note(const Tables& t, int order, const std::vector<Melody>& melodies){
+  double bits = 0;
+  size_t n = 0;
+  for(const Melody& m : melodies){
+    uint32_t ctx = context_start(m.notes[0], order);
+    for(size_t i = 1; i < m.notes.size(); i++){
+      int next = m.notes[i];
+      int row = t.context_row[m.level][ctx];
+      double p;
+      if(row >= 0){
+        int lo = next == 0 ? 0 : t.rows[row][next - 1];
+        int hi = next == 7 ? NGRAM_CDF_ONE : t.rows[row][next];
+        p = static_cast<double>(hi - lo) / NGRAM_CDF_ONE;
+      }else{
+        p = hand_row(m.level, ctx & 7)[next];
+      }
+      bits += -std::log2(std::max(p, 1e-6));
+      n++;
+      ctx = ((ctx << 3) | next) & (contexts_of(order) - 1);
+    }
+  }
+  return n ? bits / n : 0;
+}
+
+static void write_header(const std::string& path, const Tables& t, const Model& model, const std::string& corpus){
+  FILE* f = fopen(path.c_str(), "w");
+  if(!f){
+    fprintf(stderr, "can't write %s\n", path.c_str());
+    exit(1);
+  }
+  bool wide = index_bytes(t) == 2;
+  fprintf(f, "/* Filename: orchestrion_ngram_tables.h\n"
+             " * Author: Liam Warner\n"
+             " * Purpose: n-gram note models for getNextNoteIndex(), one per energy level. GENERATED by\n"
+             " *          host/ngram_train (make -C host ngram), don't edit by hand.\n"
+             " *          Order %d, prior %g, trained on %s.\n"
+             " *          ngram_context_row maps a NoteHistory context (the last NGRAM_ORDER notes as\n"
+             " *          base-8 digits, newest lowest) to a row of ngram_rows. A history whose last\n"
+             " *          note was never followed by another at its level in training is NGRAM_NO_ROW and\n"
+             " *          falls back to the hand-typed matrices; every other history has a backed-off row.\n"
+             " *          A row is P(note <= i) for i = 0-6 in 1/NGRAM_CDF_ONE steps. %zu bytes.\n"
+             " */\n\n"
+             "#ifndef ORCHESTRION_NGRAM_TABLES_H\n"
+             "#define ORCHESTRION_NGRAM_TABLES_H\n\n"
+             "#define NGRAM_ORDER %d\n"
+             "#define NGRAM_LEVELS %d\n"
+             "#define NGRAM_CONTEXTS %d\n"
+             "#define NGRAM_NUM_ROWS %zu\n"
+             "#define NGRAM_NO_ROW %s\n\n"
+             "typedef %s ngram_row_t;\n\n",
+          model.order, model.prior, corpus.c_str(), table_bytes(t, model.order),
+          model.order, LEVELS, contexts_of(model.order), t.rows.size(),
+          wide ? "0xFFFF" : "0xFF", wide ? "uint16_t" : "uint8_t");
+  fprintf(f, "static const ngram_row_t ngram_context_row[NGRAM_LEVELS][NGRAM_CONTEXTS] = {\n");
+  for(int level = 0; level < LEVELS; level++){
+    fprintf(f, "  {");
+    for(int ctx = 0; ctx < contexts_of(model.order); ctx++){
+      int row = t.context_row[level][ctx];
+      if(ctx % 16 == 0 && ctx > 0){
+        fprintf(f, "\n   ");
+      }
+      if(row < 0){
+        fprintf(f, "NGRAM_NO_ROW");
+      }else{
+        fprintf(f, "%d", row);
+      }
+      fprintf(f, ctx + 1 < contexts_of(model.order) ? ", " : "");
+    }
+    fprintf(f, "}%s\n", level + 1 < LEVELS ? "," : "");
+  }
+  fprintf(f, "};\n\n");
+  fprintf(f, "static const uint8_t ngram_rows[NGRAM_NUM_ROWS > 0 ? NGRAM_NUM_ROWS : 1][7] = {\n");
+  for(size_t r = 0; r < t.rows.size(); r++){
+    fprintf(f, "  {");
+    for(int i = 0; i < 7; i++){
+      fprintf(f, "%3d%s", t.rows[r][i], i < 6 ? ", " : "");
+    }
+    fprintf(f, "}%s\n", r + 1 < t.rows.size() ? "," : "");
+  }
+  if(t.rows.empty()){
+    fprintf(f, "  {0}\n");
+  }
+  fprintf(f, "};\n\n#endif\n");
+  fclose(f);
+}
+
+int main(int argc, char** argv){
+  int order = NGRAM_ORDER;
+  double prior = 2;
+  int policy = PITCH_MAP_SNAP_SCALE;
+  bool report = false;
+  std::string out;
+  std::vector<std::string> dirs;
+
+  for(int i = 1; i < argc; i++){
+    std::string a = argv[i];
+    bool has_val = i + 1 < argc;
+    if(a == "--order" && has_val){
+      order = atoi(argv[++i]);
+    }else if(a == "--prior" && has_val){
+      prior = atof(argv[++i]);
+    }else if(a == "--pitch-map" && has_val){
+      std::string p = argv[++i];
+      policy = p == "drop" ? PITCH_MAP_DROP : (p == "fold" ? PITCH_MAP_OCTAVE_FOLD : (p == "snap" ? PITCH_MAP_SNAP_SCALE : -1));
+    }else if(a == "--report"){
+      report = true;
+    }else if(a == "--out" && has_val){
+      out = argv[++i];
+    }else if(!a.empty() && a[0] != '-'){
+      dirs.push_back(a);
+    }else{
+      fprintf(stderr, "usage: ngram_train [--order N] [--prior K] [--pitch-map drop|fold|snap] [--report]\n"
+                      "                   [--out FILE] [DIR...]\n");
+      return 2;
+    }
+  }
+  if(order < 1 || order > MAX_ORDER || prior <= 0 || policy < 0){
+    fprintf(stderr, "bad arguments\n");
+    return 2;
+  }
+
+  std::vector<std::string> files;
+  for(const std::string& dir : dirs){
+    find_midi_files(dir, files);
+  }
+  std::sort(files.begin(), files.end()); //same corpus, same header
+  std::vector<Melody> melodies;
+  for(const std::string& path : files){
+    Melody m;
+    if(melody_from_midi(path, pitch_map_tables[policy].note_index, m)){
+      melodies.push_back(m);
+    }else{
+      fprintf(stderr, "skipped %s (not a MIDI file, or under 2 playable notes)\n", path.c_str());
+    }
+  }
+  std::string corpus;
+  if(melodies.empty()){
+    melodies_from_banks(melodies);
+    corpus = "the lick and chime banks (no MIDI files given)";
+  }else{
+    corpus = std::to_string(melodies.size()) + " MIDI files";
+  }
+  size_t notes[LEVELS] = {0, 0, 0};
+  for(const Melody& m : melodies){
+    notes[m.level] += m.notes.size();
+  }
+  fprintf(stderr, "corpus: %s, %zu/%zu/%zu notes at energy 1/2/3\n", corpus.c_str(), notes[0], notes[1], notes[2]);
+
+  if(report){
+    printf("order,contexts,seen_contexts,rows,dense_bytes,table_bytes,bits_per_note\n");
+    Tables hand;
+    hand.context_row.assign(LEVELS, std::vector<int>(8, -1));
+    printf("hand,8,0,0,%d,%d,%.3f\n", LEVELS * 8 * 8 * 2, LEVELS * 8 * 8 * 2, bits_per_note(hand, 1, melodies));
+    for(int k = 1; k <= MAX_ORDER; k++){
+      Model m = {k, prior, {}, {}, {}};
+      count_melodies(m, melodies);
+      smooth(m);
+      Tables t = build_tables(m);
+      size_t seen = 0; //histories with counts of their own at this order
+      for(int level = 0; level < LEVELS; level++){
+        for(int ctx = 0; ctx < contexts_of(k); ctx++){
+          const uint32_t* c = &m.counts[k][level][ctx * 8];
+          seen += std::accumulate(c, c + 8, 0u) > 0;
+        }
+      }
+      printf("%d,%d,%zu,%zu,%d,%zu,%.3f\n", k, LEVELS * contexts_of(k), seen, t.rows.size(),
+             LEVELS * contexts_of(k) * 7, table_bytes(t, k), bits_per_note(t, k, melodies));
+    }
+  }
+
+  if(!out.empty()){
+    Model m = {order, prior, {}, {}, {}};
+    count_melodies(m, melodies);
+    smooth(m);
+    Tables t = build_tables(m);
+    write_header(out, t, m, corpus);
+    fprintf(stderr, "wrote %s: order %d, %zu rows, %zu bytes\n", out.c_str(), order, t.rows.size(), table_bytes(t, order));
+  }
+  return 0;
+}
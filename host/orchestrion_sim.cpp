@@ -0,0 +1,301 @@
+/* Filename: orchestrion_sim.cpp
+ * Author: Liam Warner
+ * Purpose: runs setup()/loop() from orchestrion_control_v4.ino, unmodified, on the
+ *          simulated board and reports loop rate, bus usage and note onsets. All timing
+ *          is virtual, so results are repeatable and the binary can be run under perf,
+ *          gprof, valgrind etc. to profile the firmware's own code paths.
+ *
+ *   usage: orchestrion_sim [--mode midi|auto|sensor] [--seconds N] [--start-hour H]
+ *                          [--seed S] [--midi-rate HZ] [--sensors idle|wave]
+ *                          [--spi-trace FILE] [--echo-serial] [--perf] [--calibrate]
+ *                          [--faults N] [--rng-seed S] [--trace-dump FILE]
+ *
+ *   --perf sends the 'p' command over the simulated Serial after the run and prints the
+ *   firmware's timing histograms (#perf lines) it answers with.
+ *   --calibrate powers up once first and sends 'c' and 'C' over Serial, so the firmware
+ *   sweeps the solenoid on-times against the simulated strike response and saves them to
+ *   flash, prints the table, then does the run, which loads it.
+ *   --faults N pulls FAULT_PIN low for 300 ms N times, spread over the run, and reports the
+ *   time from each falling edge to OUTPUT_EN going low, to the main context taking over,
+ *   and whether every TPIC was latched blank when the outputs came back on.
+ *   --rng-seed S seeds the firmware's random engine with S instead of the RTC and sensor
+ *   noise, like the "Random seed" the firmware logs at power up. --seed only seeds the
+ *   simulated board (sensor noise, MIDI timing), so two runs with the same --seed, mode
+ *   and --rng-seed strike the same notes at the same times.
+ *   --trace-dump FILE sends the 't' command after the run and writes what the firmware
+ *   answers with (the input trace, and any log lines in between) to FILE, for trace_replay.
+ */
+
+#include "../orchestrion_control_v4.ino"
+#include "sim/board.h"
+
+#include <chrono>
+#include <string>
+
+static void usage(){
+  fprintf(stderr, "usage: orchestrion_sim [--mode midi|auto|sensor] [--seconds N] [--start-hour H]\n"
+                  "                       [--seed S] [--midi-rate HZ] [--sensors idle|wave]\n"
+                  "                       [--spi-trace FILE] [--echo-serial] [--perf] [--calibrate]\n"
+                  "                       [--faults N] [--rng-seed S] [--trace-dump FILE]\n");
+}
+
+// loop() periods in 100 ns bins up to 10 ms, longer ones in the last bin (the max is kept
+// exactly); autonomous mode runs ~100k loop() calls per virtual second, too many to keep
+#define LOOP_BIN_NS 100
+#define LOOP_BINS 100001
+static std::vector<uint64_t> loop_hist(LOOP_BINS);
+static uint64_t loop_max_ns = 0;
+
+static void record_loop(uint64_t ns){
+  loop_hist[std::min<uint64_t>(ns / LOOP_BIN_NS, LOOP_BINS - 1)]++;
+  loop_max_ns = std::max(loop_max_ns, ns);
+}
+
+static double loop_percentile(uint64_t count, double p){
+  if(count == 0){
+    return 0;
+  }
+  if(p >= 1.0){
+    return static_cast<double>(loop_max_ns);
+  }
+  uint64_t rank = static_cast<uint64_t>(p * (count - 1));
+  uint64_t seen = 0;
+  for(size_t b = 0; b < LOOP_BINS; b++){
+    seen += loop_hist[b];
+    if(seen > rank){
+      return std::min(static_cast<double>(b * LOOP_BIN_NS), static_cast<double>(loop_max_ns));
+    }
+  }
+  return static_cast<double>(loop_max_ns);
+}
+
+int main(int argc, char** argv){
+  board::Mode mode = board::MODE_AUTO;
+  double seconds = 60;
+  int start_hour = 12;
+  uint64_t seed = 1;
+  double midi_rate = 8;
+  std::string sensors = "idle";
+  std::string spi_trace;
+  std::string trace_dump;
+  bool perf_dump = false;
+  bool calibrate = false;
+  int faults = 0;
+  uint32_t rng_seed_arg = 0;
+
+  for(int i = 1; i < argc; i++){
+    std::string a = argv[i];
+    bool has_val = i + 1 < argc;
+    if(a == "--mode" && has_val){
+      std::string m = argv[++i];
+      if(m == "midi"){
+        mode = board::MODE_MIDI;
+      }else if(m == "auto"){
+        mode = board::MODE_AUTO;
+      }else if(m == "sensor"){
+        mode = board::MODE_SENSOR;
+      }else{
+        usage();
+        return 2;
+      }
+    }else if(a == "--seconds" && has_val){
+      seconds = atof(argv[++i]);
+    }else if(a == "--start-hour" && has_val){
+      start_hour = atoi(argv[++i]);
+    }else if(a == "--seed" && has_val){
+      seed = strtoull(argv[++i], nullptr, 10);
+    }else if(a == "--midi-rate" && has_val){
+      midi_rate = atof(argv[++i]);
+    }else if(a == "--sensors" && has_val){
+      sensors = argv[++i];
+    }else if(a == "--spi-trace" && has_val){
+      spi_trace = argv[++i];
+    }else if(a == "--echo-serial"){
+      sim::echo_serial = true;
+    }else if(a == "--perf"){
+      perf_dump = true;
+    }else if(a == "--calibrate"){
+      calibrate = true;
+    }else if(a == "--faults" && has_val){
+      faults = atoi(argv[++i]);
+    }else if(a == "--trace-dump" && has_val){
+      trace_dump = argv[++i];
+    }else if(a == "--rng-seed" && has_val){
+      rng_seed_arg = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+    }else{
+      usage();
+      return 2;
+    }
+  }
+
+  if(calibrate){
+    uint64_t sweep_ns = board::power_up_calibration();
+    printf("calibration sweep   %.1f s, %lu flash writes, notes swept 0x%02X\n", sweep_ns / 1e9,
+           (unsigned long)hal_nvm_store.writes, solenoid_cal.swept_mask);
+    for(int note = 0; note < CAL_NOTES; note++){
+      printf("  note %d on ms      %3d %3d %3d  (strikes from %d %d %d)\n", note, solenoid_cal.on_ms[note][0],
+             solenoid_cal.on_ms[note][1], solenoid_cal.on_ms[note][2], board::strike_need_ms[note][0],
+             board::strike_need_ms[note][1], board::strike_need_ms[note][2]);
+    }
+    tpic_stats = TpicStats(); //count the run's own writes only
+  }
+
+  board::reset(mode, seed);
+  rng_fixed_seed = rng_seed_arg;
+  sim::rtc_start_seconds = static_cast<uint32_t>(start_hour % 24) * 3600;
+  sim::adc_model = (sensors == "wave") ? board::adc_wave : board::adc_idle;
+
+  uint64_t end_ns = static_cast<uint64_t>(seconds * 1e9);
+  if(mode == board::MODE_MIDI){
+    board::midi_stream(10000000ULL, end_ns, midi_rate, available_notes, 8);
+  }
+  board::schedule_stop(end_ns, 120000000000ULL);
+  std::vector<uint64_t> fault_edges;
+  for(int k = 0; k < faults; k++){
+    uint64_t slot = end_ns / (faults + 1);
+    uint64_t at = slot * (k + 1) + sim::rand32() % (slot / 4 + 1);
+    sim::schedule_pin(at, FAULT_PIN, LOW);
+    sim::schedule_pin(at + 300000000ULL, FAULT_PIN, HIGH);
+    fault_edges.push_back(at);
+  }
+  std::vector<uint64_t> fault_handled_ns;
+  uint32_t faults_seen = fault_count;
+
+  uint64_t loops = 0;
+  TpicStats setup_tpic = {0, 0, 0};
+  uint64_t setup_spi_bus_ns = 0;
+  bool timed_out = false;
+  auto wall_start = std::chrono::steady_clock::now();
+
+  try {
+    setup();
+    setup_tpic = tpic_stats; //the power-up clear, kept out of the saving below
+    setup_spi_bus_ns = sim::stats.spi_bus_ns;
+    while(sim::now_ns < end_ns){
+      uint64_t t0 = sim::now_ns;
+      loop();
+      record_loop(sim::now_ns - t0);
+      if(fault_count != faults_seen){
+        faults_seen = fault_count;
+        fault_handled_ns.push_back((fault_last.handled_us - fault_last.isr_us) * 1000ULL);
+      }
+      loops++;
+    }
+  } catch(const sim::Timeout&){
+    timed_out = true;
+  }
+
+  double wall_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+  double virt_s = sim::now_ns / 1e9;
+
+  if(!spi_trace.empty()){
+    FILE* f = fopen(spi_trace.c_str(), "w");
+    if(f){
+      fprintf(f, "t_us,chip,byte\n");
+      for(const sim::SpiByte& b : sim::spi_log){
+        fprintf(f, "%.3f,%d,0x%02X\n", b.t_ns / 1000.0, b.chip, b.value);
+      }
+      fclose(f);
+    }
+  }
+
+  printf("virtual time        %.3f s (host %.3f s, %.0fx real time)%s\n", virt_s, wall_s,
+         wall_s > 0 ? virt_s / wall_s : 0.0, timed_out ? " [hard deadline hit]" : "");
+  printf("random seed         %lu%s\n", (unsigned long)rng_seed_used, rng_fixed_seed ? " (--rng-seed)" : "");
+  printf("loop() calls        %llu (%.1f /s)\n", (unsigned long long)loops, loops / virt_s);
+  printf("loop() period       p50 %.1f us, p99 %.1f us, max %.1f us\n",
+         loop_percentile(loops, 0.5) / 1e3, loop_percentile(loops, 0.99) / 1e3, loop_percentile(loops, 1.0) / 1e3);
+  printf("note onsets         %zu\n", board::onsets.size());
+  printf("SPI                 %llu transactions, %llu bytes, %.3f ms on the bus\n",
+         (unsigned long long)sim::stats.spi_transactions, (unsigned long long)sim::stats.spi_bytes,
+         sim::stats.spi_bus_ns / 1e6);
+  // bus time the same note changes would have cost as one transaction each
+  uint64_t per_note_ns = sim::costs.spi_txn_overhead_ns + 8ULL * 1000000000ULL / spi_settings.clock +
+                         sim::costs.spi_byte_overhead_ns + 2ULL * sim::costs.digital_io_ns;
+  // counted from the end of setup(), its power-up clear isn't a note change
+  double legacy_ms = (tpic_stats.note_writes - setup_tpic.note_writes) * per_note_ns / 1e6;
+  double shadow_ms = (sim::stats.spi_bus_ns - setup_spi_bus_ns) / 1e6;
+  printf("TPIC shadow image   %lu note writes -> %lu chip frames in %lu flushes, "
+         "bus time saved %.3f ms of %.3f ms\n",
+         (unsigned long)(tpic_stats.note_writes - setup_tpic.note_writes),
+         (unsigned long)(tpic_stats.frames - setup_tpic.frames),
+         (unsigned long)(tpic_stats.flushes - setup_tpic.flushes), legacy_ms - shadow_ms, legacy_ms);
+  printf("TPIC power-up clear %lu chip frames in %lu flushes, %.3f ms on the bus during setup()\n",
+         (unsigned long)setup_tpic.frames, (unsigned long)setup_tpic.flushes, setup_spi_bus_ns / 1e6);
+  printf("I2C                 %llu reads, %.3f ms on the bus, %lu sensor frames, %lu RTC syncs\n",
+         (unsigned long long)sim::stats.i2c_transactions, sim::stats.i2c_bus_ns / 1e6,
+         (unsigned long)sensor_frame().seq, (unsigned long)schedule_rtc_syncs);
+  printf("Serial              %llu bytes, %.3f ms blocked on a full TX buffer\n",
+         (unsigned long long)sim::stats.serial_bytes, sim::stats.serial_blocked_ns / 1e6);
+  printf("USB MIDI            %llu packets read, %lu note-ons struck, %lu dropped (note busy)\n",
+         (unsigned long long)sim::stats.midi_packets_read, (unsigned long)midi_stats.struck,
+         (unsigned long)midi_stats.dropped_busy);
+  if(faults > 0){
+    // each edge against the first time OUTPUT_EN went low after it
+    std::vector<uint64_t> disable_ns;
+    int reenabled = 0;
+    int reenabled_dirty = 0;
+    for(uint64_t edge : fault_edges){
+      for(const sim::PinEdge& e : sim::output_en_edges){
+        if(e.t_ns >= edge && e.level == 0){
+          disable_ns.push_back(e.t_ns - edge);
+          break;
+        }
+      }
+    }
+    for(const sim::PinEdge& e : sim::output_en_edges){
+      if(e.level == 1){
+        reenabled++;
+        reenabled_dirty += e.latched_or != 0;
+      }
+    }
+    std::vector<uint64_t> sorted_disable = disable_ns;
+    std::vector<uint64_t> sorted_handled = fault_handled_ns;
+    std::sort(sorted_disable.begin(), sorted_disable.end());
+    std::sort(sorted_handled.begin(), sorted_handled.end());
+    printf("fault edges         %d, outputs disabled after p50 %.2f us, max %.2f us (%zu of them)\n", faults,
+           sorted_disable.empty() ? 0.0 : sorted_disable[sorted_disable.size() / 2] / 1e3,
+           sorted_disable.empty() ? 0.0 : sorted_disable.back() / 1e3, sorted_disable.size());
+    printf("fault handling      main context took over after p50 %.1f us, max %.1f us; %d re-enables, "
+           "%d with a TPIC not blank\n",
+           sorted_handled.empty() ? 0.0 : sorted_handled[sorted_handled.size() / 2] / 1e3,
+           sorted_handled.empty() ? 0.0 : sorted_handled.back() / 1e3, reenabled, reenabled_dirty);
+  }
+  printf("clock reads         %llu\n", (unsigned long long)sim::stats.clock_reads);
+
+  if(perf_dump){
+    // the firmware writes the dump a TX buffer at a time, give it a couple of virtual seconds
+    fflush(stdout);
+    sim::hard_deadline_ns = UINT64_MAX;
+    sim::serial_rx.push_back('p');
+    sim::echo_serial = true;
+    for(int i = 0; i < 2000; i++){
+      serial_command_poll();
+      perf_poll();
+      sim::advance(1000000ULL);
+    }
+  }
+
+  if(!trace_dump.empty()){
+    FILE* f = fopen(trace_dump.c_str(), "w");
+    if(!f){
+      fprintf(stderr, "can't write %s\n", trace_dump.c_str());
+      return 1;
+    }
+    // 4 KB of trace is ~9 KB of text, under a virtual second at 115200 baud
+    fflush(stdout);
+    sim::hard_deadline_ns = UINT64_MAX;
+    sim::serial_rx.push_back('t');
+    sim::echo_serial = true;
+    sim::echo_file = f;
+    for(int i = 0; i < 10000; i++){
+      log_drain();
+      serial_command_poll();
+      trace_poll();
+      sim::advance(1000000ULL);
+    }
+    sim::echo_file = nullptr;
+    fclose(f);
+  }
+  return 0;
+}
@@ -0,0 +1,200 @@
+/* Filename: board.h
+ * Author: Liam Warner
+ * Purpose: orchestrion-specific wiring and stimulus for the host simulator. Include this
+ *          after the sketch so the pin macros from the firmware are visible. Shared by the
+ *          simulator driver and the host benchmarks.
+ */
+
+#ifndef ORCHESTRION_SIM_BOARD_H
+#define ORCHESTRION_SIM_BOARD_H
+
+#include "sim_core.h"
+
+namespace board {
+
+enum Mode { MODE_MIDI, MODE_AUTO, MODE_SENSOR };
+
+// A solenoid turning on, decoded from the latched TPIC bytes
+struct Onset {
+  uint64_t t_ns;
+  int note_index; // firmware note index, chip*2 + (upper half ? 1 : 0)
+  int level;      // 1, 2, 3 decoded from the 3-bit field
+};
+static std::vector<Onset> onsets;
+static uint64_t note_on_since_ns[16];
+static uint64_t note_on_total_ns[16];
+static uint64_t note_off_at_ns[16]; // last release, 0 while the note is on
+static int note_on_level[16];
+
+inline int field_level(uint8_t field){
+  if(field == 0x7){
+    return 3;
+  }else if(field == 0x5){
+    return 2;
+  }else if(field == 0x2){
+    return 1;
+  }
+  return field ? -1 : 0;
+}
+
+inline void on_latch(int chip, uint8_t old_value, uint8_t new_value){
+  for(int half = 0; half < 2; half++){
+    uint8_t before = (old_value >> (3 * half)) & 0x7;
+    uint8_t after = (new_value >> (3 * half)) & 0x7;
+    int note_index = chip * 2 + half;
+    if(!before && after){
+      Onset o = {sim::now_ns, note_index, field_level(after)};
+      onsets.push_back(o);
+      note_on_since_ns[note_index] = sim::now_ns;
+      note_off_at_ns[note_index] = 0;
+      note_on_level[note_index] = o.level;
+    }else if(before && !after){
+      note_on_total_ns[note_index] += sim::now_ns - note_on_since_ns[note_index];
+      note_off_at_ns[note_index] = sim::now_ns;
+    }
+  }
+}
+
+/***********************************************************
+ * Sensor models
+ ***********************************************************/
+// Nobody near the drum: a few counts of noise on every channel
+inline uint8_t adc_idle(int channel, uint64_t t_ns){
+  (void)channel;
+  (void)t_ns;
+  return static_cast<uint8_t>(sim::rand32() % 6);
+}
+
+// A hand sweeping across the tongues every 4 s, peaking at ~220 counts
+inline uint8_t adc_wave(int channel, uint64_t t_ns){
+  double phase = static_cast<double>(t_ns % 4000000000ULL) / 4000000000.0; // 0..1
+  double center = phase * 9.0 - 0.5;
+  double d = channel - center;
+  double v = 220.0 * std::exp(-d * d / 1.5);
+  int noisy = static_cast<int>(v) + static_cast<int>(sim::rand32() % 9) - 4;
+  return static_cast<uint8_t>(std::min(255, std::max(0, noisy)));
+}
+
+// Solenoid response for the calibration sweep: the beater only reaches the tongue if the
+// coil is held on for strike_need_ms[note][level - 1], less the harder it is driven, and
+// each solenoid is a bit different. The strike lands that long after the onset and reads
+// ~200 counts on the note's channel for STRIKE_SHOW_NS.
+static const uint64_t STRIKE_SHOW_NS = 20000000ULL;
+static int strike_need_ms[8][3] = {
+  {38, 24, 17}, {41, 26, 18}, {36, 23, 16}, {47, 30, 21},
+  {39, 25, 17}, {44, 28, 20}, {52, 33, 23}, {40, 25, 18},
+};
+
+// when the last pulse on note_index struck, or 0 if it was too short to
+inline uint64_t strike_time_ns(int note_index){
+  int level = note_on_level[note_index];
+  if(level < 1 || level > 3 || !note_on_since_ns[note_index]){
+    return 0;
+  }
+  uint64_t lands_ns = note_on_since_ns[note_index] + strike_need_ms[note_index][level - 1] * 1000000ULL;
+  uint64_t off_ns = note_off_at_ns[note_index];
+  return (off_ns && off_ns < lands_ns) ? 0 : lands_ns;
+}
+
+inline uint8_t adc_strikes(int channel, uint64_t t_ns){
+  uint64_t struck_ns = strike_time_ns(channel);
+  if(struck_ns && t_ns >= struck_ns && t_ns < struck_ns + STRIKE_SHOW_NS){
+    return static_cast<uint8_t>(200 + sim::rand32() % 9);
+  }
+  return adc_idle(channel, t_ns);
+}
+
+/***********************************************************
+ * MIDI stimulus
+ ***********************************************************/
+// Note-ons at rate_hz cycling through pitches, each followed by a note-off 40 ms later
+inline void midi_stream(uint64_t start_ns, uint64_t end_ns, double rate_hz,
+                        const int* pitches, int num_pitches){
+  uint64_t period = static_cast<uint64_t>(1e9 / rate_hz);
+  int k = 0;
+  for(uint64_t t = start_ns; t < end_ns; t += period, k++){
+    uint8_t pitch = static_cast<uint8_t>(pitches[k % num_pitches]);
+    uint8_t vel = static_cast<uint8_t>(30 + sim::rand32() % 97);
+    sim::schedule_midi(t, 0x9, 0x90, pitch, vel);
+    sim::schedule_midi(t + 40000000ULL, 0x8, 0x80, pitch, 0);
+  }
+}
+
+// chord_size different pitches per chord, chord_hz chords per second, each note-on offset
+// from the chord's time by up to spread_ns (a player's fingers, USB frame boundaries),
+// note-offs 40 ms later
+inline void midi_chords(uint64_t start_ns, uint64_t end_ns, double chord_hz, int chord_size,
+                        uint64_t spread_ns, const int* pitches, int num_pitches){
+  uint64_t period = static_cast<uint64_t>(1e9 / chord_hz);
+  int k = 0;
+  for(uint64_t t = start_ns; t < end_ns; t += period, k++){
+    for(int n = 0; n < chord_size && n < num_pitches; n++){
+      uint8_t pitch = static_cast<uint8_t>(pitches[(k + n) % num_pitches]);
+      uint8_t vel = static_cast<uint8_t>(30 + sim::rand32() % 97);
+      uint64_t at = t + (spread_ns ? sim::rand32() % spread_ns : 0);
+      sim::schedule_midi(at, 0x9, 0x90, pitch, vel);
+      sim::schedule_midi(at + 40000000ULL, 0x8, 0x80, pitch, 0);
+    }
+  }
+}
+
+/***********************************************************
+ * Board bring-up
+ ***********************************************************/
+inline void reset(Mode mode, uint64_t seed){
+  sim::reset();
+  sim::seed(seed);
+  onsets.clear();
+  for(int i = 0; i < 16; i++){
+    note_on_since_ns[i] = 0;
+    note_on_total_ns[i] = 0;
+    note_off_at_ns[i] = 0;
+    note_on_level[i] = 0;
+  }
+  int cs[4] = {CS_PIN0, CS_PIN1, CS_PIN2, CS_PIN3};
+  for(int i = 0; i < 4; i++){
+    sim::cs_pins[i] = cs[i];
+  }
+  sim::num_chips = 4;
+  sim::output_en_pin = OUTPUT_EN;
+  sim::on_tpic_latch = on_latch;
+  sim::adc_model = adc_idle;
+
+  // mode switches are active low
+  sim::schedule_pin(0, AUTO_PIN, mode == MODE_AUTO ? LOW : HIGH);
+  sim::schedule_pin(0, SENSOR_PIN, mode == MODE_SENSOR ? LOW : HIGH);
+  sim::schedule_pin(0, FAULT_PIN, HIGH);
+  sim::advance(0);
+}
+
+// Flip both switches to MIDI mode so autonomous loops return, then stop hard later
+inline void schedule_stop(uint64_t end_ns, uint64_t grace_ns){
+  sim::schedule_pin(end_ns, AUTO_PIN, HIGH);
+  sim::schedule_pin(end_ns, SENSOR_PIN, HIGH);
+  sim::hard_deadline_ns = end_ns + grace_ns;
+}
+
+/***********************************************************
+ * Powers the board up once in MIDI mode and sends 'c' and 'C'
+ * over Serial, so loop() runs the solenoid sweep against
+ * adc_strikes and saves the table to the simulated flash,
+ * which the next reset() and setup() load. Returns how long
+ * the sweep took (ns).
+ ***********************************************************/
+inline uint64_t power_up_calibration(){
+  reset(MODE_MIDI, 1);
+  sim::adc_model = adc_strikes;
+  setup();
+  uint64_t start_ns = sim::now_ns;
+  sim::serial_rx.push_back('c');
+  sim::serial_rx.push_back('C');
+  //one command byte per loop(), the sweep runs inside the loop() after the 'C'
+  while(!sim::serial_rx.empty() || solenoid_cal_requested){
+    loop();
+  }
+  return sim::now_ns - start_ns;
+}
+
+} // namespace board
+
+#endif
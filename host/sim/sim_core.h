@@ -0,0 +1,428 @@
+/* Filename: sim_core.h
+ * Author: Liam Warner
+ * Purpose: deterministic board model behind the host build of the orchestrion firmware.
+ *          Owns the virtual clock, the pins, the captured TPIC byte stream and the
+ *          simulated ADC, RTC, USB MIDI and Serial peripherals. Nothing in here reads the
+ *          host clock, so a run with the same options always produces the same output.
+ *
+ *          Time only advances when the firmware does something that takes time on the
+ *          board (reading the clock, toggling a pin, clocking SPI/I2C bits, writing to a
+ *          full Serial buffer, delay()). The per-operation costs live in sim::costs.
+ */
+
+#ifndef ORCHESTRION_SIM_CORE_H
+#define ORCHESTRION_SIM_CORE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+#include <deque>
+#include <algorithm>
+
+namespace sim {
+
+/***********************************************************
+ * Cost model (nanoseconds), roughly a 48 MHz SAMD21 running
+ * the stock Arduino core.
+ ***********************************************************/
+struct Costs {
+  uint32_t clock_read_ns = 400;         // millis()/micros()
+  uint32_t digital_io_ns = 1200;        // digitalRead()/digitalWrite()
+  uint32_t spi_txn_overhead_ns = 2500;  // beginTransaction()+endTransaction()
+  uint32_t spi_byte_overhead_ns = 600;  // per transfer() call on top of the bit time
+  uint32_t i2c_txn_overhead_ns = 20000; // Wire driver bookkeeping per transaction
+  uint32_t i2c_bits_per_read = 38;      // S+addr+reg, Sr+addr+data, P
+  uint32_t usb_read_ns = 1500;          // MidiUSB.read()
+  uint32_t isr_entry_ns = 1000;         // exception entry + the core's EIC_Handler finding the channel
+  uint32_t serial_baud = 115200;
+  uint32_t serial_tx_buffer = 64;
+};
+static Costs costs;
+
+struct Timeout {}; // thrown when a run exceeds its hard deadline
+
+static uint64_t now_ns = 0;
+static uint64_t hard_deadline_ns = UINT64_MAX;
+
+// Statistics gathered over a run
+struct Stats {
+  uint64_t clock_reads = 0;
+  uint64_t spi_transactions = 0;
+  uint64_t spi_bytes = 0;
+  uint64_t spi_bus_ns = 0;      // time spent inside SPI transactions
+  uint64_t i2c_transactions = 0;
+  uint64_t i2c_bus_ns = 0;
+  uint64_t serial_bytes = 0;
+  uint64_t serial_blocked_ns = 0;
+  uint64_t midi_packets_read = 0;
+};
+static Stats stats;
+
+/***********************************************************
+ * Pins and interrupts
+ ***********************************************************/
+const int NUM_PINS = 64;
+static uint8_t pin_level[NUM_PINS];
+static uint8_t pin_mode[NUM_PINS];
+static bool pin_driven[NUM_PINS]; // true once the scenario drives an input
+
+struct PinEvent {
+  uint64_t t_ns;
+  int pin;
+  int level;
+};
+static std::deque<PinEvent> pin_events; // kept sorted by time
+
+struct IsrSlot {
+  void (*fn)() = nullptr;
+  int mode = 0;
+  bool pending = false; // edge seen while interrupts were off or another ISR ran
+};
+static IsrSlot isr_slots[NUM_PINS];
+static bool in_isr = false;
+static bool interrupts_enabled = true;
+
+/***********************************************************
+ * Board wiring: which outputs are TPIC chip selects and
+ * which one is the shared output enable.
+ ***********************************************************/
+const int MAX_CHIPS = 8;
+static int cs_pins[MAX_CHIPS];
+static int num_chips = 0;
+static int output_en_pin = -1;
+
+// Every change of the output enable pin
+struct PinEdge {
+  uint64_t t_ns;
+  int level;
+  uint8_t latched_or; // every TPIC's latched byte OR'd together at that moment
+};
+static std::vector<PinEdge> output_en_edges;
+
+// Every byte shifted to a TPIC, with the time its chip select latched it
+struct SpiByte {
+  uint64_t t_ns;
+  int chip;
+  uint8_t value;
+};
+static std::vector<SpiByte> spi_log;
+static bool capture_spi = true;
+
+static uint8_t chip_shift[MAX_CHIPS]; // byte in the shift register, latched on CS rising
+static uint8_t chip_latch[MAX_CHIPS]; // byte driving the outputs
+static bool spi_in_txn = false;
+static uint64_t spi_txn_start_ns = 0;
+static uint32_t spi_clock_hz = 4000000;
+
+// Optional observer, called for every latched TPIC byte
+static void (*on_tpic_latch)(int chip, uint8_t old_value, uint8_t new_value) = nullptr;
+
+/***********************************************************
+ * Peripherals
+ ***********************************************************/
+static uint32_t i2c_clock_hz = 100000;
+
+// ADC: returns the 8-bit reading of a channel at the current time
+static uint8_t (*adc_model)(int channel, uint64_t t_ns) = nullptr;
+
+// RTC: wall-clock seconds since midnight at t=0
+static uint32_t rtc_start_seconds = 12 * 3600;
+// or, if set, returns the seconds since midnight at the current time (trace replay)
+static uint32_t (*rtc_model)(uint64_t t_ns) = nullptr;
+
+struct MidiPacket {
+  uint64_t t_ns;
+  uint8_t header, byte1, byte2, byte3;
+};
+static std::deque<MidiPacket> midi_queue; // kept sorted by time
+
+// Serial TX: a FIFO draining at the baud rate, writes block while it is full
+static uint64_t serial_idle_at_ns = 0;
+static bool echo_serial = false;
+static FILE* echo_file = nullptr; // where echo_serial writes, stdout if not set
+static std::deque<uint8_t> serial_rx;
+
+/***********************************************************
+ * Deterministic helper RNG for sensor noise and stimulus.
+ ***********************************************************/
+static uint64_t rng_state = 0x853c49e6748fea9bULL;
+
+inline uint32_t rand32(){
+  rng_state = rng_state * 6364136223846793005ULL + 1442695040888963407ULL;
+  uint32_t x = static_cast<uint32_t>(((rng_state >> 18) ^ rng_state) >> 27);
+  uint32_t rot = static_cast<uint32_t>(rng_state >> 59);
+  return (x >> rot) | (x << ((32 - rot) & 31));
+}
+
+inline void seed(uint64_t s){
+  rng_state = s * 2862933555777941757ULL + 3037000493ULL;
+  rand32();
+}
+
+/***********************************************************
+ * Clock
+ ***********************************************************/
+inline void set_pin_level(int pin, int level);
+
+inline void advance(uint64_t ns){
+  uint64_t target = now_ns + ns;
+  // apply scheduled input changes that fall inside this step, in order
+  while(!pin_events.empty() && pin_events.front().t_ns <= target){
+    PinEvent ev = pin_events.front();
+    pin_events.pop_front();
+    if(ev.t_ns > now_ns){
+      now_ns = ev.t_ns;
+    }
+    uint64_t before = now_ns;
+    set_pin_level(ev.pin, ev.level);
+    target += now_ns - before; // an ISR ran, the interrupted code finishes that much later
+  }
+  now_ns = target;
+  if(now_ns > hard_deadline_ns){
+    throw Timeout();
+  }
+}
+
+inline void advance_to(uint64_t t_ns){
+  if(t_ns > now_ns){
+    advance(t_ns - now_ns);
+  }
+}
+
+inline void run_isr(IsrSlot& slot){
+  slot.pending = false;
+  in_isr = true;
+  advance(costs.isr_entry_ns);
+  slot.fn();
+  in_isr = false;
+}
+
+// ISRs whose edge came while they couldn't run, in pin order like the EIC's priority
+inline void run_pending_isrs(){
+  for(int pin = 0; pin < NUM_PINS && interrupts_enabled && !in_isr; pin++){
+    if(isr_slots[pin].pending && isr_slots[pin].fn){
+      run_isr(isr_slots[pin]);
+    }
+  }
+}
+
+inline void set_pin_level(int pin, int level){
+  if(pin < 0 || pin >= NUM_PINS){
+    return;
+  }
+  int old = pin_level[pin];
+  pin_level[pin] = level ? 1 : 0;
+  IsrSlot& slot = isr_slots[pin];
+  if(slot.fn && old != pin_level[pin]){
+    bool falling = old && !level;
+    bool rising = !old && level;
+    // Arduino modes: CHANGE 2, FALLING 3, RISING 4
+    if(slot.mode == 2 || (slot.mode == 3 && falling) || (slot.mode == 4 && rising)){
+      slot.pending = true; // latched by the EIC, runs as soon as it can
+      if(interrupts_enabled && !in_isr){
+        run_isr(slot);
+        run_pending_isrs();
+      }
+    }
+  }
+}
+
+// Schedules an input pin change at an absolute virtual time
+inline void schedule_pin(uint64_t t_ns, int pin, int level){
+  PinEvent ev = {t_ns, pin, level};
+  auto it = std::upper_bound(pin_events.begin(), pin_events.end(), ev,
+                             [](const PinEvent& a, const PinEvent& b){ return a.t_ns < b.t_ns; });
+  pin_events.insert(it, ev);
+  pin_driven[pin] = true;
+}
+
+inline int chip_for_pin(int pin){
+  for(int i = 0; i < num_chips; i++){
+    if(cs_pins[i] == pin){
+      return i;
+    }
+  }
+  return -1;
+}
+
+/***********************************************************
+ * Digital outputs: chip select rising edge latches the TPIC
+ ***********************************************************/
+inline void write_output(int pin, int level){
+  if(pin < 0 || pin >= NUM_PINS){
+    return;
+  }
+  int old = pin_level[pin];
+  pin_level[pin] = level ? 1 : 0;
+  if(pin == output_en_pin && old != pin_level[pin]){
+    uint8_t latched_or = 0;
+    for(int i = 0; i < num_chips; i++){
+      latched_or |= chip_latch[i];
+    }
+    PinEdge e = {now_ns, pin_level[pin], latched_or};
+    output_en_edges.push_back(e);
+  }
+  int chip = chip_for_pin(pin);
+  if(chip >= 0 && !old && level){
+    uint8_t prev = chip_latch[chip];
+    chip_latch[chip] = chip_shift[chip];
+    if(capture_spi){
+      SpiByte b = {now_ns, chip, chip_shift[chip]};
+      spi_log.push_back(b);
+    }
+    if(on_tpic_latch){
+      on_tpic_latch(chip, prev, chip_latch[chip]);
+    }
+  }
+}
+
+inline bool outputs_enabled(){
+  return output_en_pin < 0 || pin_level[output_en_pin];
+}
+
+/***********************************************************
+ * SPI bus
+ ***********************************************************/
+inline void spi_begin_transaction(uint32_t clock_hz){
+  spi_clock_hz = clock_hz ? clock_hz : 4000000;
+  spi_in_txn = true;
+  spi_txn_start_ns = now_ns;
+  stats.spi_transactions++;
+  advance(costs.spi_txn_overhead_ns / 2);
+}
+
+inline void spi_end_transaction(){
+  advance(costs.spi_txn_overhead_ns / 2);
+  if(spi_in_txn){
+    stats.spi_bus_ns += now_ns - spi_txn_start_ns;
+  }
+  spi_in_txn = false;
+}
+
+inline uint8_t spi_transfer(uint8_t out){
+  uint64_t bit_ns = 1000000000ULL / spi_clock_hz;
+  advance(8 * bit_ns + costs.spi_byte_overhead_ns);
+  stats.spi_bytes++;
+  // every chip whose select is low shifts the byte in
+  for(int i = 0; i < num_chips; i++){
+    if(!pin_level[cs_pins[i]]){
+      chip_shift[i] = out;
+    }
+  }
+  return 0;
+}
+
+/***********************************************************
+ * I2C bus: one register read (ADC conversion, RTC register)
+ ***********************************************************/
+inline void i2c_read_cost(){
+  uint64_t start = now_ns;
+  advance(costs.i2c_txn_overhead_ns + costs.i2c_bits_per_read * (1000000000ULL / i2c_clock_hz));
+  stats.i2c_transactions++;
+  stats.i2c_bus_ns += now_ns - start;
+}
+
+inline uint8_t adc_read(int channel){
+  i2c_read_cost();
+  if(adc_model){
+    return adc_model(channel, now_ns);
+  }
+  return 0;
+}
+
+inline uint32_t rtc_seconds_of_day(){
+  i2c_read_cost();
+  if(rtc_model){
+    return rtc_model(now_ns);
+  }
+  return static_cast<uint32_t>((rtc_start_seconds + now_ns / 1000000000ULL) % 86400);
+}
+
+/***********************************************************
+ * USB MIDI
+ ***********************************************************/
+inline void schedule_midi(uint64_t t_ns, uint8_t header, uint8_t b1, uint8_t b2, uint8_t b3){
+  MidiPacket p = {t_ns, header, b1, b2, b3};
+  auto it = std::upper_bound(midi_queue.begin(), midi_queue.end(), p,
+                             [](const MidiPacket& a, const MidiPacket& b){ return a.t_ns < b.t_ns; });
+  midi_queue.insert(it, p);
+}
+
+// Returns false when nothing has arrived yet
+inline bool midi_pop(MidiPacket& out){
+  advance(costs.usb_read_ns);
+  if(midi_queue.empty() || midi_queue.front().t_ns > now_ns){
+    return false;
+  }
+  out = midi_queue.front();
+  midi_queue.pop_front();
+  stats.midi_packets_read++;
+  return true;
+}
+
+/***********************************************************
+ * Serial TX
+ ***********************************************************/
+inline uint64_t serial_byte_ns(){
+  return 10ULL * 1000000000ULL / costs.serial_baud;
+}
+
+inline uint32_t serial_pending(){
+  if(serial_idle_at_ns <= now_ns){
+    return 0;
+  }
+  return static_cast<uint32_t>((serial_idle_at_ns - now_ns + serial_byte_ns() - 1) / serial_byte_ns());
+}
+
+inline int serial_available_for_write(){
+  return static_cast<int>(costs.serial_tx_buffer - std::min(serial_pending(), costs.serial_tx_buffer));
+}
+
+inline void serial_write(uint8_t c){
+  if(serial_pending() >= costs.serial_tx_buffer){
+    // block until one slot drains
+    uint64_t free_at = serial_idle_at_ns - (costs.serial_tx_buffer - 1) * serial_byte_ns();
+    if(free_at > now_ns){
+      stats.serial_blocked_ns += free_at - now_ns;
+      advance_to(free_at);
+    }
+  }
+  serial_idle_at_ns = std::max(serial_idle_at_ns, now_ns) + serial_byte_ns();
+  stats.serial_bytes++;
+  if(echo_serial){
+    fputc(c, echo_file ? echo_file : stdout);
+  }
+}
+
+/***********************************************************
+ * Resets everything to power-on state
+ ***********************************************************/
+inline void reset(){
+  now_ns = 0;
+  hard_deadline_ns = UINT64_MAX;
+  stats = Stats();
+  for(int i = 0; i < NUM_PINS; i++){
+    pin_level[i] = 1;
+    pin_mode[i] = 0;
+    pin_driven[i] = false;
+    isr_slots[i] = IsrSlot();
+  }
+  pin_events.clear();
+  spi_log.clear();
+  for(int i = 0; i < MAX_CHIPS; i++){
+    chip_shift[i] = 0;
+    chip_latch[i] = 0;
+  }
+  spi_in_txn = false;
+  midi_queue.clear();
+  serial_idle_at_ns = 0;
+  serial_rx.clear();
+  in_isr = false;
+  interrupts_enabled = true;
+  output_en_edges.clear();
+  rtc_model = nullptr;
+}
+
+} // namespace sim
+
+#endif
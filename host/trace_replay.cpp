@@ -0,0 +1,381 @@
+/* Filename: trace_replay.cpp
+ * Author: Liam Warner
+ * Purpose: replays an input trace dumped by the firmware ('t' over Serial, see
+ *          orchestrion_trace.h) on the simulated board. The recorded ADC readings, RTC
+ *          fields, USB MIDI packets, switch/fault pin levels and random seed are fed back
+ *          at their recorded times while setup()/loop() run, and the TPIC bytes the replay
+ *          sends are compared with the ones in the trace. Exits 0 if they match byte for
+ *          byte, 1 if not.
+ *
+ *   usage: trace_replay [--spi-trace FILE] [--verbose] DUMP
+ *
+ *   DUMP is a Serial capture; anything that isn't a trace line (log lines, #perf) is
+ *   skipped, and if it holds several dumps the last complete one is used. Only a trace
+ *   that starts at power up (no records dropped) replays the firmware's whole state, the
+ *   solenoid calibration in flash excepted: the simulated flash starts empty. A fault
+ *   edge replays at the first read that saw it, not at the edge that ran the ISR. ADC
+ *   readings are only known to within the dead band the trace was recorded with
+ *   (TRACE_ADC_DEADBAND), so with a nonzero band a run that reacted to the sensors can
+ *   replay with different TPIC bytes; the first mismatch is reported.
+ */
+
+#include "../orchestrion_control_v4.ino"
+#include "sim/board.h"
+
+#include <string>
+
+#if !TRACE_ENABLED
+#error "trace_replay needs the firmware built with TRACE_ENABLED"
+#endif
+
+// One decoded record, at its absolute micros() time
+struct TraceRecord {
+  uint64_t t_us;
+  uint8_t header;
+  uint8_t payload[4];
+};
+
+struct TpicByte {
+  uint64_t t_us;
+  int chip;
+  uint8_t value;
+};
+
+struct TraceDump {
+  int version = 0;
+  uint32_t base_us = 0;
+  uint32_t bytes = 0;
+  bool wrapped = false;
+  uint32_t skipped = 0;
+  int adc_deadband = 0;
+  uint32_t checksum = 0;
+  std::vector<uint8_t> data;
+};
+
+// Recorded value of one input from t_ns on
+struct Sample {
+  uint64_t t_ns;
+  int value;
+};
+
+static std::vector<Sample> adc_samples[8];
+static std::vector<Sample> rtc_samples[3];
+
+// latest sample at or before t_ns, or fallback if there is none yet
+static int sample_at(const std::vector<Sample>& samples, uint64_t t_ns, int fallback){
+  auto it = std::upper_bound(samples.begin(), samples.end(), t_ns,
+                             [](uint64_t t, const Sample& s){ return t < s.t_ns; });
+  return it == samples.begin() ? fallback : (it - 1)->value;
+}
+
+static uint8_t replay_adc(int channel, uint64_t t_ns){
+  return static_cast<uint8_t>(sample_at(adc_samples[channel & 7], t_ns, 0));
+}
+
+static uint32_t replay_rtc(uint64_t t_ns){
+  int hour = sample_at(rtc_samples[0], t_ns, 12);
+  int minute = sample_at(rtc_samples[1], t_ns, 0);
+  int second = sample_at(rtc_samples[2], t_ns, 0);
+  return static_cast<uint32_t>((hour * 60 + minute) * 60 + second);
+}
+
+static bool parse_hex(const char* s, std::vector<uint8_t>& out){
+  while(*s && *s != '\r' && *s != '\n'){
+    unsigned int b;
+    if(sscanf(s, "%2x", &b) != 1 || !s[1]){
+      return false;
+    }
+    out.push_back(static_cast<uint8_t>(b));
+    s += 2;
+  }
+  return true;
+}
+
+/***********************************************************
+ * Reads the last complete dump in a Serial capture. False if
+ * there is none.
+ ***********************************************************/
+static bool read_dump(FILE* f, TraceDump& out){
+  char line[512];
+  TraceDump cur;
+  bool in_dump = false;
+  bool found = false;
+  while(fgets(line, sizeof(line), f)){
+    unsigned long base, bytes, skipped, sum;
+    int version, wrapped, deadband;
+    if(sscanf(line, "#trace end %lu", &sum) == 1){
+      if(in_dump){
+        cur.checksum = static_cast<uint32_t>(sum);
+        out = cur;
+        found = true;
+      }
+      in_dump = false;
+    }else if(sscanf(line, "#trace %d %lu %lu %d %lu %d", &version, &base, &bytes, &wrapped, &skipped, &deadband) == 6){
+      cur = TraceDump();
+      cur.version = version;
+      cur.base_us = static_cast<uint32_t>(base);
+      cur.bytes = static_cast<uint32_t>(bytes);
+      cur.wrapped = wrapped != 0;
+      cur.skipped = static_cast<uint32_t>(skipped);
+      cur.adc_deadband = deadband;
+      in_dump = true;
+    }else if(in_dump && strncmp(line, "#t ", 3) == 0){
+      if(!parse_hex(line + 3, cur.data)){
+        in_dump = false; //garbled line, this dump can't be used
+      }
+    }
+  }
+  return found;
+}
+
+static uint32_t fletcher16(const std::vector<uint8_t>& data){
+  uint32_t a = 0, b = 0;
+  for(uint8_t x : data){
+    a = (a + x) % 255;
+    b = (b + a) % 255;
+  }
+  return (b << 8) | a;
+}
+
+/***********************************************************
+ * Decodes the record stream. False if it ends partway
+ * through a record.
+ ***********************************************************/
+static bool decode(const TraceDump& dump, std::vector<TraceRecord>& out){
+  uint64_t t_us = dump.base_us;
+  size_t i = 0;
+  while(i < dump.data.size()){
+    TraceRecord r = {};
+    r.header = dump.data[i++];
+    uint64_t delta = 0;
+    int shift = 0;
+    uint8_t b;
+    do {
+      if(i >= dump.data.size()){
+        return false;
+      }
+      b = dump.data[i++];
+      delta |= static_cast<uint64_t>(b & 0x7F) << shift;
+      shift += 7;
+    } while(b & 0x80);
+    t_us += delta;
+    r.t_us = t_us;
+    uint8_t n = trace_payload_len(r.header);
+    if(i + n > dump.data.size()){
+      return false;
+    }
+    for(uint8_t k = 0; k < n; k++){
+      r.payload[k] = dump.data[i++];
+    }
+    out.push_back(r);
+  }
+  return true;
+}
+
+int main(int argc, char** argv){
+  std::string spi_trace;
+  std::string path;
+  bool verbose = false;
+
+  for(int i = 1; i < argc; i++){
+    std::string a = argv[i];
+    if(a == "--spi-trace" && i + 1 < argc){
+      spi_trace = argv[++i];
+    }else if(a == "--verbose"){
+      verbose = true;
+    }else if(path.empty() && a[0] != '-'){
+      path = a;
+    }else{
+      path.clear();
+      break;
+    }
+  }
+  if(path.empty()){
+    fprintf(stderr, "usage: trace_replay [--spi-trace FILE] [--verbose] DUMP\n");
+    return 2;
+  }
+
+  FILE* f = fopen(path.c_str(), "r");
+  if(!f){
+    fprintf(stderr, "can't read %s\n", path.c_str());
+    return 2;
+  }
+  TraceDump dump;
+  bool found = read_dump(f, dump);
+  fclose(f);
+  if(!found){
+    fprintf(stderr, "%s: no complete #trace dump\n", path.c_str());
+    return 2;
+  }
+  if(dump.version != TRACE_VERSION){
+    fprintf(stderr, "trace version %d, this build reads %d\n", dump.version, TRACE_VERSION);
+    return 2;
+  }
+  if(dump.data.size() != dump.bytes || fletcher16(dump.data) != dump.checksum){
+    fprintf(stderr, "trace is damaged: %zu of %lu bytes, checksum %u, expected %lu\n", dump.data.size(),
+            (unsigned long)dump.bytes, (unsigned)fletcher16(dump.data), (unsigned long)dump.checksum);
+    return 2;
+  }
+  std::vector<TraceRecord> records;
+  if(!decode(dump, records) || records.empty()){
+    fprintf(stderr, "trace is damaged: the last record is cut off\n");
+    return 2;
+  }
+
+  board::reset(board::MODE_MIDI, 1);
+  sim::adc_model = replay_adc;
+  sim::rtc_model = replay_rtc;
+
+  // A read's record is stamped by the micros() after it, up to a microsecond later, so
+  // each input takes its recorded value a microsecond before its stamp
+  uint64_t power_up_us = UINT64_MAX;
+  uint64_t pins_set = 0;
+  std::vector<TpicByte> expected;
+  uint32_t adc_full = 0, adc_delta = 0, midi = 0, rtc = 0, pins = 0, seeds = 0;
+  for(const TraceRecord& r : records){
+    uint64_t at_ns = r.t_us * 1000ULL;
+    at_ns = at_ns >= 1000 ? at_ns - 1000 : 0;
+    if(r.header & TRACE_ADC_DELTA){
+      int channel = (r.header >> 4) & 7;
+      int delta = (r.header & 0x08) ? (r.header & 0x0F) - 16 : (r.header & 0x0F);
+      int value = sample_at(adc_samples[channel], UINT64_MAX, 0) + delta;
+      adc_samples[channel].push_back({at_ns, value});
+      adc_delta++;
+      continue;
+    }
+    switch(r.header & 0xF0){
+      case TRACE_ADC:
+        adc_samples[r.header & 7].push_back({at_ns, r.payload[0]});
+        adc_full++;
+        break;
+      case TRACE_MIDI:
+        sim::schedule_midi(at_ns, r.header & 0x0F, r.payload[0], r.payload[1], r.payload[2]);
+        midi++;
+        break;
+      case TRACE_RTC:
+        rtc_samples[r.header & 3].push_back({at_ns, r.payload[0]});
+        rtc++;
+        break;
+      case TRACE_PIN: {
+        int pin = r.payload[0] & 63;
+        // the first level seen of each pin is its level from power up
+        bool first = !(pins_set & (1ULL << pin));
+        pins_set |= 1ULL << pin;
+        sim::schedule_pin(first ? 0 : at_ns, pin, r.header & 1);
+        pins++;
+        break;
+      }
+      case TRACE_TPIC:
+        expected.push_back({r.t_us, r.header & 7, r.payload[0]});
+        break;
+      case TRACE_POWER_UP:
+        if(power_up_us == UINT64_MAX){
+          power_up_us = r.t_us;
+        }
+        break;
+      case TRACE_SEED:
+        rng_fixed_seed = static_cast<uint32_t>(r.payload[0]) | static_cast<uint32_t>(r.payload[1]) << 8 |
+                         static_cast<uint32_t>(r.payload[2]) << 16 | static_cast<uint32_t>(r.payload[3]) << 24;
+        seeds++;
+        break;
+    }
+  }
+
+  uint64_t first_us = records.front().t_us;
+  uint64_t last_us = records.back().t_us;
+  printf("trace               v%d, %lu bytes, %zu records over %.3f s, checksum ok\n", dump.version,
+         (unsigned long)dump.bytes, records.size(), (last_us - first_us) / 1e6);
+  printf("records             adc %lu (%lu as deltas), midi %lu, rtc %lu, pin %lu, tpic %zu, seed %lu\n",
+         (unsigned long)(adc_full + adc_delta), (unsigned long)adc_delta, (unsigned long)midi, (unsigned long)rtc,
+         (unsigned long)pins, expected.size(), (unsigned long)seeds);
+  if(dump.wrapped || power_up_us != first_us){
+    printf("warning             the trace doesn't start at power up, the firmware state before it "
+           "is unknown and the replay will likely differ\n");
+  }
+  if(dump.adc_deadband > 0){
+    printf("note                ADC readings were recorded to within +-%d counts, sensor-driven output "
+           "can differ\n", dump.adc_deadband);
+  }
+  if(dump.skipped){
+    printf("warning             %lu records were skipped during an earlier dump\n", (unsigned long)dump.skipped);
+  }
+
+  // the board powered up at power_up_us on its own clock, start the virtual clock there
+  uint64_t start_ns = power_up_us != UINT64_MAX ? power_up_us * 1000ULL : first_us * 1000ULL;
+  uint64_t end_ns = last_us * 1000ULL + 1000000ULL; //nothing was recorded after the last record
+  sim::advance_to(start_ns);
+  sim::hard_deadline_ns = end_ns + 60000000000ULL;
+  bool timed_out = false;
+  try {
+    setup();
+    while(sim::now_ns < end_ns){
+      loop();
+    }
+  } catch(const sim::Timeout&){
+    timed_out = true;
+  }
+
+  if(!spi_trace.empty()){
+    FILE* out = fopen(spi_trace.c_str(), "w");
+    if(out){
+      fprintf(out, "t_us,chip,byte\n");
+      for(const sim::SpiByte& b : sim::spi_log){
+        fprintf(out, "%.3f,%d,0x%02X\n", b.t_ns / 1000.0, b.chip, b.value);
+      }
+      fclose(out);
+    }
+  }
+
+  // the replay recorded its own trace, its TPIC records carry the same micros() stamps
+  TraceDump replayed;
+  replayed.base_us = trace_base_us;
+  for(uint16_t pos = trace_tail; pos != trace_head; pos = (pos + 1) & (TRACE_BUFFER_SIZE - 1)){
+    replayed.data.push_back(trace_buffer[pos]);
+  }
+  std::vector<TraceRecord> replayed_records;
+  decode(replayed, replayed_records);
+  std::vector<uint64_t> replayed_tpic_us;
+  for(const TraceRecord& r : replayed_records){
+    if((r.header & 0xF0) == TRACE_TPIC){
+      replayed_tpic_us.push_back(r.t_us);
+    }
+  }
+
+  // the replay's bytes against the recorded ones, in order
+  size_t n = std::min(expected.size(), sim::spi_log.size());
+  size_t mismatch = n;
+  size_t timed = 0;
+  uint64_t max_skew_us = 0;
+  for(size_t i = 0; i < n; i++){
+    const sim::SpiByte& got = sim::spi_log[i];
+    if(got.chip != expected[i].chip || got.value != expected[i].value){
+      mismatch = i;
+      break;
+    }
+    if(i < replayed_tpic_us.size() && !trace_wrapped){
+      uint64_t want_us = expected[i].t_us;
+      uint64_t got_us = replayed_tpic_us[i];
+      max_skew_us = std::max(max_skew_us, want_us > got_us ? want_us - got_us : got_us - want_us);
+      timed++;
+    }
+    if(verbose){
+      printf("  tpic %zu  chip %d 0x%02X  recorded at %.3f ms, replayed at %.3f ms\n", i, got.chip, got.value,
+             expected[i].t_us / 1e3, i < replayed_tpic_us.size() ? replayed_tpic_us[i] / 1e3 : 0.0);
+    }
+  }
+  bool exact = mismatch == n && expected.size() == sim::spi_log.size() && !timed_out;
+  printf("replay              %.3f s virtual%s, %zu TPIC bytes recorded, %zu replayed\n",
+         (sim::now_ns - start_ns) / 1e9, timed_out ? " [hard deadline hit]" : "", expected.size(),
+         sim::spi_log.size());
+  if(mismatch < n){
+    printf("first mismatch      TPIC byte %zu at %.3f ms: recorded chip %d 0x%02X, replayed chip %d 0x%02X\n",
+           mismatch, expected[mismatch].t_us / 1e3, expected[mismatch].chip, expected[mismatch].value,
+           sim::spi_log[mismatch].chip, sim::spi_log[mismatch].value);
+  }
+  if(timed){
+    printf("TPIC timing         %zu matching bytes sent within %llu us of their recorded time\n", timed,
+           (unsigned long long)max_skew_us);
+  }
+  printf("bit-exact           %s\n", exact ? "yes" : "no");
+  return exact ? 0 : 1;
+}
@@ -18,66 +18,202 @@
 #define SENSOR_PIN 14 //pin used as switch for sensor mode aka A0
 #define OUTPUT_EN 6
 
-#include "Prandom.h" //Prandom library by Rob Tillaart
+// note durations are integer ticks, 48 to the quarter so sixteenths (12) and triplets (16, 8) are exact
+#define TICKS_PER_QUARTER 48
+#define TICKS_PER_SIXTEENTH (TICKS_PER_QUARTER / 4)
+
 #include <iostream>
 #include <vector>
 #include <cmath>
-#include <SPI.h>
-#include <Adafruit_ADS7830.h>
-#include <DS3231.h>
 #include <algorithm>
+#include <type_traits>
+#include "orchestrion_hal.h" //SPI, ADC, RTC, MIDI and switch access (simulated in host/)
+#include "orchestrion_log.h" //LOG_* macros, never block on Serial
+#include "orchestrion_rng.h" //xoshiro128** engine R, seeded once in setup()
+#include "orchestrion_calibration.h" //per note and velocity solenoid on-times, kept in flash
+#include "orchestrion_scheduler.h" //timed note-on/note-off events
+#include "orchestrion_sensor_scan.h" //background ADS7830 scan, one channel per step
+#include "orchestrion_sensor_cond.h" //smoothing, hysteresis and rate of change of the scan
+#include "orchestrion_schedule.h" //daily schedule table, cached time of day
+#include "orchestrion_static_vector.h" //inline note storage for licks, no heap
+#include "orchestrion_transport.h" //beat grid for note onsets, tempo changes on the beat
+#include "orchestrion_ngram_tables.h" //trained n-gram note models, generated by host/ngram_train
 
+/***********************************************************
+ * Function: constexpr uint8_t sixteenths_to_ticks(float sixteenths)
+ * Description: Converts a duration in sixteenths, as the banks
+ * are written, to ticks rounded to the nearest one. Saturates
+ * at 255 ticks (21 sixteenths), lick_bank_check_durations()
+ * logs any bank note that hit it.
+ ***********************************************************/
+constexpr uint8_t sixteenths_to_ticks(float sixteenths){
+  return sixteenths <= 0 ? 0
+       : (sixteenths * TICKS_PER_SIXTEENTH + 0.5f >= 255 ? 255
+       : static_cast<uint8_t>(sixteenths * TICKS_PER_SIXTEENTH + 0.5f));
+}
 
-//1 MHz SPI clock, shifts in data MSB first, data mode is 0
-//see https://en.wikipedia.org/wiki/Serial_Peripheral_Interface for more detail
-SPISettings spi_settings = {100000, MSBFIRST, SPI_MODE0};
-
-Adafruit_ADS7830 ad7830;
-
-DS3231 myRTC;
-bool century = false;
-bool h12Flag;
-bool pmFlag;
-byte alarmDay, alarmHour, alarmMinute, alarmSecond, alarmBits;
-bool alarmDy, alarmH12Flag, alarmPmFlag;
-
-static Prandom R;
-
+// 4 bytes, a full bank of licks and their copies sit in RAM
 struct Note {
-  int note_index;
-  float duration; //rounded to nearest 0.5 (eighth note)
-  int velocity; //1, 2, 3
-  int probability; //0 to 100, IRRELEVANT except for licks
+  int8_t note_index; //0 to 7, -1 = no note
+  uint8_t velocity; //1, 2, 3
+  uint8_t probability; //0 to 100, IRRELEVANT except for licks
+  uint8_t duration_ticks; //TICKS_PER_QUARTER to the quarter note
+
+  constexpr Note() : note_index(0), velocity(0), probability(0), duration_ticks(0) {}
+  // same argument order as the old {index, duration, velocity, probability} so the banks read the same
+  constexpr Note(int idx, float sixteenths, int vel, int prob = 0)
+    : note_index(static_cast<int8_t>(idx)), velocity(static_cast<uint8_t>(vel)),
+      probability(static_cast<uint8_t>(prob)), duration_ticks(sixteenths_to_ticks(sixteenths)) {}
 };
+static_assert(sizeof(Note) == 4, "Note should pack into 4 bytes");
 
 static int this_note_time = millis(); //DEBUG PURPOSES           
-static int past_time = millis();
 
 const int lick_mode_sensor_threshold = 120;
-static int lick_mode_inactivity_timer = millis();
+static uint32_t lick_mode_inactivity_timer = millis();
 static bool tried_to_grab_attention = 0;
 
 // Note index corresponds to available_notes array, 1 for available/inactive, 0 for unavailable/active
 static int note_inactive_arr[8] = {1, 1, 1, 1, 1, 1, 1, 1};
 
-// Note timers keeps track of how long each note is on, turns off if over certain threshold
-static int note_timers[8] = {0};
+// Time (ms) each note was last released, sensor mode waits sensor_note_wait_timers after it
+static uint32_t sensor_note_timers[8] = {0};
 
-static int sensor_note_timers[8] = {0};
-
-static int sensor_note_wait_timers[8] = {10000};
+static uint32_t sensor_note_wait_timers[8] = {10000};
 
 // Corresponding index updated with velocity level (1, 2, 3) if note is turned on
 // Happens at the same time the note_inactive_arr array is updated
 static int active_note_vel_arr[8] = {0}; 
 
+// Shadow image of the byte each TPIC (CS_PIN0..CS_PIN3) is driving. Note on/off only
+// change this image, tpic_flush() sends the dirty chips once per tick.
+#define NUM_TPICS 4
+static byte tpic_shadow[NUM_TPICS] = {0};
+static uint8_t tpic_dirty = 0x0F; // bit per chip, all dirty at power up so setup()'s flush clears them
+
+struct TpicStats {
+  uint32_t note_writes; // note on/off requests, each was a full transaction before the shadow image
+  uint32_t frames;      // chip bytes actually shifted out
+  uint32_t flushes;     // SPI transactions used for them
+};
+static TpicStats tpic_stats = {0, 0, 0};
+
+// Live MIDI input, read_midi() drains the USB queue into this batch once per tick
+#define MIDI_BATCH_SIZE 16
+
+struct MidiEvent {
+  uint8_t pitch;
+  uint8_t velocity;
+  bool on; // false for 0x8 and for 0x9 with velocity 0
+};
+static MidiEvent midi_batch[MIDI_BATCH_SIZE];
+
+struct MidiStats {
+  uint32_t packets;      // USB MIDI packets received
+  uint32_t queued;       // note on/off events put in a batch
+  uint32_t struck;       // note-ons that struck a note
+  uint32_t dropped_busy; // note-ons dropped because that note was busy and its retrigger queue full
+  uint32_t deferred;     // note-ons on a busy note held back to strike after its release
+  uint32_t retriggered;  // deferred note-ons that were struck
+  uint32_t note_offs;    // note-offs, including velocity 0 note-ons
+  uint32_t ignored;      // other messages and pitches that aren't on the drum
+  uint32_t batches_full; // ticks that left packets in the queue for the next tick
+  uint32_t chords;       // groups of held note-ons struck together
+};
+static MidiStats midi_stats = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+
+// Note-ons are held this long from the first one of a group, so notes of a chord that arrive a
+// USB frame or two apart still strike together in one SPI write per chip. 0 strikes every
+// batch straight away.
+#ifndef MIDI_CHORD_WINDOW_US
+#define MIDI_CHORD_WINDOW_US 1000
+#endif
+
+struct MidiChord {
+  uint8_t velocity[8]; // velocity level held per note index, 0 = nothing held
+  uint8_t count;
+  uint32_t due_us;     // when the held note-ons are struck
+};
+static MidiChord midi_chord = {{0}, 0, 0};
+
 // Available_notes defines integer associated available notes for song generation, and associated octave
 // Integer conversion here: 60=C4, 61=C#4/Db4, 62=D, 63=D#/Eb, 64=E, 65=F, 66=F#/Gb, 67=G, 68=G#/Ab, 69=A, 70=A#/Bb, 71=B
 //const int available_notes[8] = {60, 62, 63, 67, 69, 72, 74, 75};
-const int available_notes[8] = {60, 69, 67, 75, 63, 74, 62, 72};
+constexpr int available_notes[8] = {60, 69, 67, 75, 63, 74, 62, 72};
+
+// MIDI pitch (0-127) -> note_index lookup, one table per policy, built at compile time from
+// available_notes. -1 means the pitch isn't played.
+//  PITCH_MAP_DROP: only the exact pitches in available_notes
+//  PITCH_MAP_OCTAVE_FOLD: any octave of an available pitch class, folded to the nearest tongue
+//  PITCH_MAP_SNAP_SCALE: every pitch, snapped to the nearest available pitch class, then octave
+#define PITCH_MAP_DROP 0
+#define PITCH_MAP_OCTAVE_FOLD 1
+#define PITCH_MAP_SNAP_SCALE 2
+#define NUM_PITCH_MAP_POLICIES 3
+
+#ifndef PITCH_MAP_POLICY
+#define PITCH_MAP_POLICY PITCH_MAP_DROP
+#endif
+
+struct PitchMap {
+  int8_t note_index[128];
+};
+
+constexpr int pitch_abs(int x){
+  return x < 0 ? -x : x;
+}
+
+// semitones between two pitch classes, going the short way round the octave
+constexpr int pitch_class_distance(int a, int b){
+  return pitch_abs(a % 12 - b % 12) > 6 ? 12 - pitch_abs(a % 12 - b % 12) : pitch_abs(a % 12 - b % 12);
+}
+
+// how far pitch is from available_notes[i] under a policy, -1 if the policy never maps it there
+constexpr int pitch_map_cost(int pitch, int policy, int i){
+  return policy == PITCH_MAP_DROP ? (pitch == available_notes[i] ? 0 : -1)
+       : policy == PITCH_MAP_OCTAVE_FOLD ? (pitch_class_distance(pitch, available_notes[i]) == 0 ?
+                                            pitch_abs(pitch - available_notes[i]) : -1)
+       : pitch_class_distance(pitch, available_notes[i]) * 128 + pitch_abs(pitch - available_notes[i]);
+}
+
+// index of the lowest cost note from i on, best is the best index before i (-1 if none yet)
+constexpr int pitch_map_best(int pitch, int policy, int i, int best){
+  return i == 8 ? best
+       : pitch_map_cost(pitch, policy, i) >= 0 &&
+         (best < 0 || pitch_map_cost(pitch, policy, i) < pitch_map_cost(pitch, policy, best)) ?
+           pitch_map_best(pitch, policy, i + 1, i)
+       : pitch_map_best(pitch, policy, i + 1, best);
+}
+
+// 0..N-1 as a parameter pack, so a lookup table can be filled in one constexpr expression
+template<int... Ps> struct IndexSeq {};
+template<int N, int... Ps> struct MakeIndexSeq : MakeIndexSeq<N - 1, N - 1, Ps...> {};
+template<int... Ps> struct MakeIndexSeq<0, Ps...> { typedef IndexSeq<Ps...> type; };
+
+template<int... Ps>
+constexpr PitchMap make_pitch_map(int policy, IndexSeq<Ps...>){
+  return PitchMap{{static_cast<int8_t>(pitch_map_best(Ps, policy, 0, -1))...}};
+}
+
+constexpr PitchMap pitch_map_tables[NUM_PITCH_MAP_POLICIES] = {
+  make_pitch_map(PITCH_MAP_DROP, MakeIndexSeq<128>::type()),
+  make_pitch_map(PITCH_MAP_OCTAVE_FOLD, MakeIndexSeq<128>::type()),
+  make_pitch_map(PITCH_MAP_SNAP_SCALE, MakeIndexSeq<128>::type()),
+};
+
+static_assert(pitch_map_tables[PITCH_MAP_DROP].note_index[60] == 0 &&
+              pitch_map_tables[PITCH_MAP_DROP].note_index[61] == -1, "exact pitches only");
+static_assert(pitch_map_tables[PITCH_MAP_OCTAVE_FOLD].note_index[48] == 0 &&
+              pitch_map_tables[PITCH_MAP_OCTAVE_FOLD].note_index[87] == 3 &&
+              pitch_map_tables[PITCH_MAP_OCTAVE_FOLD].note_index[65] == -1, "C3 -> C4, D#6 -> D#5, no F");
+static_assert(pitch_map_tables[PITCH_MAP_SNAP_SCALE].note_index[0] >= 0 &&
+              pitch_map_tables[PITCH_MAP_SNAP_SCALE].note_index[127] >= 0, "every pitch plays");
+
+// table used by is_valid_note, switch with set_pitch_map_policy()
+static const int8_t* pitch_map = pitch_map_tables[PITCH_MAP_POLICY].note_index;
 
 // Probability array for determining the starting note in a phrase
-const float start_note_prob_array[8] = {0.35, 0.05, 0.05, 0.1, 0.05, 0.30, 0.05, 0.05};
+constexpr float start_note_prob_array[8] = {0.35, 0.05, 0.05, 0.1, 0.05, 0.30, 0.05, 0.05};
 
 // Probability matrices for determining the next note in a phrase
 // Each row is a "state" (current note is something, ex: row 0 for cur_note = C4)
@@ -94,8 +230,9 @@ const float start_note_prob_array[8] = {0.35, 0.05, 0.05, 0.1, 0.05, 0.30, 0.05,
 */
 
 //fixed to reflect note offsets shown in available notes array lines 50-51
-const float next_note_prob_matrix_2[8][8] = {{0.2,  0.2,  0.2,  0.15, 0.05, 0.1,  0.05, 0.05},
-                                             {0.05, 0.2,  0.05, 0.35, 0.05, 0.05, 0.2,  0.2 },
+//row 1 used to end in 0.2 and sum to 1.15, the old sampler ran out of range at 0.05
+constexpr float next_note_prob_matrix_2[8][8] = {{0.2,  0.2,  0.2,  0.15, 0.05, 0.1,  0.05, 0.05},
+                                             {0.05, 0.2,  0.05, 0.35, 0.05, 0.05, 0.2,  0.05},
                                              {0.35, 0.2,  0.05, 0.05, 0.05, 0.2,  0.05, 0.05},
                                              {0.05, 0.05, 0.05, 0.2,  0.05, 0.35, 0.2,  0.05},
                                              {0.2,  0.2,  0.2,  0.15, 0.05, 0.1,  0.05, 0.05},
@@ -115,7 +252,7 @@ std::vector<std::vector<float>> next_note_prob_matrix_2 = {{0.2,  0.2,  0.2,  0.
                                                            {0.1,  0.1,  0.1,  0.2,  0.05, 0.15, 0.1,  0.2 }};
 */
 
-const float next_note_prob_matrix_1[8][8] = {{0.25, 0.25, 0.25, 0.25, 0.00, 0.00, 0.00, 0.00},
+constexpr float next_note_prob_matrix_1[8][8] = {{0.25, 0.25, 0.25, 0.25, 0.00, 0.00, 0.00, 0.00},
                                                            {0.25, 0.25, 0.25, 0.25, 0.00, 0.00, 0.00, 0.00},
                                                            {0.25, 0.25, 0.25, 0.25, 0.00, 0.00, 0.00, 0.00},
                                                            {0.25, 0.25, 0.25, 0.25, 0.00, 0.00, 0.00, 0.00},
@@ -124,7 +261,7 @@ const float next_note_prob_matrix_1[8][8] = {{0.25, 0.25, 0.25, 0.25, 0.00, 0.00
                                                            {0.25, 0.25, 0.25, 0.25, 0.00, 0.00, 0.00, 0.00},
                                                            {0.25, 0.25, 0.25, 0.25, 0.00, 0.00, 0.00, 0.00}};
 
-const float next_note_prob_matrix_3[8][8] = {{0.05, 0.05, 0.05, 0.05, 0.20, 0.20, 0.20, 0.20},
+constexpr float next_note_prob_matrix_3[8][8] = {{0.05, 0.05, 0.05, 0.05, 0.20, 0.20, 0.20, 0.20},
                                                            {0.05, 0.05, 0.05, 0.05, 0.20, 0.20, 0.20, 0.20},
                                                            {0.05, 0.05, 0.05, 0.05, 0.20, 0.20, 0.20, 0.20},
                                                            {0.05, 0.05, 0.05, 0.05, 0.20, 0.20, 0.20, 0.20},
@@ -133,17 +270,132 @@ const float next_note_prob_matrix_3[8][8] = {{0.05, 0.05, 0.05, 0.05, 0.20, 0.20
                                                            {0.05, 0.05, 0.05, 0.05, 0.20, 0.20, 0.20, 0.20},
                                                            {0.05, 0.05, 0.05, 0.05, 0.20, 0.20, 0.20, 0.20}};
 
+// Quantized cumulative distributions of the tables above, built at compile time. cdf[i] is
+// P(note <= i) in 1/CDF_ONE steps, so a draw is a 15-bit random number compared against the
+// row with integer math (see sample_note_cdf).
+#define CDF_BITS 15
+#define CDF_ONE (1 << CDF_BITS)
+
+struct NoteCdf {
+  uint16_t cdf[8];
+};
+
+constexpr float prob_row_sum(const float* row, int n){
+  return n == 0 ? 0.0f : prob_row_sum(row, n - 1) + row[n - 1];
+}
+
+constexpr bool prob_row_ok(const float* row){
+  return prob_row_sum(row, 8) > 0.9999f && prob_row_sum(row, 8) < 1.0001f;
+}
+
+constexpr bool prob_matrix_ok(const float (*matrix)[8], int rows){
+  return rows == 0 ? true : prob_row_ok(matrix[rows - 1]) && prob_matrix_ok(matrix, rows - 1);
+}
+
+static_assert(prob_row_ok(start_note_prob_array), "start_note_prob_array must sum to 1");
+static_assert(prob_matrix_ok(next_note_prob_matrix_1, 8), "every row of next_note_prob_matrix_1 must sum to 1");
+static_assert(prob_matrix_ok(next_note_prob_matrix_2, 8), "every row of next_note_prob_matrix_2 must sum to 1");
+static_assert(prob_matrix_ok(next_note_prob_matrix_3, 8), "every row of next_note_prob_matrix_3 must sum to 1");
+
+constexpr uint16_t prob_cdf_entry(const float* row, int i){
+  // the last entry is exactly CDF_ONE so rounding can never leave a gap at the top
+  return i == 7 ? CDF_ONE : static_cast<uint16_t>(prob_row_sum(row, i + 1) * CDF_ONE + 0.5f);
+}
+
+constexpr NoteCdf make_note_cdf(const float* row){
+  return NoteCdf{{prob_cdf_entry(row, 0), prob_cdf_entry(row, 1), prob_cdf_entry(row, 2), prob_cdf_entry(row, 3),
+                  prob_cdf_entry(row, 4), prob_cdf_entry(row, 5), prob_cdf_entry(row, 6), prob_cdf_entry(row, 7)}};
+}
+
+#define NOTE_CDF_ROWS(matrix) {make_note_cdf(matrix[0]), make_note_cdf(matrix[1]), make_note_cdf(matrix[2]), \
+                               make_note_cdf(matrix[3]), make_note_cdf(matrix[4]), make_note_cdf(matrix[5]), \
+                               make_note_cdf(matrix[6]), make_note_cdf(matrix[7])}
+
+constexpr NoteCdf start_note_cdf = make_note_cdf(start_note_prob_array);
+
+// [0] energy 1 and below, [1] energy 2, [2] energy 3 and up
+constexpr NoteCdf next_note_cdf[3][8] = {NOTE_CDF_ROWS(next_note_prob_matrix_1),
+                                         NOTE_CDF_ROWS(next_note_prob_matrix_2),
+                                         NOTE_CDF_ROWS(next_note_prob_matrix_3)};
+
+static_assert(start_note_cdf.cdf[0] == 11469 && start_note_cdf.cdf[6] == 31130, "start_note_cdf quantization");
+static_assert(next_note_cdf[0][0].cdf[3] == CDF_ONE && next_note_cdf[0][0].cdf[2] == 24576,
+              "zero probability notes get no share of the range");
+
+// The trained n-gram rows (orchestrion_ngram_tables.h) are 8-bit: P(note <= i) for i = 0-6 in
+// 1/NGRAM_CDF_ONE steps, 7 bytes a row. A history with no row (NGRAM_NO_ROW, its last note
+// was never followed by another at that level in training) uses next_note_cdf.
+#define NGRAM_CDF_ONE 255
+
+static_assert(NGRAM_CONTEXTS == (1 << (3 * NGRAM_ORDER)), "one context per NGRAM_ORDER notes of history");
+static_assert(NGRAM_NUM_ROWS < NGRAM_NO_ROW, "row numbers must fit ngram_row_t");
+
+// Last NGRAM_ORDER notes played, as base-8 digits with the newest lowest, so it indexes
+// ngram_context_row directly and the newest note is ctx & 7
+struct NoteHistory {
+  uint16_t ctx;
+};
+
+// a phrase's history starts out as its first note repeated, the trainer pads the same way
+inline void note_history_start(NoteHistory& h, int note_index){
+  h.ctx = 0;
+  for(int k = 0; k < NGRAM_ORDER; k++){
+    h.ctx = static_cast<uint16_t>((h.ctx << 3) | (note_index & 7));
+  }
+}
+
+inline void note_history_push(NoteHistory& h, int note_index){
+  h.ctx = static_cast<uint16_t>(((h.ctx << 3) | (note_index & 7)) & (NGRAM_CONTEXTS - 1));
+}
+
 static int next_note_selection_array[8] = {0, 0, 0, 0, 0, 0, 0, 0};
 
 //stores sensor values for associated notes in avaiable_notes array
 //also associated with ADC channels 0-7 respectively
-static uint8_t sensor_values[8] = {0};
+//smoothed levels from the sensor conditioning, updated by read_sensor_vals() once per frame
+//(raw readings are in sensor_frame(), how fast a hand is moving is in sensor_rate)
+static const uint8_t* sensor_values = sensor_levels;
+
+// Sensor mode strikes a note while its channel is in sensor_trigger_band, the lick modes
+// count a hand as present while it is in sensor_presence_band
+static SensorBand sensor_trigger_band = {40, 32, 0};
+static SensorBand sensor_presence_band = {lick_mode_sensor_threshold, lick_mode_sensor_threshold - 16, 0};
+
+// Response curves, indexed by smoothed sensor level (0-255) and built at compile time
+// sensor_wait_curve: ms sensor mode waits after a release before re-striking, shorter the
+// closer the hand (34081 / level - 90, level 0 treated as 1)
+// sensor_velocity_curve: strike velocity for a present hand in the lick modes, one level
+// harder when the hand approaches fast (sensor_rate_velocity)
+constexpr uint16_t sensor_wait_ms(int level){
+  return static_cast<uint16_t>(34081 / (level < 1 ? 1 : level) - 90);
+}
+
+constexpr uint8_t sensor_velocity(int level){
+  return level < 140 ? 1 : (level < 200 ? 2 : 3);
+}
 
-// past sensor values are updated every 100ms to get rate of change estimate for sensor values
-// which is effectively how fast someone is moving their hand
-static uint8_t past_sensor_values[8] = {0};
+struct SensorWaitCurve {
+  uint16_t ms[256];
+};
+
+struct SensorVelocityCurve {
+  uint8_t velocity[256];
+};
+
+template<int... Ls>
+constexpr SensorWaitCurve make_sensor_wait_curve(IndexSeq<Ls...>){
+  return SensorWaitCurve{{sensor_wait_ms(Ls)...}};
+}
+
+template<int... Ls>
+constexpr SensorVelocityCurve make_sensor_velocity_curve(IndexSeq<Ls...>){
+  return SensorVelocityCurve{{sensor_velocity(Ls)...}};
+}
+
+constexpr SensorWaitCurve sensor_wait_curve = make_sensor_wait_curve(MakeIndexSeq<256>::type());
+constexpr SensorVelocityCurve sensor_velocity_curve = make_sensor_velocity_curve(MakeIndexSeq<256>::type());
 
-static int sensor_rate_of_change[8] = {0}; // see
+static_assert(sensor_wait_curve.ms[0] == sensor_wait_curve.ms[1] && sensor_wait_curve.ms[255] == 43, "wait curve ends");
 
 
 /***********************************************************
@@ -162,7 +414,7 @@ static int sensor_rate_of_change[8] = {0}; // see
  * fault pin is low, returns true if so.
  *****************************************/
 bool checkFault(){
-  if(digitalRead(FAULT_PIN) == LOW){
+  if(hal_pin_read(FAULT_PIN) == LOW){
     return 1;
   }else{
     return 0;
@@ -189,199 +441,558 @@ int get_cs_pin(int note_index){
 }
 
 /***********************************************************
- * Function: byte get_other_bits(byte, Note, bool)
- * Description: Returns an 8-bit SPI message with the other
- * bits of the other note in its TPIC pairing (ex: C4 paired with
- * D4) if the other note is active, meaning its velocity is
- * set in the active_note_vel_arr array.
+ * Function: int get_tpic(int note_index)
+ * Description: Returns which TPIC (0-3, for CS_PIN0-CS_PIN3)
+ * drives note_index.
  ***********************************************************/
-byte get_other_bits(byte message, Note cur_note, bool first_note_in_pair){
-  int cur_index = 0;
-  if(first_note_in_pair == 1){ // if first note was already set 
-  
-    cur_index = cur_note.note_index + 1; //check if second note is currently active
-    if(active_note_vel_arr[cur_index] == 1){
-      message = message | 0b00010000;
-    }else if (active_note_vel_arr[cur_index] == 2){
-      message = message | 0b00101000;
-    }else if (active_note_vel_arr[cur_index] == 3){
-      message = message | 0b00111000;
-    }
-
-  }else{ // if second note was set already
-  
-    cur_index = cur_note.note_index - 1; //check if second note is currently active
-    if(active_note_vel_arr[cur_index] == 1){
-      message = message | 0b00000010;
-    }else if (active_note_vel_arr[cur_index] == 2){
-      message = message | 0b00000101;
-    }else if (active_note_vel_arr[cur_index] == 3){
-      message = message | 0b00000111;
-    }
+int get_tpic(int note_index){
+  if(note_index < 0 || note_index >= 2 * NUM_TPICS){
+    return 0; //just in case, same as get_cs_pin
   }
-  return message;
+  return note_index / 2;
 }
 
+/***********************************************************
+ * Function: byte get_velocity_bits(int velocity)
+ * Description: Returns the 3-bit TPIC field for a velocity
+ * level (1, 2, 3), 0 turns both solenoids of the note off.
+ * The first note of a pair uses bits 0-2, the second 3-5.
+ ***********************************************************/
+byte get_velocity_bits(int velocity){
+  if(velocity == 1){
+    return 0b010;
+  }else if(velocity == 2){
+    return 0b101;
+  }else if(velocity == 3){
+    return 0b111;
+  }
+  return 0b000;
+}
 
 /***********************************************************
  * Function: get_SPI_message(Note cur_note)
- * Description: Returns an SPI message of a given note,
- * determined by its velocity and note_index. Uses the
- * get_other_bits_function to account for other active notes.
+ * Description: Returns the byte the TPIC of cur_note should
+ * hold with cur_note applied, determined by its velocity and
+ * note_index. The partner note's bits come from the shadow
+ * image, so other active notes on the same chip are kept.
  ***********************************************************/
 byte get_SPI_message(Note cur_note){
-  byte message = 0b00000000; //initialize message to all zeros
-  if(cur_note.note_index % 2 == 0){ //if first of pair of notes (ex: C4 in C4/D4 pair)
-    if(cur_note.velocity == 1){ //sets LSBs to send message
-      message = 0b00000010;
-    }else if(cur_note.velocity == 2){
-      message = 0b00000101;
-    }else if(cur_note.velocity == 3){
-      message = 0b00000111;
-    }
-
-    message = get_other_bits(message, cur_note, 1);
+  int chip = get_tpic(cur_note.note_index);
+  int shift = (cur_note.note_index % 2) * 3;
+  byte mask = 0b111 << shift;
+  return (tpic_shadow[chip] & ~mask) | (get_velocity_bits(cur_note.velocity) << shift);
+}
 
-  }else{
-    if(cur_note.velocity == 1){ //if second of pair of notes (ex: D4 in C4/D4 pair)
-      message = 0b00010000; //sets MSBs to send message
-    }else if(cur_note.velocity == 2){
-      message = 0b00101000;
-    }else if(cur_note.velocity == 3){
-      message = 0b00111000;
-    }
-    
-    message = get_other_bits(message, cur_note, 0);
-  
+/***********************************************************
+ * Function: void tpic_set_note(int note_index, int velocity)
+ * Description: Updates the shadow image for one note and
+ * marks its chip dirty if the byte changed. Nothing goes out
+ * on the bus until the next tpic_flush().
+ ***********************************************************/
+void tpic_set_note(int note_index, int velocity){
+  Note cur_note = {note_index, 0, velocity};
+  int chip = get_tpic(note_index);
+  byte message = get_SPI_message(cur_note);
+
+  tpic_stats.note_writes++;
+  if(message != tpic_shadow[chip]){
+    tpic_shadow[chip] = message;
+    tpic_dirty |= (1 << chip);
   }
-  return message;
 }
 
+/***********************************************************
+ * Function: void tpic_flush()
+ * Description: Called once per scheduler tick. Writes every
+ * dirty TPIC back to back in one SPI transaction, so a chord
+ * or staggered release costs one bus window instead of one
+ * transaction per note.
+ ***********************************************************/
+void tpic_flush(){
+  if(!tpic_dirty){
+    return;
+  }
 
-//LEGACY, MAY GET RID OF THIS
-int get_solenoid_on_delay(int velocity){
-  if(velocity == 1){
-    return (SOLENOID_ON_TIME + 30); //modify if 1-solenoid needs more on time
-  }else if(velocity == 2){
-    return SOLENOID_ON_TIME;
-  }else{ //velocity is max
-    return SOLENOID_ON_TIME;
+  int cs_pins[NUM_TPICS];
+  byte messages[NUM_TPICS];
+  int count = 0;
+  for(int chip = 0; chip < NUM_TPICS; chip++){
+    if(tpic_dirty & (1 << chip)){
+      cs_pins[count] = get_cs_pin(chip * 2);
+      messages[count] = tpic_shadow[chip];
+      count++;
+    }
   }
+  tpic_dirty = 0;
+
+  hal_spi_write_frames(cs_pins, messages, count);
+  tpic_stats.frames += count;
+  tpic_stats.flushes++;
 }
 
 /***********************************************************
- * Function: int get_note_duration_delay(Note cur_note, int bpm)
- * Description: Returns a note duration delay based on the
- * bpm and cur_note's duration.
+ * Function: uint32_t get_note_duration_us(const Note& cur_note, int bpm)
+ * Description: Returns how long cur_note lasts (us) at bpm.
+ * Integer math, a quarter is 60000000 / bpm us.
  ***********************************************************/
-int get_note_duration_delay(Note cur_note, int bpm){
-  return (1000 / (4.0 * bpm / cur_note.duration / 60));
+uint32_t get_note_duration_us(const Note& cur_note, int bpm){
+  return cur_note.duration_ticks * (60000000UL / TICKS_PER_QUARTER) / bpm;
 }
 
 /***********************************************************
  * Function: void send_SPI_message_on(Note cur_note)
- * Description: This sends an SPI message for the cur_note
- * using the appropriate CS_PIN and SPI pins. Uses the
- * get_cs_pin and get_SPI_message functions.
+ * Description: Turns cur_note on in the TPIC shadow image
+ * at its velocity. Goes out on the next tpic_flush().
  ***********************************************************/
 void send_SPI_message_on(Note cur_note){
-  int cs_pin = get_cs_pin(cur_note.note_index);
-  byte spi_received = 0;
-  byte spi_message = get_SPI_message(cur_note);
-
-  SPI.beginTransaction(spi_settings);
-  digitalWrite(cs_pin, LOW);
-  
-  spi_received = SPI.transfer(spi_message);
-  
-  digitalWrite(cs_pin, HIGH);
-  SPI.endTransaction();
-  
-  Serial.print("SPI ON Message: ");
-  Serial.println(spi_message, BIN);
-  Serial.print("Chip Select: ");
-  Serial.println(cs_pin);
+  tpic_set_note(cur_note.note_index, cur_note.velocity);
 
+  LOG_DEBUG("SPI ON message/CS", tpic_shadow[get_tpic(cur_note.note_index)], get_cs_pin(cur_note.note_index));
 }
 
 /***********************************************************
  * Function: void send_SPI_message_off(Note cur_note)
- * Description: This turns a particular note OFF, depending
- * on its note_index. Accounts for other active notes with
- * with the get_other_bits function (doesn't turn them off
- * prematurely).
+ * Description: This turns a particular note OFF in the TPIC
+ * shadow image, depending on its note_index. The other note
+ * in its TPIC pairing is left as it is (doesn't turn it off
+ * prematurely). Goes out on the next tpic_flush().
  ***********************************************************/
 void send_SPI_message_off(Note cur_note){
-  //turn solenoid(s) off regardless
-  int cs_pin = get_cs_pin(cur_note.note_index);
-  byte message = 0b00000000;
-  byte spi_received = 0;
+  tpic_set_note(cur_note.note_index, 0);
 
-  if(cur_note.note_index % 2 == 0){
-    message = get_other_bits(message, cur_note, 1);
-  }else{
-    message = get_other_bits(message, cur_note, 0);
+  LOG_DEBUG("SPI OFF message/CS", tpic_shadow[get_tpic(cur_note.note_index)], get_cs_pin(cur_note.note_index));
+}
+
+/********************************
+ * SCHEDULER FUNCTIONS START HERE
+ ********************************/
+
+// Bumped on every strike/release of a note and stamped into its note-off event, so an
+// off left over from an earlier strike is ignored
+static uint8_t note_strike_id[8] = {0};
+
+// Note-ons for a note that is still being actuated (a roll or tremolo on one tongue) wait
+// here, up to RETRIGGER_DEPTH per note, and are struck once it is released. A repeat is
+// struck no sooner than RETRIGGER_MIN_INTERVAL_US after the previous strike and
+// RETRIGGER_REST_US after the release, so the fastest a tongue repeats is its calibrated
+// on-time + rest, but never more than 1 / RETRIGGER_MIN_INTERVAL_US (20 Hz, coil duty).
+#define RETRIGGER_DEPTH 2
+#define RETRIGGER_MIN_INTERVAL_US 50000UL
+#define RETRIGGER_REST_US 10000UL
+
+struct RetriggerQueue {
+  uint8_t velocity[RETRIGGER_DEPTH]; // oldest first
+  uint8_t count;
+  bool scheduled; // an EVENT_RETRIGGER is queued for this note
+};
+static RetriggerQueue note_retrigger[8];
+static uint32_t note_last_strike_us[8] = {0};
+
+// Optional work to do while waiting for the next deadline (e.g. a sensor scan step), only
+// run if the deadline is at least SCHED_IDLE_GUARD_US away so it can't make a note late
+#define SCHED_IDLE_GUARD_US 1000
+static void (*scheduler_idle_work)() = NULL;
+
+/***********************************************************
+ * Function: void release_note(int note_index)
+ * Description: Turns a note off and marks it available again.
+ * Cancels its pending note-off, if any.
+ ***********************************************************/
+void release_note(int note_index){
+  Note cur_note = {note_index, 0, 3};
+  note_inactive_arr[note_index] = 1; //note is now off again
+  active_note_vel_arr[note_index] = 0; //reset corresponding velocity to zero now that note is off
+  note_strike_id[note_index]++;
+  sensor_note_timers[note_index] = millis(); //sensor mode re-strike wait counts from the release
+  send_SPI_message_off(cur_note); //now actually turn it off
+}
+
+/***********************************************************
+ * Function: void strike_note(Note cur_note)
+ * Description: Turns cur_note on and schedules its note-off
+ * get_solenoid_on_delay() from now. The caller makes sure the
+ * note is available (note_inactive_arr).
+ ***********************************************************/
+void strike_note(Note cur_note){
+  int i = cur_note.note_index;
+  note_inactive_arr[i] = 0; //note is active now
+  active_note_vel_arr[i] = cur_note.velocity; //so we know which solenoids to turn off
+  note_strike_id[i]++;
+  note_last_strike_us[i] = micros();
+  send_SPI_message_on(cur_note);
+
+  uint32_t off_us = micros() + static_cast<uint32_t>(get_solenoid_on_delay(i, cur_note.velocity)) * 1000UL;
+  SchedEvent off = {off_us, EVENT_NOTE_OFF,
+                    static_cast<int8_t>(i), 0, note_strike_id[i]};
+  if(!sched_push(off)){
+    LOG_ERROR("Scheduler full, releasing note now", i);
+    release_note(i); //never leave a solenoid on without an off time
   }
+}
 
-  SPI.beginTransaction(spi_settings);
-  digitalWrite(cs_pin, LOW);
-  
-  spi_received = SPI.transfer(message);
+/***********************************************************
+ * Function: bool schedule_note_on(uint32_t due_us, Note cur_note)
+ * Description: Queues cur_note to be struck at due_us.
+ ***********************************************************/
+bool schedule_note_on(uint32_t due_us, Note cur_note){
+  SchedEvent on = {due_us, EVENT_NOTE_ON, static_cast<int8_t>(cur_note.note_index),
+                   static_cast<uint8_t>(cur_note.velocity), 0};
+  return sched_push(on);
+}
 
-  digitalWrite(cs_pin, HIGH);
-  SPI.endTransaction();
+/***********************************************************
+ * Function: bool retrigger_defer(int note_index, int velocity)
+ * Description: Holds back a note-on for a busy note. False
+ * if its queue is already full (the caller drops it).
+ ***********************************************************/
+bool retrigger_defer(int note_index, int velocity){
+  RetriggerQueue& q = note_retrigger[note_index];
+  if(q.count >= RETRIGGER_DEPTH){
+    return false;
+  }
+  q.velocity[q.count++] = static_cast<uint8_t>(velocity);
+  return true;
+}
 
-  Serial.print("SPI OFF Message: ");
-  Serial.println(message, BIN);
-  Serial.print("Chip Select: ");
-  Serial.println(cs_pin);
+/***********************************************************
+ * Function: void retrigger_schedule(int note_index)
+ * Description: Called when note_index is released. If repeats
+ * are waiting, queues the next one for the later of the rest
+ * time after now and the minimum interval after its last
+ * strike.
+ ***********************************************************/
+void retrigger_schedule(int note_index){
+  RetriggerQueue& q = note_retrigger[note_index];
+  if(q.count == 0 || q.scheduled){
+    return;
+  }
+  uint32_t due = micros() + RETRIGGER_REST_US;
+  uint32_t interval_due = note_last_strike_us[note_index] + RETRIGGER_MIN_INTERVAL_US;
+  if(sched_before(due, interval_due)){
+    due = interval_due;
+  }
+  SchedEvent ev = {due, EVENT_RETRIGGER, static_cast<int8_t>(note_index), 0, 0};
+  q.scheduled = sched_push(ev);
+  if(!q.scheduled){
+    midi_stats.dropped_busy += q.count; //no room to wait, give them up
+    q.count = 0;
+  }
 }
 
 /***********************************************************
- * Function: update_note_timers(int note_inactive_arr[])
- * Description: Updates the note_timers array for notes that
- * are "off" (not currently being actuated).
+ * Function: void scheduler_dispatch(const SchedEvent &ev)
+ * Description: Carries out one due event.
  ***********************************************************/
-void update_note_timers(int note_inactive_arr[]){
-  for(int i=0; i<8; i++){
-    // Only updates timers for notes that are off
-    // Notes that are on retain timer value from when they were turned on
-    if(note_inactive_arr[i]){ 
-      note_timers[i] = millis();
-      /*
-      Serial.print("Note timer ");
-      Serial.print(i);
-      Serial.print(": ");
-      Serial.println(note_timers[i]);
-      */
+void scheduler_dispatch(const SchedEvent &ev){
+  if(ev.note_index < 0 || ev.note_index >= 8){
+    return;
+  }
+  if(ev.type == EVENT_NOTE_OFF){
+    if(ev.strike_id == note_strike_id[ev.note_index] && !note_inactive_arr[ev.note_index]){
+      PERF_RECORD_LATE(PERF_NOTE_OFF_LATE, micros(), ev.due_us);
+      LOG_DEBUG("Note off (idx/late us)", ev.note_index, micros() - ev.due_us);
+      release_note(ev.note_index);
+      retrigger_schedule(ev.note_index);
+    }
+  }else if(ev.type == EVENT_NOTE_ON){
+    if(note_inactive_arr[ev.note_index]){
+      Note cur_note = {ev.note_index, 0, ev.velocity};
+      strike_note(cur_note);
+    }else{
+      LOG_DEBUG("Scheduled note on dropped, note busy", ev.note_index);
+    }
+  }else if(ev.type == EVENT_RETRIGGER){
+    RetriggerQueue& q = note_retrigger[ev.note_index];
+    q.scheduled = false;
+    if(q.count == 0 || !note_inactive_arr[ev.note_index]){
+      return; //struck again meanwhile, the next release schedules it
     }
+    Note cur_note = {ev.note_index, 0, q.velocity[0]};
+    for(int k = 1; k < q.count; k++){
+      q.velocity[k - 1] = q.velocity[k];
+    }
+    q.count--;
+    strike_note(cur_note);
+    midi_stats.retriggered++;
+  }
+}
+
+/***********************************************************
+ * Function: void scheduler_run_due()
+ * Description: One scheduler tick. Carries out every event
+ * that is due, then sends all TPIC changes in one flush.
+ ***********************************************************/
+void scheduler_run_due(){
+  PERF_SCOPE(PERF_SCHED_STAGE);
+  SchedEvent ev;
+  while(sched_pop_due(micros(), ev)){
+    scheduler_dispatch(ev);
+  }
+  tpic_flush();
+}
+
+/***********************************************************
+ * Function: void serial_command_poll()
+ * Description: Call from idle time. Takes one command byte
+ * from Serial and hands it to whichever part owns it: 'p' and
+ * 'r' the timing histograms, 't' the input trace, 'c' and 'C'
+ * the solenoid calibration. Anything else is ignored.
+ ***********************************************************/
+void serial_command_poll(){
+  if(Serial.available() <= 0){
+    return;
+  }
+  int c = Serial.read();
+  if(!perf_command(c) && !trace_command(c)){
+    calibration_command(c);
   }
 }
 
+/***********************************************************
+ * Function: void scheduler_wait_until(uint32_t target_us)
+ * Description: Returns at target_us (micros() time), running
+ * scheduled events as they come due in the meantime. Idle
+ * work and log draining only happen between deadlines.
+ ***********************************************************/
+void scheduler_wait_until(uint32_t target_us){
+  while(true){
+    scheduler_run_due();
+    uint32_t now = micros();
+    if(!sched_before(now, target_us)){
+      return;
+    }
 
+    uint32_t next_due = target_us;
+    uint32_t event_due;
+    if(sched_next_due(event_due) && sched_before(event_due, next_due)){
+      next_due = event_due;
+    }
+    if(scheduler_idle_work != NULL && next_due - now > SCHED_IDLE_GUARD_US){
+      scheduler_idle_work();
+    }
+    log_drain();
+    serial_command_poll();
+    perf_poll();
+    trace_poll();
+  }
+}
 
 /***********************************************************
- * Function: void check_note_timers(int note_inactive_arr[])
- * Description: Checks the note timers array for any notes
- * that have been on longer than SOLENOID_ON_TIME. If so,
- * it turns that note off and updates the appropriate arrays.
+ * Function: void scheduler_wait_for_release(int note_index)
+ * Description: Waits until note_index has been turned off
+ * by its scheduled note-off.
  ***********************************************************/
-void check_note_timers(int note_inactive_arr[], Note cur_note){
-  for(int i=0; i<8; i++){
-    if(millis() - note_timers[i] >= get_solenoid_on_delay(active_note_vel_arr[i])){ 
-      Serial.print("Time exceeded solenoid on time: ");
-      Serial.print(millis() - note_timers[i]);
-      Serial.println(" ms.");
-
-      Note cur_note = {i, 0, 3};
-      Serial.println("Note is now off!");
-      note_inactive_arr[i] = 1; //note is now off again
-      active_note_vel_arr[i] = 0; //reset corresponding velocity to zero now that note is off
-      send_SPI_message_off(cur_note); //now actually turn it off
+void scheduler_wait_for_release(int note_index){
+  while(!note_inactive_arr[note_index]){
+    uint32_t event_due;
+    if(!sched_next_due(event_due)){
+      release_note(note_index); //no off pending, shouldn't happen
+      tpic_flush();
+      return;
     }
+    scheduler_wait_until(event_due);
+  }
+}
+
+/*****************************
+ * SOLENOID CALIBRATION SWEEP
+ *****************************/
+
+// A strike shows up on the note's proximity channel (beater and tongue move right under the
+// sensor) as a reading CAL_STRIKE_DELTA above its resting level
+#define CAL_STRIKE_DELTA 60
+#define CAL_LISTEN_MS 30 // a strike can still show up this long after the release
+#define CAL_REST_MS 150  // between pulses, so the tongue has stopped moving
+#define CAL_TRIALS 2     // an on-time only counts if it struck this many times in a row
+
+static bool cal_aborted = false; // a fault stopped the sweep, nothing measured after it counts
+
+bool fault_active(); // orchestrion_fault.h
+
+/***********************************************************
+ * Function: bool cal_fault()
+ * Description: True once a fault has hit during the sweep.
+ * The outputs are off from then on, so every pulse would read
+ * as no strike; the sweep stops instead.
+ ***********************************************************/
+bool cal_fault(){
+  if(!cal_aborted && fault_active()){
+    cal_aborted = true;
+  }
+  return cal_aborted;
+}
+
+/***********************************************************
+ * Function: int cal_resting_level(int note_index)
+ * Description: Average of a few reads of the note's channel
+ * with its solenoid off.
+ ***********************************************************/
+int cal_resting_level(int note_index){
+  int sum = 0;
+  for(int k = 0; k < 8; k++){
+    sum += hal_adc_read(note_index);
   }
+  return sum / 8;
 }
 
+/***********************************************************
+ * Function: bool cal_pulse_strikes(int note_index, int level,
+ *                                  int on_ms, int threshold)
+ * Description: Holds the note on for on_ms at level, watching
+ * its channel for a reading at or above threshold until
+ * CAL_LISTEN_MS after the release, then rests. False, with
+ * nothing pulsed, once a fault has stopped the sweep.
+ ***********************************************************/
+bool cal_pulse_strikes(int note_index, int level, int on_ms, int threshold){
+  if(cal_fault()){
+    return false;
+  }
+  bool struck = false;
+  tpic_set_note(note_index, level);
+  tpic_flush();
+  uint32_t off_us = micros() + static_cast<uint32_t>(on_ms) * 1000UL;
+  while(sched_before(micros(), off_us) && !cal_fault()){
+    if(!struck && hal_adc_read(note_index) >= threshold){
+      struck = true;
+    }
+  }
+  tpic_set_note(note_index, 0);
+  tpic_flush();
+
+  uint32_t listen_us = micros() + CAL_LISTEN_MS * 1000UL;
+  while(!struck && sched_before(micros(), listen_us) && !cal_fault()){
+    struck = hal_adc_read(note_index) >= threshold;
+  }
+  scheduler_wait_until(micros() + CAL_REST_MS * 1000UL);
+  return struck && !cal_aborted;
+}
+
+/***********************************************************
+ * Function: int cal_shortest_on_ms(int note_index, int level,
+ *                                  int threshold)
+ * Description: Shortest on-time (ms) that struck CAL_TRIALS
+ * times in a row, bisecting CAL_MIN_MS..CAL_MAX_MS (longer
+ * always strikes harder). -1 if even CAL_MAX_MS doesn't, or
+ * if a fault stopped the sweep (cal_aborted).
+ ***********************************************************/
+int cal_shortest_on_ms(int note_index, int level, int threshold){
+  int fails = CAL_MIN_MS - 1; //longest time known not to strike
+  int strikes = CAL_MAX_MS + 1; //shortest time known to strike
+  int on_ms = CAL_MAX_MS; //check the top end first, then bisect
+  while(strikes - fails > 1){
+    bool ok = true;
+    for(int trial = 0; ok && trial < CAL_TRIALS; trial++){
+      ok = cal_pulse_strikes(note_index, level, on_ms, threshold);
+    }
+    if(cal_aborted){
+      return -1;
+    }
+    if(ok){
+      strikes = on_ms;
+    }else if(on_ms == CAL_MAX_MS){
+      return -1;
+    }else{
+      fails = on_ms;
+    }
+    on_ms = (fails + strikes) / 2;
+  }
+  return strikes;
+}
+
+/***********************************************************
+ * Function: void calibrate_solenoids()
+ * Description: Finds the shortest on-time that strikes, per
+ * note and velocity level, and stores it plus CAL_MARGIN_MS
+ * in flash. Blocking, nothing else may be playing: up to 7
+ * bisection steps of CAL_TRIALS pulses, each the on-time plus
+ * CAL_LISTEN_MS and CAL_REST_MS, about 3.5 s per note and
+ * level. A level that never struck keeps the on-time it had.
+ * A fault stops the sweep and nothing is saved; the table is
+ * left as it was. Only run when asked for over Serial
+ * (calibration_command()).
+ ***********************************************************/
+void calibrate_solenoids(){
+  static const char* const done_msgs[CAL_LEVELS] = {
+    "Calibrated velocity 1 (note/on ms)", "Calibrated velocity 2 (note/on ms)", "Calibrated velocity 3 (note/on ms)"
+  };
+  LOG_INFO("Solenoid calibration sweep started");
+  SolenoidCalibration before = solenoid_cal;
+  cal_aborted = false;
+  int note = 0;
+  for(; note < CAL_NOTES && !cal_fault(); note++){
+    int threshold = cal_resting_level(note) + CAL_STRIKE_DELTA;
+    if(threshold > 255){
+      LOG_WARN("Calibration: sensor saturated, note skipped", note);
+      continue;
+    }
+    bool all_levels = true;
+    for(int level = 1; level <= CAL_LEVELS; level++){
+      int shortest = cal_shortest_on_ms(note, level, threshold);
+      if(cal_aborted){
+        break;
+      }
+      if(shortest < 0){
+        LOG_WARN("Calibration: no strike (note/velocity)", note, level);
+        all_levels = false;
+        continue;
+      }
+      int on_ms = min(shortest + CAL_MARGIN_MS, CAL_MAX_MS);
+      solenoid_cal.on_ms[note][level - 1] = static_cast<uint8_t>(on_ms);
+      LOG_INFO(done_msgs[level - 1], note, on_ms);
+    }
+    if(cal_aborted){
+      break;
+    }
+    if(all_levels){
+      solenoid_cal.swept_mask |= static_cast<uint8_t>(1 << note);
+    }
+  }
+  if(cal_aborted){
+    solenoid_cal = before;
+    LOG_ERROR("Solenoid calibration stopped by a fault, nothing saved (note)", note);
+    return;
+  }
+  if(solenoid_cal_save()){
+    LOG_INFO("Solenoid calibration saved (swept notes mask)", solenoid_cal.swept_mask);
+  }else{
+    LOG_INFO("Solenoid calibration unchanged, flash not written (swept notes mask)", solenoid_cal.swept_mask);
+  }
+}
+
+
+/***********************************************************
+ * Function: bool transport_try_strike(Transport& t, const Note& cur_note)
+ * Description: Strikes cur_note if its onset on the grid is
+ * due and its tongue is free, and moves the transport on by
+ * its duration. Returns false, having done nothing, if not.
+ * Never waits.
+ ***********************************************************/
+bool transport_try_strike(Transport& t, const Note& cur_note){
+  if(sched_before(micros(), transport_due_us(t)) || !note_inactive_arr[cur_note.note_index]){
+    return false;
+  }
+  strike_note(cur_note); //scheduler turns it off after its on time
+  scheduler_run_due(); //send it now
+  PERF_RECORD_LATE(PERF_ONSET_ERROR, micros(), transport_due_us(t));
+  LOG_DEBUG("Note on (tick/late us)", t.tick, micros() - transport_due_us(t));
+  transport_advance(t, cur_note.duration_ticks);
+  return true;
+}
+
+/***********************************************************
+ * Function: void transport_strike(Transport& t, const Note& cur_note)
+ * Description: Waits for cur_note's onset on the transport's
+ * grid and for its tongue to be free, strikes it and moves
+ * the transport on by its duration.
+ ***********************************************************/
+void transport_strike(Transport& t, const Note& cur_note){
+  if(transport_resync_if_late(t)){
+    LOG_WARN("Transport fell behind, resynced (tick)", t.tick);
+  }
+  scheduler_wait_until(transport_due_us(t));
+  scheduler_wait_for_release(cur_note.note_index); //tongue may still be held from an earlier note
+  transport_try_strike(t, cur_note);
+}
 
 
 /***************************
@@ -424,17 +1035,25 @@ int velocity_level(byte velocity) {
 
 /***********************************************************
  * Function: int is_valid_note(byte pitch)
- * Description: checks if note is valid (in available_notes),
+ * Description: checks if note is valid (mapped to one of
+ * available_notes under the current pitch map policy),
  * returns note_index if so, if not valid returns -1 which is
- * an indicator to NOT send an SPI message.
+ * an indicator to NOT send an SPI message. One table load.
  ***********************************************************/
 int is_valid_note(byte pitch){
-  for(int i=0; i < sizeof(available_notes) / sizeof(available_notes[0]); i++){
-    if(pitch == available_notes[i]){ //sometimes needs plus/minus twelve for octave adjustment
-      return i;
-    }
+  return pitch_map[pitch & 0x7F];
+}
+
+/***********************************************************
+ * Function: void set_pitch_map_policy(int policy)
+ * Description: Chooses how MIDI pitches that aren't on the
+ * drum are handled (PITCH_MAP_DROP, PITCH_MAP_OCTAVE_FOLD or
+ * PITCH_MAP_SNAP_SCALE). Unknown policies are ignored.
+ ***********************************************************/
+void set_pitch_map_policy(int policy){
+  if(policy >= 0 && policy < NUM_PITCH_MAP_POLICIES){
+    pitch_map = pitch_map_tables[policy].note_index;
   }
-  return -1;
 }
 
 /***********************************************************
@@ -443,182 +1062,201 @@ int is_valid_note(byte pitch){
  * incoming MIDI data parameters (channel, pitch, velocity).
  * First, it gets the velocity and note_index of the note to
  * turn on (duration doesn't matter for live MIDI input).
- * Then, it checks if the note is valid (note_index>=0) AND
- * if the note is off (not being actuated currently), only then
- * sends the SPI message and updates the appropriate arrays.
+ * Then, if the note is valid (note_index>=0), holds it in
+ * midi_chord to be struck with the rest of its chord by
+ * midi_chord_poll(). The same note twice in one chord window
+ * is counted as dropped.
  ***********************************************************/
 Note noteOn(byte channel, byte pitch, byte velocity){
+  (void)channel; //every channel plays the drum
   Note cur_note;
   cur_note.velocity = velocity_level(velocity);
   cur_note.note_index = is_valid_note(pitch);
 
-  if(cur_note.note_index >= 0 && note_inactive_arr[cur_note.note_index] && cur_note.velocity != 0){
-    Serial.println("Note was turned on!");
-    Serial.println("Time since last note on (ms): ");
-    Serial.println(millis() - this_note_time);
-    this_note_time = millis();
-    note_inactive_arr[cur_note.note_index] = 0; //whatever note was played is now on
-    active_note_vel_arr[cur_note.note_index] = cur_note.velocity; // record its velocity while it's on
-    send_SPI_message_on(cur_note);
-    if(checkFault()){
-      Serial.println("FAULT!");
+  if(cur_note.note_index < 0 || cur_note.velocity == 0){
+    midi_stats.ignored++;
+  }else if(midi_chord.velocity[cur_note.note_index] != 0){
+    midi_stats.dropped_busy++; //same note twice in one chord window, far inside RETRIGGER_MIN_INTERVAL_US
+  }else{
+    //held with the rest of its chord, struck by midi_chord_poll()
+    if(midi_chord.count == 0){
+      midi_chord.due_us = micros() + MIDI_CHORD_WINDOW_US;
     }
+    midi_chord.velocity[cur_note.note_index] = cur_note.velocity;
+    midi_chord.count++;
   }
 
   return cur_note;
 }
 
-//LEGACY, may get rid of this. check_note_timers handles turning notes off
-void noteOff(byte channel, byte pitch, byte velocity) {
-  Note cur_note;
-  cur_note.note_index = is_valid_note(pitch);
-  note_inactive_arr[cur_note.note_index] = 1; //now the note is off again
-  active_note_vel_arr[cur_note.note_index] = 0; //record no velocity now that it's off
-  send_SPI_message_off(cur_note);
+/***********************************************************
+ * Function: int midi_chord_poll()
+ * Description: Once the chord window of the held note-ons
+ * has passed, strikes all of them into the TPIC shadow image
+ * so the next tpic_flush() sends at most one byte per chip
+ * with every velocity in it. A note still being actuated
+ * (or with repeats already waiting) is deferred to the
+ * retrigger queue, or dropped if that is full. Returns notes
+ * struck.
+ ***********************************************************/
+int midi_chord_poll(){
+  if(midi_chord.count == 0 || sched_before(micros(), midi_chord.due_us)){
+    return 0;
+  }
+  int struck = 0;
+  for(int i = 0; i < 8; i++){
+    if(midi_chord.velocity[i] == 0){
+      continue;
+    }
+    if(note_inactive_arr[i] && note_retrigger[i].count == 0){
+      Note cur_note = {i, 0, midi_chord.velocity[i]};
+      strike_note(cur_note); //whatever note was played is now on, its note-off is scheduled
+      struck++;
+    }else if(retrigger_defer(i, midi_chord.velocity[i])){
+      midi_stats.deferred++; //struck after the release, in order behind any earlier repeats
+      if(note_inactive_arr[i]){
+        retrigger_schedule(i); //already released, only waiting for its interval
+      }
+    }else{
+      midi_stats.dropped_busy++;
+    }
+    midi_chord.velocity[i] = 0;
+  }
+  midi_chord.count = 0;
+  midi_stats.struck += struck;
+  midi_stats.chords++;
+
+  LOG_DEBUG("MIDI chord (notes), ms since last", struck, millis() - this_note_time);
+  this_note_time = millis();
+  return struck;
 }
 
 /***********************************************************
- * Function: Note read_midi()
- * Description: Called from main. Reads any incoming MIDI
- * message and if it is a noteOn event (case 0x9), then
- * calls noteOn function. Intializes cur_note with note_index
- * of -1 to ensure that any valid note indices are only from
- * actual notes.
+ * Function: void midi_input_drop()
+ * Description: Forgets the chord being gathered and every
+ * repeat waiting in the retrigger queues. Called whenever
+ * MIDI mode isn't running (switches, fault), so nothing held
+ * from it is struck in another mode or late when it comes
+ * back. A queued EVENT_RETRIGGER finds its queue empty.
  ***********************************************************/
-Note read_midi(){
-  midiEventPacket_t rx = MidiUSB.read();
-  
-  Note cur_note = {-1, 0, 0};
+void midi_input_drop(){
+  for(int i = 0; i < 8; i++){
+    midi_chord.velocity[i] = 0;
+    note_retrigger[i].count = 0;
+  }
+  midi_chord.count = 0;
+}
+
+/***********************************************************
+ * Function: void noteOff(byte channel, byte pitch, byte velocity)
+ * Description: MIDI note-off (0x8, or 0x9 with velocity 0).
+ * How long the solenoid is held is set by the strike itself
+ * (get_solenoid_on_delay and its scheduled note-off), the
+ * key release only ends the note on the controller, so a
+ * note-off never cuts a strike short. Only counted here.
+ ***********************************************************/
+void noteOff(byte channel, byte pitch, byte velocity){
+  (void)channel;
+  (void)pitch;
+  (void)velocity;
+  midi_stats.note_offs++;
+}
 
-  switch (rx.header) {
-    case 0:
+/***********************************************************
+ * Function: int read_midi()
+ * Description: Called from main. Drains every pending USB
+ * MIDI packet (up to MIDI_BATCH_SIZE, the rest wait for the
+ * next tick) into midi_batch, then handles the batch: note-on
+ * (0x9) calls noteOn, note-off (0x8) and note-on with
+ * velocity 0 call noteOff, everything else is ignored.
+ * Note-ons are held for MIDI_CHORD_WINDOW_US and then struck
+ * together (midi_chord_poll), so a chord goes out in one
+ * tpic_flush, one SPI transaction with at most one byte per
+ * chip. Returns the number of note events handled.
+ ***********************************************************/
+int read_midi(){
+  PERF_SCOPE(PERF_MIDI_STAGE);
+  int num_events = 0;
+
+  while(num_events < MIDI_BATCH_SIZE){
+    midiEventPacket_t rx = hal_midi_read();
+    if(rx.header == 0){
       break; //No pending events
-    case 0x9:
-      cur_note = noteOn(
-        rx.byte1 & 0xF,  //channel
-        rx.byte2,        //pitch
-        rx.byte3         //velocity
-      );
-      break;  
+    }
+    midi_stats.packets++;
+
+    uint8_t type = rx.header & 0xF; //code index number, same as the status nibble for note messages
+    if(type == 0x9 || type == 0x8){
+      MidiEvent& ev = midi_batch[num_events++];
+      ev.pitch = rx.byte2;
+      ev.velocity = rx.byte3;
+      ev.on = (type == 0x9 && rx.byte3 != 0); //running status senders use velocity 0 for note-off
+    }else{
+      midi_stats.ignored++;
+    }
   }
-  return cur_note;
+  if(num_events == MIDI_BATCH_SIZE){
+    midi_stats.batches_full++;
+  }
+  midi_stats.queued += num_events;
+
+  for(int i = 0; i < num_events; i++){
+    if(midi_batch[i].on){
+      noteOn(0, midi_batch[i].pitch, midi_batch[i].velocity);
+    }else{
+      noteOff(0, midi_batch[i].pitch, midi_batch[i].velocity);
+    }
+  }
+  midi_chord_poll();
+  return num_events;
 }
 
 /*********************************
  * SENSOR FUNCTIONS START HERE
  *********************************/
+/***********************************************************
+ * Function: void read_sensor_vals()
+ * Description: Advances the background sensor scan by at
+ * most one channel, never blocks on all 8. When a new frame
+ * is complete it is run through the conditioning (smoothed
+ * levels, rate of change) and the hysteresis bands.
+ ***********************************************************/
 void read_sensor_vals(){
-  for(int i=0; i<8; i++){
-     sensor_values[i] = ad7830.readADCsingle(i); //reading channel i
-     
-     Serial.print("Sensor value CH");
-     Serial.print(i);
-     Serial.print(": ");
-     Serial.println(sensor_values[i]);
-    
-  }
-
-  uint8_t sampling_period = 100; // how long between sensor value samples (ms)
-  
-  //static uint8_t sensor_rate_of_change[8] = {0}; // updates every 
-
-
-  //get past sensor values for rate of change estimate
-  if(past_time < millis() - sampling_period){
-    
-    past_time = millis();
-    //Serial.println();
-    //Serial.print("Change in sensor vals: ");
-  
-    for(int i=0; i<8; i++){
-      sensor_rate_of_change[i] = sensor_values[i] - past_sensor_values[i]; //update rate of change
-      past_sensor_values[i] = sensor_values[i]; // now update past with current
-      
-      //Serial.print(sensor_rate_of_change[i]);
-      //Serial.print(" ");
-    }
-    //Serial.println();
-    
-    // after rate of change is updated, now update the past sensor values
-    //std::copy(sensor_values, sensor_values+8, past_sensor_values); //copies past sensor values to 
+  PERF_SCOPE(PERF_SENSOR_STAGE);
+  if(!sensor_scan_step()){
+    return; //frame not finished, sensor_values still has the last complete one
   }
+  sensor_cond_update(sensor_frame());
+  sensor_band_update(sensor_trigger_band, sensor_values);
+  sensor_band_update(sensor_presence_band, sensor_values);
+  LOG_DEBUG("Sensor frame (seq/CH0)", sensor_frame().seq, sensor_values[0]);
 }
 
 void check_sensors(){
-  int threshold = 40;
-  Note cur_note = {-1, 0, 1};
   for(int i=0; i<8; i++){
-    if(sensor_values[i] >= threshold){
-      Note cur_note = {i, 0, 2};
+    if(sensor_in_band(sensor_trigger_band, i)){
+      Note cur_note = {i, 0, sensor_rate_velocity(i, 2)};
       if((millis() - sensor_note_timers[i] >= sensor_note_wait_timers[i]) && note_inactive_arr[i]){
-        note_inactive_arr[cur_note.note_index] = 0;
-        active_note_vel_arr[cur_note.note_index] = cur_note.velocity;
-        send_SPI_message_on(cur_note);
-        
-        Serial.print("SENSOR: note on at: ");
-        Serial.print(millis());
-        Serial.println(" ms.");
+        strike_note(cur_note);
+        LOG_DEBUG("SENSOR: note on (idx/ms)", i, millis());
       }
-      
-      Serial.print("Sensor note timer ");
-      Serial.print(i);
-      Serial.print(" :");
-      Serial.print(sensor_note_timers[i]);
-      Serial.println(" ms.");
-    }else if(sensor_values[i] < threshold){
 
+      LOG_DEBUG("Sensor note timer (idx/ms)", i, sensor_note_timers[i]);
     }
   }
 
 }
 
-void update_sensor_note_timers(int note_inactive_arr[]){
+/***********************************************************
+ * Function: void update_sensor_note_timers()
+ * Description: Updates how long each note waits after its
+ * release before the sensor can strike it again, shorter the
+ * closer the hand is. Note-offs come from the scheduler.
+ ***********************************************************/
+void update_sensor_note_timers(){
   for(int i=0; i<8; i++){
-    // Only updates timers for notes that are off
-    // Notes that are on retain timer value from when they were turned on
-    if(note_inactive_arr[i]){ 
-      note_timers[i] = millis();
-
-      /*
-      Serial.print("Sensor note wait timer ");
-      Serial.print(i);
-      Serial.print(" :");
-      Serial.println(sensor_note_wait_timers[i]);
-      */
-    }else{
-      //FOR DEBUG!
-      //Serial.print("Note is still on: ");
-      //Serial.println(i);
-      sensor_note_timers[i] = millis();
-
-       /*
-      Serial.print("Sensor note wait timer ");
-      Serial.print(i);
-      Serial.print(": ");
-      Serial.println(sensor_note_wait_timers[i]);
-      */
-    }
-
     //sensor_note_wait_timers[i] = abs((int)(4*(250 - sensor_values[i])));
-    sensor_note_wait_timers[i] = (int)(34081.0 / sensor_values[i]) - 90;
-  }
-}
-
-
-void check_sensor_note_timers(int note_inactive_arr[]){
-  for(int i=0; i<8; i++){
-    if(millis() - note_timers[i] >= get_solenoid_on_delay(active_note_vel_arr[i])){ 
-      Serial.print("Time exceeded solenoid on time: ");
-      Serial.print(millis() - note_timers[i]);
-      Serial.println(" ms.");
-
-      Note cur_note = {i, 0, 3};
-      Serial.println("Note is now off!");
-      note_inactive_arr[i] = 1; //note is now off again
-      active_note_vel_arr[i] = 0; //reset corresponding velocity to zero now that note is off
-      send_SPI_message_off(cur_note); //now actually turn it off
-      sensor_note_timers[i] = millis(); //reset the sensor note timer
-    }
+    sensor_note_wait_timers[i] = sensor_wait_curve.ms[sensor_values[i]];
   }
 }
 
@@ -639,190 +1277,250 @@ void modify_prob_matrix(int energy_level){
  * AUTONOMOUS FUNCTIONS START HERE
  *********************************/
 
-int getStartNoteIndex(Prandom R){
-  float randomProb = (R.uniform(0.0, 100.0) / 100.0);
-  float cumulativeProb = 0.0;
-    for (int i = 0; i < 8; i++) {
-        cumulativeProb += start_note_prob_array[i];
-        if (randomProb <= cumulativeProb + 1e-5) {
-            return i;
-        }
-    }
-    return -1;
+/***********************************************************
+ * Function: int sample_note_cdf(const NoteCdf& table, Rng& R)
+ * Description: Draws a note index from a quantized CDF row.
+ * The index is how many entries a 15-bit random number is at
+ * or above, counted the same way for every draw (no early
+ * exit, no floats).
+ ***********************************************************/
+int sample_note_cdf(const NoteCdf& table, Rng& R){
+  uint16_t r = static_cast<uint16_t>(rng_next(R) >> (32 - CDF_BITS));
+  int idx = 0;
+  for(int i = 0; i < 7; i++){
+    idx += (r >= table.cdf[i]);
+  }
+  return idx;
 }
 
-int getNextNoteIndex(int currentRow, int energy_level, Prandom R) {
-    // Ensure randomization based on current time
+int getStartNoteIndex(Rng& R){
+  return sample_note_cdf(start_note_cdf, R);
+}
 
-    float randomProb = (R.uniform(0.0, 100.0) / 100.0);
-    //Serial.println(randomProb);
+/***********************************************************
+ * Function: int sample_ngram_row(const uint8_t* row, Rng& R)
+ * Description: Draws a note index from an 8-bit n-gram row,
+ * the same fixed 7 compares as sample_note_cdf.
+ ***********************************************************/
+int sample_ngram_row(const uint8_t* row, Rng& R){
+  uint8_t r = static_cast<uint8_t>(((rng_next(R) >> 24) * NGRAM_CDF_ONE) >> 8); // 0 to NGRAM_CDF_ONE - 1
+  int idx = 0;
+  for(int i = 0; i < 7; i++){
+    idx += (r >= row[i]);
+  }
+  return idx;
+}
 
-    // Accumulate probabilities and find the index
-    float cumulativeProb = 0.0;
-    for (int i = 0; i < 8; i++) {
-        
-        if(energy_level <=1){
-          cumulativeProb += next_note_prob_matrix_2[currentRow][i];
-        }else if(energy_level == 2){
-          cumulativeProb += next_note_prob_matrix_2[currentRow][i];
-        }else if(energy_level >= 3){
-          cumulativeProb += next_note_prob_matrix_2[currentRow][i];
-        }
-        
-        if (randomProb <= cumulativeProb + 1e-5) {
-          return i;
-        }
-    }
-    // This should not happen, but return -1 if it does
-    return -1;
+/***********************************************************
+ * Function: int getNextNoteIndex(const NoteHistory& history, int energy_level, Rng& R)
+ * Description: Draws the note to follow history from the
+ * energy level's trained n-gram row, or from its hand-typed
+ * matrix row for the last note if the history has no row
+ * (its last note was never followed by another at that level
+ * in training; any other unseen history has a backed-off
+ * row). Trained on the lick banks every history has a row,
+ * host/ngram_fallback_test covers the fallback. One index
+ * load and one row draw either way, whatever the model order. The caller pushes the note it
+ * ends up playing onto history.
+ ***********************************************************/
+int getNextNoteIndex(const NoteHistory& history, int energy_level, Rng& R) {
+  int level = energy_level <= 1 ? 0 : (energy_level == 2 ? 1 : 2);
+  ngram_row_t row = ngram_context_row[level][history.ctx];
+  if(row != NGRAM_NO_ROW){
+    return sample_ngram_row(ngram_rows[row], R);
+  }
+  return sample_note_cdf(next_note_cdf[level][history.ctx & 7], R);
 }
 
 
-int check_note_leap(Note* song, int time_sig, int i, int j, Prandom R){
+// longest phrase the generator will build, 8/4 time
+#define PHRASE_MAX_SLOTS 32
 
-  if (j < 1 || j >= (4 * time_sig)) {
-      return j; // Check for boundary condition to prevent out-of-bounds access
-  }
+typedef StaticVector<Note, PHRASE_MAX_SLOTS> Phrase;
 
-  if(abs(song[(i*time_sig*4)+j].note_index - song[(i*time_sig*4)+j - 1].note_index) >= 4){
-    //do cool resolution
-    while(song[(i * time_sig * 4) + j].note_index != 0 && j<(4*time_sig)){
-      j++;
-      song[(i*time_sig*4)+j].duration = round(R.uniform(0.5, 2.5));
-      song[(i*time_sig*4)+j].note_index = song[(i*time_sig*4)+j-1].note_index - 1; 
-      song[(i*time_sig*4)+j].velocity = round(R.uniform(0.5, 3.5));
-    }
-  }
+// Generator filling one phrase buffer a note at a time from idle time between onsets
+struct PhraseGen {
+  Phrase* phrase;       // buffer being filled, NULL when there is nothing to generate
+  Rng* rng;
+  uint8_t slots;        // notes in a phrase, time_sig * 4 capped at PHRASE_MAX_SLOTS
+  int8_t energy_level;
+  NoteHistory history;  // notes of the phrase so far, for getNextNoteIndex()
+  bool resolving;       // stepping down to the tonic after a big leap
+  bool failed;          // getNextNoteIndex() gave no note, phrase ends early
+};
 
-  return j;
-}
+// generator cost, kept apart from playback so it can be looked at on its own
+struct PhraseGenStats {
+  uint32_t steps;
+  uint32_t phrases;
+  uint32_t max_step_us;
+  uint32_t total_step_us;
+  uint32_t late_phrases; // the player needed a phrase that wasn't finished and had to wait for it
+};
 
-Note* autonomous_seq_generation(Note* song, int energy_level, int song_length, int time_sig, Prandom R, int bpm){
-  int rand_note_index = 0;
-  int cur_note_on_time = millis();
-  int cur_note_off_time = 999999999;
-  int note_still_on = 0;
-  bool repeat_note = 0;
-  int rep_note_on_time = 999999999;
-  int rep_note_off_time = 999999999;
-  int sensor_delay = 0;
+static PhraseGen phrase_gen = {NULL, NULL, 0, 0, {0}, false, false};
+static PhraseGenStats phrase_gen_stats = {0, 0, 0, 0, 0};
 
-  Serial.println(song_length / (time_sig*4));
+/***********************************************************
+ * Function: void phrase_gen_begin(Phrase& phrase, int time_sig, int energy_level, Rng& R)
+ * Description: Clears phrase and points the generator at it.
+ ***********************************************************/
+void phrase_gen_begin(Phrase& phrase, int time_sig, int energy_level, Rng& R){
+  phrase.clear();
+  int slots = time_sig * 4;
+  phrase_gen.phrase = &phrase;
+  phrase_gen.rng = &R;
+  phrase_gen.slots = static_cast<uint8_t>(slots < 1 ? 1 : (slots > PHRASE_MAX_SLOTS ? PHRASE_MAX_SLOTS : slots));
+  phrase_gen.energy_level = static_cast<int8_t>(energy_level);
+  phrase_gen.resolving = false;
+  phrase_gen.failed = false;
+}
 
-  for (int i=0; i<(song_length / (time_sig*4)); i++){
-    
-    Serial.println("New Phrase");
-    song[i*4*time_sig].note_index = getStartNoteIndex(R); //input starting note
-    song[i*4*time_sig].duration = 4;
-    //song[i*4*time_sig].velocity = round(R.uniform(0.5, 3.5));
-    song[i*4*time_sig].velocity = 2;
-
-    Serial.println(song[i*4*time_sig].note_index);
-
-    for (int j=1; j<(4*time_sig); j++){
-      
-      //read sensor data here if sensor mode on
-      read_sensor_vals();
-      //modify prob matrices with value
-      //modify_prob_matrix(energy_level);
-
-
-      rand_note_index = getNextNoteIndex(song[(i*time_sig*4)+j-1].note_index, energy_level, R);
-      
-      if(rand_note_index == -1){
-        Serial.println("UNEXPECTED NOTE!"); //do nothing if this happens, or THROW ERROR
-        break;
+/***********************************************************
+ * Function: bool phrase_gen_step()
+ * Description: Adds one note to the phrase being generated.
+ * The first note comes from the start distribution, the rest
+ * from the energy level's n-gram model; a leap of 4 or
+ * more is resolved by stepping down towards note 0, in the
+ * same phrase's remaining slots only. Returns false once the
+ * phrase is finished (or there is none).
+ ***********************************************************/
+bool phrase_gen_step(){
+  Phrase* phrase = phrase_gen.phrase;
+  if(phrase == NULL){
+    return false;
+  }
+  uint32_t start_us = micros();
+  Rng& R = *phrase_gen.rng;
+  Note note;
+
+  if(phrase->empty()){
+    note.note_index = getStartNoteIndex(R); //input starting note
+    note.duration_ticks = 4 * TICKS_PER_SIXTEENTH;
+    note.velocity = 2;
+    LOG_DEBUG("Phrase start note", note.note_index);
+  }else{
+    int prev_index = (*phrase)[phrase->size() - 1].note_index;
+    if(phrase_gen.resolving){
+      //do cool resolution
+      note.note_index = prev_index - 1;
+      note.velocity = rng_range(R, 1, 3);
+    }else{
+      int next_index = getNextNoteIndex(phrase_gen.history, phrase_gen.energy_level, R);
+      if(next_index == -1){
+        LOG_ERROR("UNEXPECTED NOTE!");
+        phrase_gen.failed = true;
       }
-      
-      song[(i*time_sig*4)+j].note_index = rand_note_index;
-      song[(i*time_sig*4)+j].duration = round(R.uniform(0.5, 2.5));
-      //song[(i*time_sig*4)+j].velocity = round(R.uniform(0.5, 3.5));
-      song[(i*time_sig*4)+j].velocity = 2;
-  
-      j = check_note_leap(song, time_sig, i, j, R);
+      note.note_index = next_index;
+      //note.velocity = rng_range(R, 1, 3);
+      note.velocity = 2;
+      phrase_gen.resolving = abs(next_index - prev_index) >= 4;
+    }
+    note.duration_ticks = TICKS_PER_SIXTEENTH * rng_range(R, 1, 2);
+    if(note.note_index == 0){
+      phrase_gen.resolving = false;
+    }
+  }
 
-      //NOW PLAY NOTE that was just generated!
+  if(!phrase_gen.failed){
+    if(phrase->empty()){
+      note_history_start(phrase_gen.history, note.note_index);
+    }else{
+      note_history_push(phrase_gen.history, note.note_index);
+    }
+    phrase->push_back(note);
+  }
+  if(phrase_gen.failed || phrase->size() >= phrase_gen.slots){
+    phrase_gen.phrase = NULL; //finished, the player can take it
+    phrase_gen_stats.phrases++;
+  }
 
-      //FOR TESTING WITH SOLENOIDS (COMMENT THE OTHER OUT)
-      send_SPI_message_on(song[(i*time_sig*4)+j]); //send SPI message for note on
-      cur_note_on_time = millis(); //time (ms) when the note was turned on
-      note_still_on = 1;
+  uint32_t step_us = micros() - start_us;
+  phrase_gen_stats.steps++;
+  phrase_gen_stats.total_step_us += step_us;
+  if(step_us > phrase_gen_stats.max_step_us){
+    phrase_gen_stats.max_step_us = step_us;
+  }
+  return phrase_gen.phrase != NULL;
+}
 
-      Serial.print("Auto note on at (ms): ");
-      Serial.println(cur_note_on_time);
+/***********************************************************
+ * Function: void autonomous_idle_work()
+ * Description: Idle work while a sequence plays: the sensor
+ * scan and one generator step, both only run by the scheduler
+ * when the next deadline is far enough away.
+ ***********************************************************/
+void autonomous_idle_work(){
+  read_sensor_vals();
+  phrase_gen_step();
+}
 
-      //tone(BUZZ_PIN, pitchFrequency[available_notes[song[i].note_index]]); //for speaker testing
-      //while loop continues to update note timer until FULL note duration is complete
-      while(millis() - cur_note_on_time < 1000 / (4.0 * bpm / song[(i*time_sig*4)+j].duration / 60)){
-
-        //read_sensor_vals();
-        /*
-        if(sensor_values[song[(i*time_sig*4)+j].note_index] > 254 && (millis() - cur_note_off_time) > sensor_delay){
-          repeat_note = 1;
-          sensor_delay = 400 - sensor_values[song[(i*time_sig*4)+j].note_index];
-        }else{
-          repeat_note = 0;
-          sensor_delay = 0;
-        }
-        */
-        
-        //for initial note
-        if(millis() - cur_note_on_time >= get_solenoid_on_delay(song[(i*time_sig*4)+j].velocity) && note_still_on && !repeat_note){
-          send_SPI_message_off(song[(i*time_sig*4)+j]);
-          cur_note_off_time = millis();
-          Serial.print("Auto note off at (ms): ");
-          Serial.println(cur_note_off_time);
-          Serial.println();
-          note_still_on = 0;
-        }
-        //for repeated notes
-        /*
-        }else if(millis() - rep_note_on_time >= get_solenoid_on_delay(song[(i*time_sig*4)+j].velocity) && note_still_on && repeat_note){
-          send_SPI_message_off(song[(i*time_sig*4)+j]);
-          Serial.print("Repeated note off at (ms): ");
-          Serial.println(millis());
-          Serial.println();
-          note_still_on = 0;
-          rep_note_off_time = millis();
-        }
-        */
-
-        //turn on repeated note
-        /*
-        if(note_still_on == 0 && repeat_note){ //actuate note a second time???
-          delay(sensor_delay);
-          send_SPI_message_on(song[(i*time_sig*4)+j]); //send SPI message for note on
-          cur_note_on_time = millis(); //time (ms) when the note was turned on
-          note_still_on = 1; //turn note_still_on back on
-          Serial.print("Repeated note on at (ms): ");
-          Serial.println(cur_note_on_time);
-        }
-        */
+/***********************************************************
+ * Function: Note* autonomous_seq_generation(Note* song, int energy_level, int song_length, int time_sig, Rng& R, int bpm)
+ * Description: Generates and plays song_length / (time_sig*4)
+ * phrases. Two phrase buffers: the player strikes the notes of
+ * a finished one on the transport while the generator fills
+ * the other from idle time between onsets, so generation
+ * never sits between a deadline and its note. The notes played
+ * are copied into song (up to song_length of them).
+ ***********************************************************/
+Note* autonomous_seq_generation(Note* song, int energy_level, int song_length, int time_sig, Rng& R, int bpm){
+  static Phrase phrases[2];
+  int num_phrases = song_length / (time_sig*4);
+  int song_pos = 0;
+  int last_index = 0;
+  Transport transport;
+
+  LOG_INFO("Phrases in song", num_phrases);
+
+  //first phrase is generated up front, nothing is playing yet
+  phrase_gen_begin(phrases[0], time_sig, energy_level, R);
+  while(phrase_gen_step()){}
+
+  //read sensor data and generate between notes, when it can't delay one
+  scheduler_idle_work = autonomous_idle_work;
+  transport_start(transport, bpm);
+
+  for(int i = 0; i < num_phrases; i++){
+    Phrase& playing = phrases[i % 2];
+    if(phrase_gen.phrase != NULL){
+      phrase_gen_stats.late_phrases++; //idle time ran out, finish it now
+      while(phrase_gen_step()){}
+    }
+    bool phrase_failed = phrase_gen.failed;
+    if(i + 1 < num_phrases && !phrase_failed){
+      phrase_gen_begin(phrases[(i + 1) % 2], time_sig, energy_level, R); //filled while this one plays
+    }
 
+    LOG_INFO("New Phrase");
+    for(int j = 0; j < playing.size(); j++){
+      //tone(BUZZ_PIN, pitchFrequency[available_notes[song[i].note_index]]); //for speaker testing
+      transport_strike(transport, playing[j]);
+      last_index = playing[j].note_index;
+      if(song_pos < song_length){
+        song[song_pos++] = playing[j];
       }
+    }
 
-    };
-
-    if(rand_note_index == -1)
+    if(phrase_failed)
       break;
-
-  };
+  }
+  phrase_gen.phrase = NULL;
 
   //play ending note
 
-  if(song[song_length-1].note_index != 0){
+  if(last_index != 0){
     Note final_note = {0, 4, 2};
-    send_SPI_message_on(final_note); //send SPI message
-    delay(SOLENOID_ON_TIME); //wait
-    send_SPI_message_off(final_note); //turn solenoids off
-    Serial.println();
-
     //tone(BUZZ_PIN, pitchFrequency[available_notes[final_note.note_index]]);
-    
-    delay(1000 / (4.0 * bpm / final_note.duration / 60));
+    transport_strike(transport, final_note); //scheduler turns the solenoids off
     //noTone(BUZZ_PIN);
   }
+  scheduler_wait_until(transport_due_us(transport)); //let the last note ring out its duration
 
+  LOG_INFO("Phrase generator (steps/max us)", phrase_gen_stats.steps, phrase_gen_stats.max_step_us);
+  LOG_INFO("Phrases finished late", phrase_gen_stats.late_phrases);
+
+  scheduler_idle_work = NULL;
   return song;
 }
 
@@ -836,7 +1534,7 @@ Note* autonomous_seq_generation(Note* song, int energy_level, int song_length, i
  * NEEDS TESTING
 */
 
-#define MAX_NOTES 16
+#define MAX_NOTES 24 //longest chime is 23 notes, licks grow by added notes up to this
 
 // Define the Lick struct with a statically sized array of Notes
 /*
@@ -857,12 +1555,29 @@ struct Lick {
     int energy_level;
     int num_notes;        // Number of Notes in this lick
     int orig_num_notes;
-    //struct Note data[MAX_NOTES];  // Predefined array of notes (up to MAX_NOTES)
-    std::vector<Note> data;
+    StaticVector<Note, MAX_NOTES> data; // inline, copying a lick never allocates
 };
 
+static_assert(std::is_trivially_copyable<Lick>::value, "licks are copied with plain memberwise copies");
+
 const int BoL_len = 19;
 
+// Index of Bank_of_licks by (energy_level, time signature), built once by build_lick_index().
+// Each bucket is a run of lick_index, bucket b is lick_index[lick_bucket_start[b]] up to
+// lick_index[lick_bucket_start[b + 1]].
+#define LICK_MAX_ENERGY 4
+#define LICK_MAX_TS_NUM 12
+#define LICK_NUM_DENOMS 4 // 2, 4, 8, 16
+#define LICK_NUM_BUCKETS ((LICK_MAX_ENERGY + 1) * LICK_MAX_TS_NUM * LICK_NUM_DENOMS)
+
+struct LickSpan {
+  struct Lick** licks;
+  int count;
+};
+
+static struct Lick* lick_index[BoL_len];
+static uint16_t lick_bucket_start[LICK_NUM_BUCKETS + 1] = {0};
+
 // Integer conversion here: 60=C4, 61=C#4/Db4, 62=D, 63=D#/Eb, 64=E, 65=F, 66=F#/Gb, 67=G, 68=G#/Ab, 69=A, 70=A#/Bb, 71=B
 //const int available_notes[8] = {60, 69, 67, 75, 63, 74, 62, 72};
 // C4, A4, G4, Eb5, Eb4, D5, 
@@ -871,7 +1586,7 @@ const int BoL_len = 19;
 // Input: index in order of pitch 0 is lowest note on drum, 7 is highest
 // Output: index that correctly maps to hardware and SPI functions
 int get_unscrambled_idx(int idx){
-  std::vector<int> mapping = {0, 6, 4, 2, 1, 7, 5, 3};
+  static const int mapping[8] = {0, 6, 4, 2, 1, 7, 5, 3};
   return mapping[idx];
 }
 
@@ -921,21 +1636,51 @@ static struct Lick Bank_of_licks[BoL_len] = {
 };
 
 
+// Initial state of the bank, copied once by save_lick_bank() so licks can be reset after
+// notes have been added/removed
+static struct Lick Bank_of_licks_orig[BoL_len];
+
+void save_lick_bank(){
+  for(int i = 0; i < BoL_len; i++){
+    Bank_of_licks_orig[i] = Bank_of_licks[i];
+  }
+}
+
+/***********************************************************
+ * Function: void lick_bank_check_durations(const Lick* bank, int len)
+ * Description: Logs every note written longer than a Note can
+ * hold, sixteenths_to_ticks() saturated it at 255 ticks. A
+ * bank is checked once at power up.
+ ***********************************************************/
+void lick_bank_check_durations(const Lick* bank, int len){
+  for(int i = 0; i < len; i++){
+    for(int n = 0; n < bank[i].data.size(); n++){
+      if(bank[i].data[n].duration_ticks == 255){
+        LOG_DEBUG("Note clamped to 255 ticks (lick/note)", i, n);
+      }
+    }
+  }
+}
+
 // TO DO: Incorporate logic for each lick to add/subtract additional notes or put it back to its default state
 // Function to add a note to the lick, determining parameters
 void add_note_to_lick(Lick &lick, int position) {
 
   //probabiity to add note to lick is
   float prob_to_add_note = (1.0 + lick.orig_num_notes) / (1.0 + 1.25 * lick.num_notes);
-  Serial.print("PROBABILITY TO ADD NOTE: ");
-  Serial.println(prob_to_add_note);
+  LOG_DEBUG("Probability to add note (%)", static_cast<int32_t>(prob_to_add_note * 100));
+
+  if(lick.data.full()){
+    LOG_DEBUG("Lick is full, no note added (notes)", lick.data.size());
+    return;
+  }
 
-  if (position >= 0 && position < lick.data.size() && R.uniform(0, 1) < prob_to_add_note) {
+  if (position >= 0 && position < lick.data.size() && rng_chance(R, prob_to_add_note)) {
     // Determine new note based on current note
     Note new_note;
     
     // don't add note if target is less than a sixteenth
-    if(lick.data[position].duration < 1){
+    if(lick.data[position].duration_ticks < TICKS_PER_SIXTEENTH){
       return;
     }
 
@@ -950,33 +1695,39 @@ void add_note_to_lick(Lick &lick, int position) {
     int max_interval = 1; // set max distance between grace notes
 
     if(cur_index == 0){
-      new_note.note_index = static_cast<int>(round(R.uniform(cur_index, cur_index + max_interval + 0.499)));
+      new_note.note_index = rng_range(R, cur_index, cur_index + max_interval);
     }else if (cur_index == 7){
-      new_note.note_index = static_cast<int>(round(R.uniform(cur_index - max_interval - 0.5, cur_index)));
+      new_note.note_index = rng_range(R, cur_index - max_interval, cur_index);
     }else{
-      new_note.note_index = static_cast<int>(round(R.uniform(cur_index - max_interval - 0.5, cur_index + max_interval + 0.499)));
+      new_note.note_index = rng_range(R, cur_index - max_interval, cur_index + max_interval);
     }
 
     bool after;
-    after = (R.uniform(0, 1) > 0.5);
+    after = rng_chance(R, 1, 2);
     
     // only want to insert after if position is zero and NOT when its the last note, randomly chosen otherwise
     if((after || position == 0) && position != (lick.data.size() - 1)){
-      // gets half the duration of the note before it
-      new_note.duration = max(0.01, lick.data[position].duration / 2);
+      // gets half the duration of the note before it, the two still add up to the original
+      new_note.duration_ticks = lick.data[position].duration_ticks / 2;
 
-      lick.data[position].duration = lick.data[position].duration / 2;
-      lick.data.insert(lick.data.begin() + position + 1, new_note);
-      lick.num_notes++;
+      if(lick.data.insert(position + 1, new_note)){
+        lick.data[position].duration_ticks -= new_note.duration_ticks;
+        lick.num_notes++;
+      }
 
     // otherwise before is fine
     } else if (position > 0 && position < lick.data.size()){ 
-      // gets half the duration of the note before it
-      new_note.duration = max(0.01, lick.data[position - 1].duration / 2);
+      // a note under 2 ticks can't be split without leaving one of 0
+      if(lick.data[position - 1].duration_ticks < 2){
+        return;
+      }
+      // gets half the duration of the note before it, the two still add up to the original
+      new_note.duration_ticks = lick.data[position - 1].duration_ticks / 2;
 
-      lick.data[position - 1].duration = lick.data[position - 1].duration / 2; // always want to adjust the preceding note's duration
-      lick.data.insert(lick.data.begin() + position, new_note);
-      lick.num_notes++;
+      if(lick.data.insert(position, new_note)){
+        lick.data[position - 1].duration_ticks -= new_note.duration_ticks; // always want to adjust the preceding note's duration
+        lick.num_notes++;
+      }
 
     } 
   }
@@ -986,27 +1737,28 @@ void subtract_note_from_lick(Lick &lick) {
   // Collect indices of all added notes
   float prob_to_remove_note = 1 - ((1.0 + lick.orig_num_notes) / (1.0 + 1.25 * lick.num_notes));
 
-  if(R.uniform(0, 1) < prob_to_remove_note){
+  if(rng_chance(R, prob_to_remove_note)){
     
-    std::vector<int> added_note_indices;
+    int added_note_indices[MAX_NOTES];
+    int num_added = 0;
     
     for (int i = 0; i < lick.data.size(); i++) {
       if (lick.data[i].probability != 100) {
-        added_note_indices.push_back(i);
+        added_note_indices[num_added++] = i;
       }
     }
 
     // If there are no added notes, exit the function
-    if (added_note_indices.empty()) return;
+    if (num_added == 0) return;
 
     // Randomly select one of the added notes to remove
-    int random_index = added_note_indices[static_cast<int>(R.uniform(0, added_note_indices.size()-1))];
+    int random_index = added_note_indices[rng_below(R, num_added)];
     
     // Adjust duration of surrounding notes
-    if (random_index >= 0) {
-      // If there is a preceding note, restore its duration
-      lick.data[random_index - 1].duration *= 2;
-      lick.data.erase(lick.data.begin() + random_index);
+    if (random_index > 0) {
+      // If there is a preceding note, give it back the removed note's ticks
+      lick.data[random_index - 1].duration_ticks += lick.data[random_index].duration_ticks;
+      lick.data.erase(random_index);
       lick.num_notes--;
     }
     //else if (random_index < lick.data.size() - 1) {
@@ -1029,9 +1781,9 @@ void print_lick(struct Lick* lick) {
     printf("Notes:\n");
 
     for (int i = 0; i < lick->num_notes; i++) {
-        printf("  Note %d: Index = %d, Duration = %.1f, Velocity = %d\n",
+        printf("  Note %d: Index = %d, Duration = %d ticks, Velocity = %d\n",
                i + 1, lick->data[i].note_index,
-               lick->data[i].duration,
+               lick->data[i].duration_ticks,
                lick->data[i].velocity);
     }
 }
@@ -1049,66 +1801,102 @@ void filter_licks_by_energy_level(struct Lick* bank, int size, int target_energy
 }
 
 
-struct Lick** pick_licks_by_criteria(struct Lick* bank, int size, int target_energy_level, int target_time_sig_num, int target_time_sig_denom, int* result_count) {
-    // Dynamically allocate memory for an array of Lick pointers (a list)
-    struct Lick** result = (struct Lick**)malloc(size * sizeof(struct Lick*)); // Max possible matches
-    *result_count = 0;  // Initialize result count
+/***********************************************************
+ * Function: int lick_bucket(int energy_level, int time_sig_num,
+ *                           int time_sig_denom)
+ * Description: Bucket number of a lick criteria in the lick
+ * index, -1 if it is outside what the index covers (energy
+ * 0-LICK_MAX_ENERGY, numerator 1-LICK_MAX_TS_NUM, denominator
+ * 2, 4, 8 or 16).
+ ***********************************************************/
+int lick_bucket(int energy_level, int time_sig_num, int time_sig_denom){
+  int denom_slot = time_sig_denom == 2 ? 0 : time_sig_denom == 4 ? 1 : time_sig_denom == 8 ? 2 :
+                   time_sig_denom == 16 ? 3 : -1;
+  if(energy_level < 0 || energy_level > LICK_MAX_ENERGY || time_sig_num < 1 || time_sig_num > LICK_MAX_TS_NUM ||
+     denom_slot < 0){
+    return -1;
+  }
+  return (energy_level * LICK_MAX_TS_NUM + (time_sig_num - 1)) * LICK_NUM_DENOMS + denom_slot;
+}
 
-    // Iterate over the bank of licks to find matching licks
-    for (int i = 0; i < size; i++) {
-        if (bank[i].energy_level == target_energy_level &&
-            bank[i].time_sig_num == target_time_sig_num &&
-            bank[i].time_sig_denom == target_time_sig_denom) {
-            
-            // Store the pointer to the matching lick in the result array
-            result[*result_count] = &bank[i];
-            (*result_count)++;  // Increment the result count
-        }
+/***********************************************************
+ * Function: void build_lick_index(struct Lick* bank, int size)
+ * Description: Called once from setup(). Sorts pointers to
+ * every lick in the bank into lick_index grouped by bucket
+ * (counting sort, bank order kept within a bucket), so
+ * pick_licks_by_criteria is two table loads. Licks whose
+ * criteria the index doesn't cover are left out with a
+ * warning. Only the criteria are indexed, so adding or
+ * removing notes from a lick doesn't need a rebuild.
+ ***********************************************************/
+void build_lick_index(struct Lick* bank, int size){
+  for(int b = 0; b <= LICK_NUM_BUCKETS; b++){
+    lick_bucket_start[b] = 0;
+  }
+
+  //count each bucket into the slot after it, then a running sum gives each bucket's start
+  for(int i = 0; i < size; i++){
+    int b = lick_bucket(bank[i].energy_level, bank[i].time_sig_num, bank[i].time_sig_denom);
+    if(b < 0){
+      LOG_WARN("Lick not indexed, criteria out of range (lick/energy)", i, bank[i].energy_level);
+      continue;
     }
+    lick_bucket_start[b + 1]++;
+  }
+  for(int b = 0; b < LICK_NUM_BUCKETS; b++){
+    lick_bucket_start[b + 1] += lick_bucket_start[b];
+  }
 
-    // If no matches, return NULL
-    if (*result_count == 0) {
-        free(result);  // Free allocated memory if no matches
-        return NULL;
+  uint16_t fill[LICK_NUM_BUCKETS];
+  for(int b = 0; b < LICK_NUM_BUCKETS; b++){
+    fill[b] = lick_bucket_start[b];
+  }
+  for(int i = 0; i < size; i++){
+    int b = lick_bucket(bank[i].energy_level, bank[i].time_sig_num, bank[i].time_sig_denom);
+    if(b >= 0){
+      lick_index[fill[b]++] = &bank[i];
     }
+  }
+}
 
-    return result;  // Return the list of matching licks
+/***********************************************************
+ * Function: LickSpan pick_licks_by_criteria(int target_energy_level,
+ *                     int target_time_sig_num, int target_time_sig_denom)
+ * Description: All licks in the bank with the given energy
+ * level and time signature, as a span into lick_index (no
+ * copy, nothing to free). count is 0 if there are none.
+ ***********************************************************/
+LickSpan pick_licks_by_criteria(int target_energy_level, int target_time_sig_num, int target_time_sig_denom){
+  LickSpan result = {lick_index, 0};
+  int b = lick_bucket(target_energy_level, target_time_sig_num, target_time_sig_denom);
+  if(b >= 0){
+    result.licks = lick_index + lick_bucket_start[b];
+    result.count = lick_bucket_start[b + 1] - lick_bucket_start[b];
+  }
+  return result;
 }
 
 
 int update_bpm(int bpm){
-  //get hour from RTC and convert to int
-  int hour = static_cast<int>(myRTC.getHour(h12Flag, pmFlag)); //0, 0 for 24 hour mode
-  //Serial.print(hour);
-
-  if(hour < 10){
-    bpm = static_cast<int>(0.8*bpm);
-  }else if(hour < 14){
-    bpm = static_cast<int>(1.1*bpm); //change nothing
-  }else if(hour < 22){
-    bpm = static_cast<int>(1.2*bpm);
-  }
-  //Serial.println(bpm);
-  return bpm;
+  //scaled by the schedule band for the time of day, no RTC read
+  return bpm * schedule_now.band.bpm_percent / 100;
 }
 
 int get_next_note_idx_from_sensors(){
   int num_selected_notes = 0;
 
   for(int i=0; i<8; i++){
-    if(sensor_values[i] > lick_mode_sensor_threshold){
+    if(sensor_in_band(sensor_presence_band, i)){
       next_note_selection_array[i] = 1; //now this note is available to be played;
       num_selected_notes++;
     }else{
       next_note_selection_array[i] = 0; //need to set back to zero if sensor value is below threshold
     }
-    Serial.println(next_note_selection_array[i]);
   }
 
-  int temp = static_cast<int>round(R.uniform(0.5, num_selected_notes+0.499));
+  int temp = rng_range(R, 1, num_selected_notes);
   int count = 0;
-  Serial.print("temp value for sensor note selection: ");
-  Serial.println(temp);
+  LOG_DEBUG("Sensor note selection (pick/of)", temp, num_selected_notes);
   for(int i=0; i<8; i++){
     if(next_note_selection_array[i]){ // this shouldn't be met if no notes are selected
       count++; // increment count if note is selected 
@@ -1122,96 +1910,60 @@ int get_next_note_idx_from_sensors(){
 }
 
 int get_velocity_from_sensors(int note_idx){
-  int val = sensor_values[note_idx];
-  if(val > lick_mode_sensor_threshold){
-    if(val < 140){
-      return 1;
-    }else if(val < 200){
-      return 2;
-    }else if(val <= 255){
-      return 3;   
-    }
+  if(sensor_in_band(sensor_presence_band, note_idx)){
+    return sensor_rate_velocity(note_idx, sensor_velocity_curve.velocity[sensor_values[note_idx]]);
   }
   return 2;
 }
 
 // Time-based responses for drum
 int get_lick_wait_period(int bpm, int time_sig_num, int time_sig_denom){
-  int hour = static_cast<int>(myRTC.getHour(h12Flag, pmFlag));
-  int num_measures = 0;
-  Serial.print("Hour: ");
-  Serial.println(hour);
-  if(hour < 10){
-    num_measures = 16;
-  }else if(hour < 14){
-    num_measures = 8; //change nothing
-  }else if(hour < 18){
-    num_measures = 4;
-  }else{
-    num_measures = 16;
-  }
+  int num_measures = schedule_now.band.wait_measures;
 
   int max_sensor_val = 0;
   for(int i=0; i<8; i++){
     // want to read max sensor_val and have it be 
-    if(sensor_values[i] > max_sensor_val && sensor_values[i] > lick_mode_sensor_threshold){
+    if(sensor_values[i] > max_sensor_val && sensor_in_band(sensor_presence_band, i)){
       max_sensor_val = sensor_values[i];
     }
   }
 
-  float sensor_mult = (255 - max_sensor_val) / 255.0; // want this to reduce 
-  num_measures = static_cast<int>(sensor_mult * num_measures);
-
-  int num_sixteenths = num_measures * (time_sig_num*(4.0/time_sig_denom)*4);
-  if(num_sixteenths == 0){
-    return 0;
-  }
+  num_measures = num_measures * (255 - max_sensor_val) / 255; // want this to reduce 
 
   //final 4 is for converting time sig into sixteenth note units
-  Serial.print("Number of measures to wait: ");
-  Serial.println(num_measures);
-  double denom = (4.0 * bpm / num_sixteenths / 60);
-  if(denom == 0){
+  int num_sixteenths = num_measures * time_sig_num * 4 * 4 / time_sig_denom;
+  if(num_sixteenths == 0 || bpm <= 0){
     return 0;
   }
-  Serial.print("Denominator (DEBUG): ");
-  Serial.println(denom);
-  int wait_period = static_cast<int>(1000 / denom);
+
+  LOG_DEBUG("Number of measures to wait", num_measures);
+  //a sixteenth is 60000 / (4 * bpm) ms
+  int wait_period = static_cast<int>(15000L * num_sixteenths / bpm);
   return wait_period;
 }
 
 int update_energy_level() {
-  int hour = static_cast<int>(myRTC.getHour(h12Flag, pmFlag));
-  Serial.println(hour);
-  if(hour < 10){
-    return 1;
-  }else if(hour < 14){
-    return 2;
-  }else if(hour < 18){
-    return 3;
-  }else{
-    return 1;
-  }
+  return schedule_now.band.energy_level;
 }
 
 int check_sensor_inactivity(int energy_level) {
+  (void)energy_level; //the schedule sets the level, see update_energy_level()
   
   for(int i=0; i<8; i++){
-    if(sensor_values[i] > lick_mode_sensor_threshold){
+    if(sensor_in_band(sensor_presence_band, i)){
       lick_mode_inactivity_timer = millis();
       tried_to_grab_attention = 0;
       return update_energy_level();
     }
   }
   
-  int inactivity_wait_time = 5000;
-  Serial.print("MS since last activity: ");
-  Serial.println(millis()-lick_mode_inactivity_timer);
+  uint32_t inactivity_wait_time = 5000;
+  LOG_DEBUG("MS since last activity", millis()-lick_mode_inactivity_timer);
 
   if(tried_to_grab_attention){
     return update_energy_level();
   //tried_to_grab_attention
-  }else if(lick_mode_inactivity_timer < (millis() - inactivity_wait_time) && !tried_to_grab_attention){
+  }else if(millis() - lick_mode_inactivity_timer > inactivity_wait_time && !tried_to_grab_attention){ //wrap safe
     tried_to_grab_attention = 1;
     return 4; // return special energy level
   }else{
@@ -1219,8 +1971,9 @@ int check_sensor_inactivity(int energy_level) {
   }
 }
 
+const int BoC_len = 5;
 
-static struct Lick Bank_of_chimes[5] = {
+static struct Lick Bank_of_chimes[BoC_len] = {
   {4, 4, 3, 1, 8, 8, {{7, 4, 2, 100}, {5, 4, 2, 100}, {6, 4, 2, 100}, {3, 8, 2, 100}, {3, 4, 2, 100}, {6, 4, 2, 100}, {7, 4, 2, 100}, {5, 16, 2, 100}}},
   {4, 4, 3, 1, 9, 9, {{3, 4, 2, 100}, {5, 4, 2, 100}, {3, 4, 2, 100}, {2, 6, 2, 100}, {3, 2, 2, 100}, {4, 2, 2, 100}, {5, 2, 2, 100}, {3, 4, 2, 100}, {0, 16, 2, 100}}},
   {4, 4, 3, 1, 11, 11, {{5, 2, 2, 100}, {4, 2, 2, 100}, {3, 2, 2, 100}, {1, 2, 2, 100}, {0, 6, 2, 100}, {0, 4, 2, 100}, {1, 4, 2, 100}, {2, 4, 2, 100}, {3, 2, 2, 100}, {5, 2, 2, 100}, {0, 16, 2, 100}}},
@@ -1228,284 +1981,305 @@ static struct Lick Bank_of_chimes[5] = {
   {4, 4, 6, 1, 23, 23, {{5, 4, 2, 100}, {4, 4, 2, 100}, {3, 4, 2, 100}, {3, 4, 2, 100}, {3, 2, 2, 100}, {2, 2, 2, 100}, {2, 2, 2, 100}, {3, 2, 2, 100}, {1, 4, 2, 100}, {0, 4, 2, 100}, {1, 4, 2, 100}, {3, 12, 2, 100}, {3, 4, 2, 100}, {4, 4, 2, 100}, {3, 4, 2, 100}, {5, 4, 2, 100}, {3, 2, 2, 100}, {2, 2, 2, 100}, {2, 2, 2, 100}, {3, 2, 2, 100}, {1, 4, 2, 100}, {3, 4, 2, 100}, {5, 16, 2, 100}}}
 };
 
-void play_chime(){
-  //chime is using scrambled note index mapping
-  Lick chime = Bank_of_chimes[static_cast<int>round(R.uniform(-0.499, 4.499))];
-  
-  // PLAYING LICK
-  int j = 0;
-  Note cur_note; 
-  bool next_note_ready = true;
-  int cur_note_on_time = millis();
-  int bpm = 60;
-
-  //play the lick, iterating through the notes
-  while(j < chime.num_notes){
-
-    read_sensor_vals();
-
-    //only get note when ready, prevents overriding index with other values
-    if(next_note_ready){
-
-      cur_note = chime.data[j];
-      cur_note.note_index = get_unscrambled_idx(cur_note.note_index); //update with unscrambled value
-
-      // some chance to use markov matrices to determine the note based on previous (increase variety)
-      //if(j > 0 && (R.uniform(0, 0.7) >= 0.5)){
-      //  cur_note.note_index = getNextNoteIndex(chime.data[j-1].note_index, 2, R);
-      //}
-
-      // SENSORS ACTIVE
-      // only update if someone is next to the drum and is close enough
-      // fn returns -1 if no notes are selected
-      int selected_note_idx = get_next_note_idx_from_sensors();
-      if(selected_note_idx >= 0){
-        cur_note.note_index = selected_note_idx;
-      }
-
-      cur_note.velocity = get_velocity_from_sensors(cur_note.note_index);
-    
-    }
-
-    update_note_timers(note_inactive_arr);
-    
-    if(note_inactive_arr[cur_note.note_index] && next_note_ready){
-      send_SPI_message_on(cur_note); //send SPI message for note on
-      note_inactive_arr[cur_note.note_index] = 0; //note is active now
-      active_note_vel_arr[cur_note.note_index] = cur_note.velocity; //update velocity so that we know which solenoids to turn off
-      cur_note_on_time = millis(); //tracking on_time for ensuring that notes are quantized (on musical grid)
-      next_note_ready = 0;
-
-      Serial.print("Lick note on at (ms): ");
-      Serial.println(cur_note_on_time);
-    }
+/***************************************
+ * AUTONOMOUS MODE STATE MACHINE STARTS HERE
+ ***************************************/
+
+// Autonomous mode (licks, and the hourly chime) is stepped from loop() like the other two
+// modes. A step never waits: it makes at most one decision or strikes at most one note and
+// returns, so loop() keeps reading the mode switches and serving the scheduler, and a flip
+// to MIDI or sensor mode takes effect on the next loop() instead of after the lick.
+enum AutoState {
+  AUTO_STOPPED = 0, // not in autonomous mode
+  AUTO_DECIDE,      // chime due? pick the next lick, play it or wait
+  AUTO_WAIT,        // not time for a lick yet, decide again at wake_us
+  AUTO_PLAY,        // striking the lick's (or chime's) notes on the transport
+  AUTO_RING_OUT     // the last note's duration
+};
 
-    //here we check the note timers, turning off any solenoids that exceed on time
-    check_sensor_note_timers(note_inactive_arr);
+struct AutoMode {
+  uint8_t state;
+  bool chime;                 // playing a chime, not a lick
+  int energy_level;
+  int time_sig_num;
+  int time_sig_denom;
+  int base_bpm;               // before the schedule band's scaling
+  int lick_wait_period;       // ms from the end of a lick to the next one
+  bool quiet_time;
+  uint32_t lick_done_ms;      // millis() when the last lick finished
+  uint32_t wake_us;           // end of AUTO_WAIT
+  struct Lick* lick;          // last lick picked
+  const struct Lick* playing; // lick or chime being played
+  int j;                      // next note of it
+  bool note_ready;            // cur_note was chosen at its onset, its tongue is still held
+  Note cur_note;
+  NoteHistory history;        // notes struck so far in this pass of the lick
+  Transport transport;
+};
+static AutoMode auto_mode;
 
-    //want to make sure that the next note is played in time, and that the previous one has been turned
-    if(millis() - cur_note_on_time >= 1000 / (4.0 * bpm / cur_note.duration / 60) && note_inactive_arr[cur_note.note_index]){
-      next_note_ready = 1;
-      j++;
-    }
-      
-  };
+static bool can_add_note = 0;
 
-  //turn off all arms for safety
-  for(int i = 0; i < 8; i++){
-    Note temp = {i, 0, 3, 100};
-    send_SPI_message_off(temp);
-  }
+// how often autonomous mode re-checks time and sensors while waiting for the next lick
+#define LICK_POLL_MS 50
 
-  return;
+/***********************************************************
+ * Function: void auto_mode_start(int energy_level, int time_sig_num,
+ *                                int time_sig_denom, int bpm)
+ * Description: Enters autonomous mode, the first lick is
+ * picked on the next step.
+ ***********************************************************/
+void auto_mode_start(int energy_level, int time_sig_num, int time_sig_denom, int bpm){
+  auto_mode.state = AUTO_DECIDE;
+  auto_mode.chime = false;
+  auto_mode.energy_level = energy_level;
+  auto_mode.time_sig_num = time_sig_num;
+  auto_mode.time_sig_denom = time_sig_denom;
+  auto_mode.base_bpm = bpm;
+  auto_mode.lick_done_ms = 0;
+  auto_mode.lick = NULL;
+  auto_mode.playing = NULL;
+  auto_mode.note_ready = false;
 }
 
-static bool already_chimed = true;
-
-// returns quiet_state boolean, if true then the drum shouldn't play any licks
-bool check_time_state(struct Lick* bank_init){
-  int hour = static_cast<int>(myRTC.getHour(h12Flag, pmFlag));
-  int minute = static_cast<int>(myRTC.getMinute());
-
-  Serial.print("Minute: ");
-  Serial.println(minute);
-
-  int chime_minute = 55;
-
-  // Here we determine the tolls to play at hours
-  if(minute == chime_minute && !already_chimed){
-    play_chime();
-    //reset bank of licks
-    for(int i = 0; i < BoL_len; i++){
-      Bank_of_licks[i] = bank_init[i];
-    }
-
-    already_chimed = true;
-  }else if (minute != chime_minute){
-    already_chimed = false;
+/***********************************************************
+ * Function: void auto_mode_stop()
+ * Description: Leaves autonomous mode wherever it is. Notes
+ * already struck keep their scheduled note-offs.
+ ***********************************************************/
+void auto_mode_stop(){
+  if(auto_mode.state == AUTO_STOPPED){
+    return;
   }
-
-  // Here we can implement the schedule for when to have the drum off or on
-  // on 4/14 this was changed to last until 10pm -> supports interaction around showtimes
-  if(hour < 9 || hour >= 20){
-    return true;
-  } else {
-    return false;
+  if(auto_mode.chime){
+    for(int i = 0; i < BoL_len; i++){ //as after a finished chime
+      Bank_of_licks[i] = Bank_of_licks_orig[i];
+    }
   }
+  auto_mode.state = AUTO_STOPPED;
+  LOG_INFO("Autonomous mode stopped (note of lick)", auto_mode.j);
 }
 
-static bool can_add_note = 0;
+/***********************************************************
+ * Function: void auto_begin_chime()
+ * Description: Picks a chime and starts playing it at 60 bpm.
+ ***********************************************************/
+void auto_begin_chime(){
+  //chime is using scrambled note index mapping
+  auto_mode.playing = &Bank_of_chimes[rng_below(R, BoC_len)];
+  auto_mode.chime = true;
+  auto_mode.j = 0;
+  auto_mode.note_ready = false;
+  transport_start(auto_mode.transport, 60);
+  auto_mode.state = AUTO_PLAY;
+}
 
 /***********************************************************
- * Function: Note* play_licks()
- * Description: Called from main. Needs external inputs 
+ * Function: void auto_decide()
+ * Description: One pass of what used to be the top of the
+ * play_licks loop: plays a pending chime, otherwise updates
+ * tempo, wait period and energy level from the schedule and
+ * sensors, picks a lick and either starts it or waits.
  ***********************************************************/
-void play_licks(int energy_level, int time_sig_num, int time_sig_denom, Prandom R, int bpm){
-  int rand_note_index = 0;
-  int cur_note_on_time = millis();
-  int cur_note_off_time = 2147483647; //max value on int
-  bool next_note_ready = 1;
-  struct Lick* cur_lick;
-
-  int orig_bpm = bpm;
-  bool play_another_lick = 1;
-  int result_count = 0;
-  int lick_wait_period = 0;
-  int previous_millis = 0;
-
-  bool quiet_time = false;
-
-  //copy intial state of bank of licks for resetting purposes
-  struct Lick Bank_of_licks_init[BoL_len];
-  for(int i = 0; i < BoL_len; i++){
-    Bank_of_licks_init[i] = Bank_of_licks[i];
+void auto_decide(){
+  AutoMode& a = auto_mode;
+  schedule_poll(); //only looks at the clock when the minute has changed
+
+  // Here we determine the tolls to play at hours
+  if(schedule_now.chime_pending){
+    schedule_now.chime_pending = false;
+    LOG_INFO("Chime (minute of day)", schedule_now.minute_of_day);
+    auto_begin_chime();
+    return;
   }
-    
-  // play until some condition is met, TBD?
-  while (play_another_lick){
-    if(digitalRead(AUTO_PIN) != LOW){
-      break;
-    }
-    
-    read_sensor_vals();
-    quiet_time = check_time_state(Bank_of_licks_init);
-
-    bpm = update_bpm(orig_bpm);
-    Serial.print("BPM: ");
-    Serial.println(bpm);
-
-    // these use clock's hour value to update their values accordingly
-    lick_wait_period = get_lick_wait_period(bpm, time_sig_num, time_sig_denom);
-    energy_level = update_energy_level();
-    //quiet_time = check_time_off_state();
-    energy_level = check_sensor_inactivity(energy_level);
-
-    Serial.print("Lick wait period: ");
-    Serial.println(lick_wait_period);
-    Serial.print("Energy level: ");
-    Serial.println(energy_level);
-
-    Serial.println("New Lick");
-    result_count = 0;
-
-    // Pick all licks with passed energy level
-    struct Lick** matching_licks = pick_licks_by_criteria(Bank_of_licks, BoL_len, energy_level, time_sig_num, time_sig_denom, &result_count);
-
-    if (matching_licks != NULL) {
-        //printf("Found %d matching licks:\n", result_count);
-        // Print the matching licks
-        //for (int i = 0; i < result_count; i++) {
-            //print_lick(matching_licks[i]);
-            // WANT TO CHOOSE LICK SOMEHOW
-            //int rnd_lick_idx = static_cast<int>(round(R.uniform(0, result_count-0.501)));
-            //cur_lick = *matching_licks[rnd_lick_idx];
-        //}
-
-        int rnd_lick_idx = static_cast<int>(round(R.uniform(0, result_count-0.501)));
-        cur_lick = matching_licks[rnd_lick_idx];
-        free(matching_licks);  // Free memory after use
-    } else {
-        printf("No matching licks found with the given criteria.\n");
-        printf("Please add more licks to the bank of licks.\n");
-    }
 
-    //static_cast<bool>(round(R.uniform(0, 1)))
-    if(can_add_note){
-      // randomly select 
-      Serial.println("\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n");
-      Serial.print("Adding note to lick now: ");
-      add_note_to_lick(*cur_lick, static_cast<int>(round(R.uniform(0, cur_lick->num_notes - 0.501))));
-      subtract_note_from_lick(*cur_lick);
-      can_add_note = 0;
-    }
+  // when to have the drum off or on is in schedule_bands
+  a.quiet_time = schedule_now.band.quiet;
 
-    int j = 0;
-    Note cur_note;
-    
-    //check if next lick should be played, and it's not quiet time
-    if((millis() - previous_millis >= lick_wait_period && !quiet_time) || energy_level == 4){
-      
-      // PLAYING LICK
+  int bpm = update_bpm(a.base_bpm);
+  LOG_DEBUG("BPM", bpm);
 
-      //play the lick, iterating through the notes
-      while(j < cur_lick->num_notes){
+  // these use clock's hour value to update their values accordingly
+  a.lick_wait_period = get_lick_wait_period(bpm, a.time_sig_num, a.time_sig_denom);
+  a.energy_level = update_energy_level();
+  a.energy_level = check_sensor_inactivity(a.energy_level);
 
-        read_sensor_vals();
+  //every LICK_POLL_MS while waiting, so debug only; a lick starting is logged at info below
+  LOG_DEBUG("Lick wait period (ms)", a.lick_wait_period);
+  LOG_DEBUG("Energy level", a.energy_level);
 
-        //only get note when ready, prevents overriding index with other values
-        if(next_note_ready){
+  // Pick all licks with passed energy level
+  LickSpan matching_licks = pick_licks_by_criteria(a.energy_level, a.time_sig_num, a.time_sig_denom);
 
-          cur_note = cur_lick->data[j];
-          cur_note.note_index = get_unscrambled_idx(cur_note.note_index); //update with unscrambled value
+  static int warned_no_licks = -1; //energy and time signature last warned about
+  if (matching_licks.count > 0) {
+      int rnd_lick_idx = static_cast<int>(rng_below(R, matching_licks.count));
+      a.lick = matching_licks.licks[rnd_lick_idx];
+      warned_no_licks = -1;
+  } else if (warned_no_licks != a.energy_level * 16 + a.time_sig_num) {
+      warned_no_licks = a.energy_level * 16 + a.time_sig_num;
+      LOG_WARN("No matching licks found, please add more licks to the bank (energy/ts num)", a.energy_level, a.time_sig_num);
+  }
 
-          // some chance to use markov matrices to determine the note based on previous (increase variety)
-          if(j > 0 && (R.uniform(0, 0.7) >= 0.5) && energy_level != 4){
-            cur_note.note_index = getNextNoteIndex(cur_lick->data[j-1].note_index, 2, R);
-          }
+  if(can_add_note && a.lick != NULL){
+    // randomly select 
+    LOG_DEBUG("Adding note to lick now");
+    add_note_to_lick(*a.lick, static_cast<int>(rng_below(R, a.lick->num_notes)));
+    subtract_note_from_lick(*a.lick);
+    can_add_note = 0;
+  }
 
-          // SENSORS ACTIVE
-          // only update if someone is next to the drum and is close enough
-          // fn returns -1 if no notes are selected
-          int selected_note_idx = get_next_note_idx_from_sensors();
-          if(selected_note_idx >= 0){
-            cur_note.note_index = selected_note_idx;
-          }
+  //check if next lick should be played, and it's not quiet time
+  if(a.lick != NULL && ((millis() - a.lick_done_ms >= static_cast<uint32_t>(a.lick_wait_period) && !a.quiet_time) || a.energy_level == 4)){
+    a.chime = false;
+    a.playing = a.lick;
+    a.j = 0;
+    a.note_ready = false;
+    transport_start(a.transport, bpm);
+    a.state = AUTO_PLAY;
+    LOG_INFO("New lick (energy/bpm)", a.energy_level, bpm);
+  }else{
+    //not time for a lick yet, check again in a bit: at the end of the wait period if that
+    //comes sooner, never less than 1 ms so a passed period can't spin DECIDE every loop()
+    uint32_t wait_ms = LICK_POLL_MS;
+    if(a.lick != NULL && !a.quiet_time){
+      int32_t left_ms = static_cast<int32_t>(a.lick_wait_period - static_cast<int32_t>(millis() - a.lick_done_ms));
+      if(left_ms < LICK_POLL_MS){
+        wait_ms = left_ms < 1 ? 1 : static_cast<uint32_t>(left_ms);
+      }
+    }
+    a.wake_us = micros() + wait_ms * 1000UL;
+    a.state = AUTO_WAIT;
+  }
+}
 
-          cur_note.velocity = get_velocity_from_sensors(cur_note.note_index);
-        
-        }
+/***********************************************************
+ * Function: Note auto_choose_note()
+ * Description: The next note of the lick or chime, chosen at
+ * its onset: the written note, maybe replaced by a draw from
+ * the energy level's n-gram model given the notes struck so
+ * far (licks only), or by the note a hand is over, with its
+ * velocity from the sensors.
+ ***********************************************************/
+Note auto_choose_note(){
+  AutoMode& a = auto_mode;
+  Note cur_note = a.playing->data[a.j];
+  cur_note.note_index = get_unscrambled_idx(cur_note.note_index); //update with unscrambled value
+
+  // some chance to use markov matrices to determine the note based on previous (increase variety)
+  if(!a.chime && a.j > 0 && rng_chance(R, 2, 7) && a.energy_level != 4){
+    cur_note.note_index = getNextNoteIndex(a.history, a.energy_level, R);
+  }
 
-        update_note_timers(note_inactive_arr);
-        
-        if(note_inactive_arr[cur_note.note_index] && next_note_ready){
-          send_SPI_message_on(cur_note); //send SPI message for note on
-          note_inactive_arr[cur_note.note_index] = 0; //note is active now
-          active_note_vel_arr[cur_note.note_index] = cur_note.velocity; //update velocity so that we know which solenoids to turn off
-          cur_note_on_time = millis(); //tracking on_time for ensuring that notes are quantized (on musical grid)
-          next_note_ready = 0;
-
-          Serial.print("Lick note on at (ms): ");
-          Serial.println(cur_note_on_time);
-        }
+  // SENSORS ACTIVE
+  // only update if someone is next to the drum and is close enough
+  // fn returns -1 if no notes are selected
+  int selected_note_idx = get_next_note_idx_from_sensors();
+  if(selected_note_idx >= 0){
+    cur_note.note_index = selected_note_idx;
+  }
 
-        //here we check the note timers, turning off any solenoids that exceed on time
-        check_sensor_note_timers(note_inactive_arr);
-
-        //want something based on note_timers, not current note (see above)
-        /*
-        if ((!note_inactive_arr[cur_note.note_index]) && (millis() - cur_note_on_time >= get_solenoid_on_delay(cur_note.velocity)) && !next_note_ready) {
-          send_SPI_message_off(cur_note);  // Send SPI message to turn off the note
-          note_inactive_arr[cur_note.note_index] = 1; // Mark the note as no longer active
-          Serial.print("Auto note off at (ms): ");
-          Serial.println(millis());
-          Serial.println();
-        }
-        */
-
-        //want to make sure that the next note is played in time, and that the previous one has been turned
-        if(millis() - cur_note_on_time >= 1000 / (4.0 * bpm / cur_note.duration / 60) && note_inactive_arr[cur_note.note_index]){
-          next_note_ready = 1;
-          j++;
-          if(R.uniform(0.0, 1.0) >= 0.9 && energy_level != 4){
-            j = 0; // 20% chance to repeat the lick
-          }
-        }
-          
-      };
+  cur_note.velocity = get_velocity_from_sensors(cur_note.note_index);
+  if(a.j == 0){
+    note_history_start(a.history, cur_note.note_index);
+  }else{
+    note_history_push(a.history, cur_note.note_index);
+  }
+  return cur_note;
+}
 
-      //turn off all arms for safety
-      for(int i = 0; i < 8; i++){
-        Note temp = {i, 0, 3, 100};
-        send_SPI_message_off(temp);
-      }
+/***********************************************************
+ * Function: void auto_play_step()
+ * Description: Strikes the lick's next note if it is due on
+ * the transport and its tongue is free, otherwise returns.
+ ***********************************************************/
+void auto_play_step(){
+  AutoMode& a = auto_mode;
+  if(a.j >= a.playing->num_notes){
+    a.state = AUTO_RING_OUT;
+    return;
+  }
+  if(!a.note_ready){
+    if(sched_before(micros(), transport_due_us(a.transport))){
+      return;
+    }
+    if(transport_resync_if_late(a.transport)){
+      LOG_WARN("Transport fell behind, resynced (tick)", a.transport.tick);
+    }
+    a.cur_note = auto_choose_note();
+    a.note_ready = true;
+  }
+  //onsets are due on the beat grid, not a duration after the previous note happened to fire
+  if(!transport_try_strike(a.transport, a.cur_note)){
+    return; //tongue still held from an earlier note
+  }
+  a.note_ready = false;
+  a.j++;
+  if(a.chime){
+    return;
+  }
+  //a new schedule band's tempo starts on the next beat
+  schedule_poll();
+  transport_set_bpm(a.transport, update_bpm(a.base_bpm));
+  if(rng_chance(R, 1, 10) && a.energy_level != 4){
+    a.j = 0; // 10% chance to repeat the lick
+  }
+}
+
+/***********************************************************
+ * Function: void auto_finish()
+ * Description: After the last note's duration: all arms off,
+ * then back to deciding. A chime resets the bank of licks.
+ ***********************************************************/
+void auto_finish(){
+  //turn off all arms for safety
+  for(int i = 0; i < 8; i++){
+    Note temp = {i, 0, 3, 100};
+    send_SPI_message_off(temp);
+  }
+  tpic_flush();
 
-      Serial.print("Lick Finished!!\n");
-      previous_millis = millis(); //update previous_millis now that lick is finished
-      can_add_note = 1;
+  if(auto_mode.chime){
+    //reset bank of licks
+    for(int i = 0; i < BoL_len; i++){
+      Bank_of_licks[i] = Bank_of_licks_orig[i];
     }
+    auto_mode.chime = false;
+  }else{
+    LOG_INFO("Lick Finished!!");
+    auto_mode.lick_done_ms = millis(); //the wait for the next lick counts from now
+    can_add_note = 1;
+  }
+  auto_mode.state = AUTO_DECIDE;
+}
 
-    if(rand_note_index == -1)
+/***********************************************************
+ * Function: void auto_mode_step()
+ * Description: Called from loop() in autonomous mode. Runs
+ * one sensor scan step and one step of the state machine,
+ * never waits for a note.
+ ***********************************************************/
+void auto_mode_step(){
+  PERF_SCOPE(PERF_AUTO_STAGE);
+  read_sensor_vals();
+  switch(auto_mode.state){
+    case AUTO_DECIDE:
+      auto_decide();
       break;
-
-  };
+    case AUTO_WAIT:
+      if(!sched_before(micros(), auto_mode.wake_us)){
+        auto_mode.state = AUTO_DECIDE;
+      }
+      break;
+    case AUTO_PLAY:
+      auto_play_step();
+      break;
+    case AUTO_RING_OUT:
+      if(!sched_before(micros(), transport_due_us(auto_mode.transport))){ //last note's full duration
+        auto_finish();
+      }
+      break;
+    default:
+      break;
+  }
 }
@@ -0,0 +1,166 @@
+/* Filename: orchestrion_calibration.h
+ * Author: Liam Warner
+ * Purpose: solenoid on-time per note and velocity level. Every tongue used to get the same
+ *          on-time (SOLENOID_ON_TIME, +30 ms at velocity 1), long enough for the slowest
+ *          solenoid, which also set how fast any tongue could repeat. The table here is
+ *          filled by the calibration sweep (calibrate_solenoids(), run from loop() after 'c'
+ *          and then 'C' within CAL_CONFIRM_MS come in over Serial, never by itself) and kept
+ *          in the flash settings row, loaded again by solenoid_cal_load() at every setup().
+ *          A sweep within CAL_SAVE_TOLERANCE_MS of the stored table leaves the flash alone.
+ *          Until a sweep has been saved, or if the stored table doesn't check out, the old
+ *          constants are used.
+ */
+
+#ifndef ORCHESTRION_CALIBRATION_H
+#define ORCHESTRION_CALIBRATION_H
+
+#define CAL_NOTES 8
+#define CAL_LEVELS 3           // velocity levels 1, 2, 3
+#define CAL_MAGIC 0xCA1Bu
+#define CAL_VERSION 1
+#define CAL_MIN_MS 5           // shortest on-time the sweep tries
+#define CAL_MAX_MS 100         // longest on-time ever used, keeps the coils from cooking
+#define CAL_MARGIN_MS 5        // added to the shortest time that struck, for heat and wear
+#define CAL_SAVE_TOLERANCE_MS 2 // a sweep this close to the stored table keeps the stored one
+#define CAL_CONFIRM_MS 10000   // 'C' has to follow 'c' within this long to start a sweep
+
+struct SolenoidCalibration {
+  uint16_t magic;
+  uint8_t version;
+  uint8_t swept_mask;                   // bit per note whose times came from a sweep
+  uint8_t on_ms[CAL_NOTES][CAL_LEVELS]; // on-time per note index and velocity level - 1
+  uint16_t checksum;                    // solenoid_cal_checksum() of everything above
+};
+static_assert(sizeof(SolenoidCalibration) <= HAL_NVM_SIZE, "calibration table must fit the settings row");
+
+static SolenoidCalibration solenoid_cal;
+
+static bool solenoid_cal_requested = false; // confirmed over Serial, loop() runs the sweep
+static bool solenoid_cal_armed = false;     // 'c' came in, waiting for 'C'
+static uint32_t solenoid_cal_armed_ms = 0;
+
+/***********************************************************
+ * Function: uint16_t solenoid_cal_checksum(const SolenoidCalibration& cal)
+ * Description: Fletcher-16 over the table up to the checksum.
+ ***********************************************************/
+uint16_t solenoid_cal_checksum(const SolenoidCalibration& cal){
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(&cal);
+  uint16_t a = 0;
+  uint16_t b = 0;
+  for(size_t i = 0; i < offsetof(SolenoidCalibration, checksum); i++){
+    a = (a + p[i]) % 255;
+    b = (b + a) % 255;
+  }
+  return static_cast<uint16_t>((b << 8) | a);
+}
+
+/***********************************************************
+ * Function: void solenoid_cal_defaults()
+ * Description: Fills the table with the old fixed on-times.
+ ***********************************************************/
+void solenoid_cal_defaults(){
+  solenoid_cal.magic = CAL_MAGIC;
+  solenoid_cal.version = CAL_VERSION;
+  solenoid_cal.swept_mask = 0;
+  for(int note = 0; note < CAL_NOTES; note++){
+    solenoid_cal.on_ms[note][0] = SOLENOID_ON_TIME + 30; //velocity 1 needs more on time
+    solenoid_cal.on_ms[note][1] = SOLENOID_ON_TIME;
+    solenoid_cal.on_ms[note][2] = SOLENOID_ON_TIME;
+  }
+  solenoid_cal.checksum = solenoid_cal_checksum(solenoid_cal);
+}
+
+/***********************************************************
+ * Function: bool solenoid_cal_load()
+ * Description: Loads the table from flash. False, with the
+ * defaults loaded instead, if nothing valid was stored.
+ ***********************************************************/
+bool solenoid_cal_load(){
+  SolenoidCalibration stored;
+  hal_nvm_read(&stored, sizeof(stored));
+  bool ok = stored.magic == CAL_MAGIC && stored.version == CAL_VERSION &&
+            stored.checksum == solenoid_cal_checksum(stored);
+  for(int note = 0; ok && note < CAL_NOTES; note++){
+    for(int level = 0; level < CAL_LEVELS; level++){
+      if(stored.on_ms[note][level] < CAL_MIN_MS || stored.on_ms[note][level] > CAL_MAX_MS){
+        ok = false;
+      }
+    }
+  }
+  if(!ok){
+    solenoid_cal_defaults();
+    LOG_INFO("No solenoid calibration stored, using defaults");
+    return false;
+  }
+  solenoid_cal = stored;
+  LOG_INFO("Solenoid calibration loaded (swept notes mask)", solenoid_cal.swept_mask);
+  return true;
+}
+
+/***********************************************************
+ * Function: bool solenoid_cal_save()
+ * Description: Writes the table to flash, unless the stored
+ * one is valid, swept the same notes and is within
+ * CAL_SAVE_TOLERANCE_MS everywhere; then that one is kept,
+ * in flash and in RAM. The row is only good for about 10k
+ * writes, and sweeps vary by a ms or two. True if written.
+ ***********************************************************/
+bool solenoid_cal_save(){
+  solenoid_cal.magic = CAL_MAGIC;
+  solenoid_cal.version = CAL_VERSION;
+  solenoid_cal.checksum = solenoid_cal_checksum(solenoid_cal);
+  SolenoidCalibration stored;
+  hal_nvm_read(&stored, sizeof(stored));
+  bool same = stored.magic == CAL_MAGIC && stored.version == CAL_VERSION &&
+              stored.checksum == solenoid_cal_checksum(stored) && stored.swept_mask == solenoid_cal.swept_mask;
+  for(int note = 0; same && note < CAL_NOTES; note++){
+    for(int level = 0; level < CAL_LEVELS; level++){
+      if(abs(stored.on_ms[note][level] - solenoid_cal.on_ms[note][level]) > CAL_SAVE_TOLERANCE_MS){
+        same = false;
+      }
+    }
+  }
+  if(same){
+    solenoid_cal = stored;
+    return false;
+  }
+  hal_nvm_write(&solenoid_cal, sizeof(solenoid_cal));
+  return true;
+}
+
+/***********************************************************
+ * Function: bool calibration_command(int c)
+ * Description: 'c' arms the solenoid sweep, 'C' within
+ * CAL_CONFIRM_MS confirms it and loop() runs it. The sweep
+ * strikes every tongue for about a minute, so it never starts
+ * from one stray byte or from the switch positions. False for
+ * any other command.
+ ***********************************************************/
+bool calibration_command(int c){
+  if(c == 'c'){
+    solenoid_cal_armed = true;
+    solenoid_cal_armed_ms = millis();
+    LOG_WARN("Send C within 10 s to run the solenoid calibration sweep");
+    return true;
+  }
+  if(c == 'C'){
+    if(solenoid_cal_armed && millis() - solenoid_cal_armed_ms < CAL_CONFIRM_MS){
+      solenoid_cal_requested = true;
+    }
+    solenoid_cal_armed = false;
+    return true;
+  }
+  return false;
+}
+
+/***********************************************************
+ * Function: int get_solenoid_on_delay(int note_index, int velocity)
+ * Description: How long (ms) to hold note_index on to strike
+ * it at velocity level 1-3. Anything else is treated as 3.
+ ***********************************************************/
+inline int get_solenoid_on_delay(int note_index, int velocity){
+  int level = (velocity >= 1 && velocity <= CAL_LEVELS) ? velocity : CAL_LEVELS;
+  return solenoid_cal.on_ms[note_index & (CAL_NOTES - 1)][level - 1];
+}
+
+#endif
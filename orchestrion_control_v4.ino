@@ -4,29 +4,18 @@
 #include <stdlib.h>
 #include <time.h>
 #include "midi_autonomous_performance_v4.h"
+#include "orchestrion_fault.h" //FAULT_PIN interrupt, snapshot and recovery
 #include <Wire.h>
 #include <Adafruit_ADS7830.h>
 #include <DS3231.h>
 
 // Pin # Definitions are in header file
 
-bool fault_detected;
-
-void fault_interrupt(){
-  //turn off all notes
-    for(int i=0; i<8; i++){
-      Note temp_note = {i, 0, 3};
-      send_SPI_message_off(temp_note);
-    }
-    digitalWrite(OUTPUT_EN, LOW); //turn off output enable pin
-    //fault_detected = 1; //fault has been detected, don't do midi/auto/sensor/this (stop everything)
-    Serial.println("ERROR!!! FAULT DETECTED!!! ERROR!!!"); //print message to terminal
-    while(1); // STOP EVERYTHING
-}
-
 
 void setup() {
+  TRACE_POWER_UP_MARK(); //the input trace starts over with every power up
   Wire.begin(); //I2C interface intialization
+  Wire.setClock(400000); //ADS7830 and DS3231 both support 400 kHz fast mode
   Serial.begin(115200); //baud rate used by examples in USBMIDI library, matching here for safety
   SPI.begin(); //SPI interface intialization
 
@@ -40,28 +29,80 @@ void setup() {
   pinMode(CS_PIN3, OUTPUT);
   pinMode(OUTPUT_EN, OUTPUT); //output enable
 
-  digitalWrite(OUTPUT_EN, HIGH); //enabled at setup
   digitalWrite(CS_PIN0, HIGH);
   digitalWrite(CS_PIN1, HIGH);
   digitalWrite(CS_PIN2, HIGH);
   digitalWrite(CS_PIN3, HIGH);         
+  tpic_flush(); //the shadow image starts all dirty, this latches zeros into every TPIC
+  digitalWrite(OUTPUT_EN, HIGH); //enabled at setup, once nothing is latched on
 
-  //attachInterrupt(digitalPinToInterrupt(FAULT_PIN), fault_interrupt, FALLING);
+  attachInterrupt(digitalPinToInterrupt(FAULT_PIN), fault_isr, FALLING); //outputs off within microseconds
 
   //do adc setup
   ad7830.begin();         
 
-  fault_detected = 0;                                                                     
+  solenoid_cal_load(); //per note on-times from flash, the old fixed ones if none were saved
+
+  save_lick_bank(); //copy intial state of bank of licks for resetting purposes
+  lick_bank_check_durations(Bank_of_licks, BoL_len);
+  lick_bank_check_durations(Bank_of_chimes, BoC_len);
+  build_lick_index(Bank_of_licks, BoL_len); //group the licks by energy level and time signature
+
+  //fill the first sensor frame so nothing reads zeros before the scan has gone round once
+  while(sensor_frame().seq == 0){
+    read_sensor_vals();
+  }
+
+  rng_seed_from_hardware(); //RTC time and sensor noise, or rng_fixed_seed to replay a run
+
+  fault_poll(); //a fault line already low at power up has no edge
 }
 
 
 void loop() {
-  
+#if PERF_ENABLED
+  static bool loop_started = false;
+  static uint32_t loop_start_us = 0;
+  uint32_t now_us = micros();
+  if(loop_started){
+    PERF_RECORD(PERF_LOOP_PERIOD, now_us - loop_start_us);
+  }
+  loop_started = true;
+  loop_start_us = now_us;
+#endif
+
+  //FAULT_PIN: snapshot and shutdown after the ISR, or recovery once it has cleared
+  fault_poll();
+
+  //'c' then 'C' over Serial: sweep the solenoid on-times, with nothing else playing
+  if(solenoid_cal_requested){
+    solenoid_cal_requested = false;
+    if(fault_detected){
+      LOG_WARN("Calibration refused, outputs are off for a fault");
+    }else{
+      auto_mode_stop();
+      midi_input_drop();
+      scheduler_wait_until(micros() + CAL_MAX_MS * 1000UL); //every note still on has been released
+      calibrate_solenoids();
+    }
+  }
+
+  //mode switches, read once per tick
+  int sensor_switch = hal_pin_read(SENSOR_PIN);
+  int auto_switch = hal_pin_read(AUTO_PIN);
+  if(auto_switch != LOW || fault_detected){
+    auto_mode_stop(); //flipped out of autonomous mode, drop the lick wherever it was
+  }
+  bool midi_mode = sensor_switch == HIGH && auto_switch == HIGH && !(fault_detected);
+  if(!midi_mode){
+    midi_input_drop(); //a chord or repeats held when MIDI mode was left are never struck
+  }
+
   //DO IF MIDI MODE:
-  if(digitalRead(SENSOR_PIN) == HIGH && digitalRead(AUTO_PIN) == HIGH && !(fault_detected)){
+  if(midi_mode){
     
-    //read midi input if any, note_index of returned note is -1 if no note received
-    Note cur_note = read_midi();
+    //handle every MIDI packet that arrived since the last tick
+    read_midi();
    
   //  //FOR CHECKOFF: print stuff if note input is valid
   //  if(cur_note.note_index >= 0){
@@ -84,13 +125,10 @@ void loop() {
   //    
   //  }
   
-    //cur_note printed earlier
-    update_note_timers(note_inactive_arr);
-    check_note_timers(note_inactive_arr, cur_note);
+    //note-offs are already queued on the scheduler by noteOn, run at the end of the tick
 
     //DO IF AUTONOMOUS MODE:
-  }else if(digitalRead(AUTO_PIN) == LOW && !(fault_detected)){ // low for autonomous mode
-    Prandom R;
+  }else if(auto_switch == LOW && !(fault_detected)){ // low for autonomous mode
     int bpm = 90;
     
     /*
@@ -107,27 +145,26 @@ void loop() {
     delay(2000);
     */
 
-    play_licks(2, 4, 4, R, bpm);
+    //one step per tick, the lick carries on from where it was on the next loop()
+    if(auto_mode.state == AUTO_STOPPED){
+      auto_mode_start(2, 4, 4, bpm);
+    }
+    auto_mode_step();
   
     //DO IF SENSOR MODE
-  }else if(digitalRead(SENSOR_PIN) == LOW && !(fault_detected)){
+  }else if(sensor_switch == LOW && !(fault_detected)){
       read_sensor_vals();
       check_sensors(); 
-      update_sensor_note_timers(note_inactive_arr);
-      check_sensor_note_timers(note_inactive_arr);
+      update_sensor_note_timers();
   }
 
-  //if fault pin is driven low disable TPIC output
-//  if(digitalRead(FAULT_PIN) == LOW && !(fault_detected)){
-//    //turn off all notes
-//    for(int i=0; i<8; i++){
-//      Note temp_note = {i, 0, 3};
-//      send_SPI_message_off(temp_note);
-//    }
-//    digitalWrite(OUTPUT_EN, LOW); //turn off output enable pin
-//    fault_detected = 1; //fault has been detected, don't do midi/auto/sensor/this (stop everything)
-//    Serial.println("ERROR!!! FAULT DETECTED!!! ERROR!!!"); //print message to terminal
-//  }
+  //end of tick, release any note whose on time is up and send every TPIC whose byte changed
+  //in one SPI transaction
+  scheduler_run_due();
+  log_drain(); //idle time, print queued log records without blocking
+  serial_command_poll(); //'p' dumps the timing histograms, 't' the input trace
+  perf_poll();
+  trace_poll();
 
   //otherwise do nothing
 }
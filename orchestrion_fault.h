@@ -0,0 +1,183 @@
+/* Filename: orchestrion_fault.h
+ * Author: Liam Warner
+ * Purpose: fault handling for the solenoid drivers. A falling edge on FAULT_PIN runs
+ *          fault_isr(), which drops OUTPUT_EN first thing and blanks the TPIC shadow image,
+ *          and nothing else: no SPI (a transaction may be half done in the main context), no
+ *          Serial, no log. The main context picks it up at the top of the next loop() in
+ *          fault_poll(): it records a snapshot of what was playing, clears every note and
+ *          pending event, stops the modes and logs it. Once FAULT_PIN has stayed high for
+ *          FAULT_CLEAR_MS the blank image is sent and the outputs are enabled again, up to
+ *          FAULT_MAX_RECOVERIES times; after that the drum stays off until it is reset.
+ *          The pin is also polled, in case it was already low before the interrupt was
+ *          attached.
+ */
+
+#ifndef ORCHESTRION_FAULT_H
+#define ORCHESTRION_FAULT_H
+
+#define FAULT_CLEAR_MS 2000     // fault line must stay released this long before re-enabling
+#define FAULT_MAX_RECOVERIES 3  // faults after this many stay latched until reset
+
+// What the drum was doing when the fault hit
+struct FaultSnapshot {
+  uint32_t isr_us;          // micros() in the ISR
+  uint32_t handled_us;      // micros() when the main context took over
+  byte tpic[NUM_TPICS];     // shadow image that was driving the solenoids
+  uint8_t active_notes;     // bit per note that was being held
+  uint8_t switches;         // bit 0 AUTO_PIN low, bit 1 SENSOR_PIN low
+  uint8_t events_dropped;   // scheduled events thrown away
+  uint8_t polled;           // 1 if found by polling rather than the interrupt
+};
+
+static volatile bool fault_isr_pending = false;  // set by the ISR, taken by fault_poll()
+static volatile uint32_t fault_isr_us = 0;
+static byte fault_isr_tpic[NUM_TPICS];
+static bool fault_detected = false;              // outputs are off, the modes don't run
+static uint32_t fault_count = 0;                 // faults since power up
+static uint32_t fault_clear_since_ms = 0;        // millis() since FAULT_PIN has been high
+static FaultSnapshot fault_last;
+
+/***********************************************************
+ * Function: void fault_isr()
+ * Description: FAULT_PIN falling edge. Outputs off, then the
+ * shadow image blanked and every chip marked dirty so the
+ * next tpic_flush() from the main context sends zeros.
+ ***********************************************************/
+void fault_isr(){
+  digitalWrite(OUTPUT_EN, LOW); //before anything else
+  if(!fault_isr_pending){
+    for(int chip = 0; chip < NUM_TPICS; chip++){
+      fault_isr_tpic[chip] = tpic_shadow[chip];
+    }
+    fault_isr_us = micros();
+  }
+  for(int chip = 0; chip < NUM_TPICS; chip++){
+    tpic_shadow[chip] = 0;
+  }
+  tpic_dirty = (1 << NUM_TPICS) - 1;
+  fault_isr_pending = true;
+}
+
+/***********************************************************
+ * Function: void fault_enter(bool polled)
+ * Description: Main context side of a fault: snapshot, drop
+ * every note, event and held MIDI note, stop the modes.
+ ***********************************************************/
+void fault_enter(bool polled){
+  FaultSnapshot& snap = fault_last;
+  noInterrupts();
+  for(int chip = 0; chip < NUM_TPICS; chip++){
+    snap.tpic[chip] = fault_isr_tpic[chip];
+  }
+  snap.isr_us = fault_isr_us;
+  fault_isr_pending = false;
+  interrupts();
+
+  snap.handled_us = micros();
+  snap.polled = polled;
+  snap.active_notes = 0;
+  for(int i = 0; i < 8; i++){
+    if(!note_inactive_arr[i]){
+      snap.active_notes |= static_cast<uint8_t>(1 << i);
+      release_note(i); //its pending note-off no longer matches
+    }
+    note_retrigger[i].scheduled = false; //sched_clear() below drops their events
+  }
+  midi_input_drop();
+  snap.switches = (hal_pin_read(AUTO_PIN) == LOW ? 1 : 0) | (hal_pin_read(SENSOR_PIN) == LOW ? 2 : 0);
+  snap.events_dropped = sched_count;
+  sched_clear();
+  auto_mode_stop();
+  tpic_flush(); //zeros out to every chip while the outputs are still off
+
+  fault_detected = true;
+  fault_count++;
+  fault_clear_since_ms = millis();
+
+  LOG_ERROR("FAULT! Outputs disabled (count/us to main context)", fault_count, snap.handled_us - snap.isr_us);
+  LOG_ERROR("FAULT notes held (mask), TPIC image", snap.active_notes,
+            static_cast<int32_t>((uint32_t)snap.tpic[0] | ((uint32_t)snap.tpic[1] << 8) |
+                                 ((uint32_t)snap.tpic[2] << 16) | ((uint32_t)snap.tpic[3] << 24)));
+  if(fault_count > FAULT_MAX_RECOVERIES){
+    LOG_ERROR("FAULT latched, outputs stay off until reset (count)", fault_count);
+  }
+}
+
+/***********************************************************
+ * Function: void fault_try_recover()
+ * Description: Re-enables the outputs once FAULT_PIN has been
+ * high for FAULT_CLEAR_MS, with the image known blank.
+ ***********************************************************/
+void fault_try_recover(){
+  if(fault_count > FAULT_MAX_RECOVERIES){
+    return; //latched until reset
+  }
+  if(fault_isr_pending){ //the line bounced or faulted again, outputs are already off
+    noInterrupts();
+    fault_isr_pending = false;
+    interrupts();
+    fault_clear_since_ms = millis();
+    return;
+  }
+  if(checkFault()){
+    fault_clear_since_ms = millis();
+    return;
+  }
+  if(millis() - fault_clear_since_ms < FAULT_CLEAR_MS){
+    return;
+  }
+  for(int chip = 0; chip < NUM_TPICS; chip++){
+    tpic_shadow[chip] = 0;
+  }
+  tpic_dirty = (1 << NUM_TPICS) - 1;
+  tpic_flush();
+  noInterrupts(); //a fault edge from here on runs the ISR after the enable and turns it off again
+  if(fault_isr_pending){
+    interrupts();
+    return;
+  }
+  fault_detected = false;
+  digitalWrite(OUTPUT_EN, HIGH);
+  interrupts();
+  if(fault_count == FAULT_MAX_RECOVERIES){
+    LOG_WARN("Fault cleared, outputs on, the next fault latches (count)", fault_count);
+  }else{
+    LOG_WARN("Fault cleared, outputs on (count)", fault_count);
+  }
+}
+
+/***********************************************************
+ * Function: bool fault_active()
+ * Description: True while the outputs are off for a fault,
+ * including one the ISR flagged or the pin shows that
+ * fault_poll() hasn't taken yet. For code that blocks
+ * between loop()s, like the calibration sweep.
+ ***********************************************************/
+bool fault_active(){
+  return fault_isr_pending || fault_detected || checkFault();
+}
+
+/***********************************************************
+ * Function: void fault_poll()
+ * Description: Called at the top of every loop(). Takes a
+ * fault the ISR flagged, or one the pin shows that the ISR
+ * didn't see, and runs recovery while faulted.
+ ***********************************************************/
+void fault_poll(){
+  if(fault_detected){
+    fault_try_recover();
+    return;
+  }
+  bool polled = false;
+  if(!fault_isr_pending && checkFault()){
+    noInterrupts();
+    fault_isr(); //same shutdown
+    interrupts();
+    polled = true;
+  }
+  if(fault_isr_pending){
+    fault_enter(polled);
+  }
+}
+
+#endif
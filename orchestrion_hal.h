@@ -0,0 +1,156 @@
+/* Filename: orchestrion_hal.h
+ * Author: Liam Warner
+ * Purpose: hardware abstraction layer for the orchestrion. All access to the TPIC chain,
+ *          ADS7830, DS3231, USB MIDI, the mode switches and the non-volatile settings in
+ *          flash goes through these functions,
+ *          so the performance code builds unchanged for the board and for the host
+ *          simulator in host/ (which provides simulated versions of the libraries below)
+ */
+
+#ifndef ORCHESTRION_HAL_H
+#define ORCHESTRION_HAL_H
+
+#include <SPI.h>
+#include <Wire.h>
+#include <MIDIUSB.h>
+#include <Adafruit_ADS7830.h>
+#include <DS3231.h>
+#include <FlashStorage.h> //FlashStorage library by Cristian Maglie
+#include "orchestrion_perf.h" //I2C and SPI time histograms
+#include "orchestrion_trace.h" //input trace ring, every read below is recorded
+
+//100 kHz SPI clock, shifts in data MSB first, data mode is 0
+//see https://en.wikipedia.org/wiki/Serial_Peripheral_Interface for more detail
+SPISettings spi_settings = {100000, MSBFIRST, SPI_MODE0};
+
+Adafruit_ADS7830 ad7830;
+
+DS3231 myRTC;
+bool century = false;
+bool h12Flag;
+bool pmFlag;
+byte alarmDay, alarmHour, alarmMinute, alarmSecond, alarmBits;
+bool alarmDy, alarmH12Flag, alarmPmFlag;
+
+/***********************************************************
+ * Function: void hal_spi_write_frames(const int cs_pins[],
+ *                                     const byte messages[], int count)
+ * Description: Shifts messages[k] into the TPIC selected by
+ * cs_pins[k] for every k, back to back inside a single SPI
+ * transaction. Each TPIC latches its byte on the rising edge
+ * of its chip select.
+ ***********************************************************/
+void hal_spi_write_frames(const int cs_pins[], const byte messages[], int count){
+  PERF_SCOPE(PERF_SPI);
+  SPI.beginTransaction(spi_settings);
+  for(int k = 0; k < count; k++){
+    digitalWrite(cs_pins[k], LOW);
+    SPI.transfer(messages[k]);
+    digitalWrite(cs_pins[k], HIGH);
+  }
+  SPI.endTransaction();
+  TRACE_TPIC_FRAMES(cs_pins, messages, count);
+}
+
+/***********************************************************
+ * Function: void hal_spi_write(int cs_pin, byte message)
+ * Description: Single TPIC write as its own transaction.
+ ***********************************************************/
+void hal_spi_write(int cs_pin, byte message){
+  hal_spi_write_frames(&cs_pin, &message, 1);
+}
+
+/***********************************************************
+ * Function: uint8_t hal_adc_read(uint8_t channel)
+ * Description: Blocking single-ended read of one ADS7830
+ * channel (0-7) over I2C.
+ ***********************************************************/
+uint8_t hal_adc_read(uint8_t channel){
+  PERF_SCOPE(PERF_I2C);
+  uint8_t value = ad7830.readADCsingle(channel);
+  TRACE_ADC_READ(channel, value);
+  return value;
+}
+
+/***********************************************************
+ * Function: int hal_rtc_hour() / int hal_rtc_minute() /
+ *           int hal_rtc_second()
+ * Description: Reads the current hour (24 hour mode), minute
+ * or second from the DS3231 over I2C.
+ ***********************************************************/
+int hal_rtc_hour(){
+  PERF_SCOPE(PERF_I2C);
+  int hour = static_cast<int>(myRTC.getHour(h12Flag, pmFlag));
+  TRACE_RTC_READ(0, hour);
+  return hour;
+}
+
+int hal_rtc_minute(){
+  PERF_SCOPE(PERF_I2C);
+  int minute = static_cast<int>(myRTC.getMinute());
+  TRACE_RTC_READ(1, minute);
+  return minute;
+}
+
+int hal_rtc_second(){
+  PERF_SCOPE(PERF_I2C);
+  int second = static_cast<int>(myRTC.getSecond());
+  TRACE_RTC_READ(2, second);
+  return second;
+}
+
+/***********************************************************
+ * Function: midiEventPacket_t hal_midi_read()
+ * Description: Pops the next USB MIDI event packet, header
+ * is 0 if nothing is pending.
+ ***********************************************************/
+midiEventPacket_t hal_midi_read(){
+  midiEventPacket_t rx = MidiUSB.read();
+  TRACE_MIDI_READ(rx);
+  return rx;
+}
+
+// One flash row of settings that survive power cycles. The SAMD21 has no EEPROM, this is
+// a row of program flash: it is erased by every sketch upload and good for about 10000
+// writes, so only write it when something actually changed.
+#define HAL_NVM_SIZE 64
+
+struct HalNvmBlock {
+  uint8_t bytes[HAL_NVM_SIZE];
+};
+FlashStorage(hal_nvm_store, HalNvmBlock);
+
+/***********************************************************
+ * Function: void hal_nvm_read(void* dst, size_t len)
+ * Description: Copies the first len bytes of the settings
+ * row into dst. The caller checks they are valid.
+ ***********************************************************/
+void hal_nvm_read(void* dst, size_t len){
+  HalNvmBlock block = hal_nvm_store.read();
+  memcpy(dst, block.bytes, len < HAL_NVM_SIZE ? len : HAL_NVM_SIZE);
+}
+
+/***********************************************************
+ * Function: void hal_nvm_write(const void* src, size_t len)
+ * Description: Replaces the first len bytes of the settings
+ * row with src, the rest of the row is kept. Erases and
+ * programs the row, the CPU stalls for several ms, so
+ * never call it while notes are playing.
+ ***********************************************************/
+void hal_nvm_write(const void* src, size_t len){
+  HalNvmBlock block = hal_nvm_store.read();
+  memcpy(block.bytes, src, len < HAL_NVM_SIZE ? len : HAL_NVM_SIZE);
+  hal_nvm_store.write(block);
+}
+
+/***********************************************************
+ * Function: int hal_pin_read(int pin)
+ * Description: Reads a digital input (mode switches, fault).
+ ***********************************************************/
+int hal_pin_read(int pin){
+  int level = digitalRead(pin);
+  TRACE_PIN_READ(pin, level);
+  return level;
+}
+
+#endif
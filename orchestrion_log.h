@@ -0,0 +1,188 @@
+/* Filename: orchestrion_log.h
+ * Author: Liam Warner
+ * Purpose: non-blocking debug logging. LOG_ERROR/WARN/INFO/DEBUG calls below LOG_LEVEL
+ *          compile to nothing (arguments aren't even evaluated). Enabled calls store a
+ *          small fixed-size record in a RAM ring buffer, which costs the same few cycles
+ *          whether or not anyone is listening. log_drain() formats records out to Serial
+ *          only as far as the TX buffer has room, and is called from idle time, so a
+ *          debug build keeps the same note timing as a release build. When the ring is
+ *          full new records are counted in log_dropped instead of waiting.
+ */
+
+#ifndef ORCHESTRION_LOG_H
+#define ORCHESTRION_LOG_H
+
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+
+// Override from the build (e.g. -DLOG_LEVEL=LOG_LEVEL_DEBUG) to change what gets compiled in
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+#define LOG_BUFFER_SIZE 64 // records, must be a power of two
+#define LOG_LINE_MAX 128   // longest formatted line, longer ones are cut; leaves a message
+                           // ~80 characters next to the time, level and two values
+
+struct LogRecord {
+  uint32_t time_ms;
+  const char* msg; // string literal, never copied
+  int32_t a;
+  int32_t b;
+  uint8_t level;
+  uint8_t num_args;
+};
+
+static LogRecord log_buffer[LOG_BUFFER_SIZE];
+static uint16_t log_head = 0; // next slot to write
+static uint16_t log_tail = 0; // next slot to drain
+static uint32_t log_dropped = 0;
+static uint32_t log_dropped_reported = 0;
+
+// line currently being drained, written out a few bytes at a time
+static char log_line[LOG_LINE_MAX];
+static uint8_t log_line_len = 0;
+static uint8_t log_line_pos = 0;
+
+/***********************************************************
+ * Function: void log_push(uint8_t level, const char* msg,
+ *                         uint8_t num_args, int32_t a, int32_t b)
+ * Description: Appends one record to the ring buffer, or
+ * counts it as dropped if the ring is full. Never touches
+ * Serial.
+ ***********************************************************/
+void log_push(uint8_t level, const char* msg, uint8_t num_args, int32_t a, int32_t b){
+  uint16_t next = (log_head + 1) & (LOG_BUFFER_SIZE - 1);
+  if(next == log_tail){
+    log_dropped++;
+    return;
+  }
+  LogRecord& rec = log_buffer[log_head];
+  rec.time_ms = millis();
+  rec.msg = msg;
+  rec.a = a;
+  rec.b = b;
+  rec.level = level;
+  rec.num_args = num_args;
+  log_head = next;
+}
+
+/***********************************************************
+ * Function: void log_record(uint8_t level, const char* msg,
+ *                           ...up to two int32_t values)
+ * Description: log_push() with the number of values filled
+ * in. Use the LOG_* macros rather than calling this directly.
+ ***********************************************************/
+void log_record(uint8_t level, const char* msg){
+  log_push(level, msg, 0, 0, 0);
+}
+
+void log_record(uint8_t level, const char* msg, int32_t a){
+  log_push(level, msg, 1, a, 0);
+}
+
+void log_record(uint8_t level, const char* msg, int32_t a, int32_t b){
+  log_push(level, msg, 2, a, b);
+}
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(...) log_record(LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define LOG_ERROR(...) do {} while(0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_WARN(...) log_record(LOG_LEVEL_WARN, __VA_ARGS__)
+#else
+#define LOG_WARN(...) do {} while(0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(...) log_record(LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define LOG_INFO(...) do {} while(0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) log_record(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) do {} while(0)
+#endif
+
+/***********************************************************
+ * Function: bool log_format_next()
+ * Description: Formats the oldest record into log_line, or
+ * once the ring is empty a notice of how many records were
+ * dropped. Returns false if there is nothing to format.
+ ***********************************************************/
+bool log_format_next(){
+  static const char level_chars[] = {'-', 'E', 'W', 'I', 'D'};
+  int len = 0;
+
+  if(log_tail != log_head){
+    const LogRecord& rec = log_buffer[log_tail];
+    char level = level_chars[rec.level <= LOG_LEVEL_DEBUG ? rec.level : 0];
+    if(rec.num_args == 0){
+      len = snprintf(log_line, LOG_LINE_MAX, "%lu %c %s\r\n", (unsigned long)rec.time_ms, level, rec.msg);
+    }else if(rec.num_args == 1){
+      len = snprintf(log_line, LOG_LINE_MAX, "%lu %c %s: %ld\r\n", (unsigned long)rec.time_ms, level,
+                     rec.msg, (long)rec.a);
+    }else{
+      len = snprintf(log_line, LOG_LINE_MAX, "%lu %c %s: %ld, %ld\r\n", (unsigned long)rec.time_ms, level,
+                     rec.msg, (long)rec.a, (long)rec.b);
+    }
+    log_tail = (log_tail + 1) & (LOG_BUFFER_SIZE - 1);
+  }else if(log_dropped != log_dropped_reported){
+    len = snprintf(log_line, LOG_LINE_MAX, "[log] %lu records dropped\r\n",
+                   (unsigned long)(log_dropped - log_dropped_reported));
+    log_dropped_reported = log_dropped;
+  }else{
+    return false;
+  }
+
+  if(len >= LOG_LINE_MAX){ // cut, but keep the line ending
+    len = LOG_LINE_MAX - 1;
+    log_line[len - 2] = '\r';
+    log_line[len - 1] = '\n';
+  }
+  log_line_len = static_cast<uint8_t>(len > 0 ? len : 0);
+  log_line_pos = 0;
+  return true;
+}
+
+// a log line is partway out
+inline bool log_line_pending(){
+  return log_line_pos < log_line_len;
+}
+
+/***********************************************************
+ * Function: void log_drain()
+ * Description: Call from idle time. Writes formatted records
+ * to Serial only while the TX buffer has free space, so it
+ * never blocks; whatever doesn't fit waits for the next call.
+ ***********************************************************/
+void log_drain(){
+  while(true){
+    if(log_line_pos >= log_line_len && !log_format_next()){
+      return;
+    }
+    int room = Serial.availableForWrite();
+    if(room <= 0){
+      return;
+    }
+    int n = log_line_len - log_line_pos;
+    if(n > room){
+      n = room;
+    }
+    Serial.write(reinterpret_cast<const uint8_t*>(log_line + log_line_pos), n);
+    log_line_pos += n;
+    if(log_line_pos < log_line_len){
+      return; // TX buffer is full, pick up here next time
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,366 @@
+/* Filename: orchestrion_ngram_tables.h
+ * Author: Liam Warner
+ * Purpose: n-gram note models for getNextNoteIndex(), one per energy level. GENERATED by
+ *          host/ngram_train (make -C host ngram), don't edit by hand.
+ *          Order 3, prior 2, trained on the lick and chime banks (no MIDI files given).
+ *          ngram_context_row maps a NoteHistory context (the last NGRAM_ORDER notes as
+ *          base-8 digits, newest lowest) to a row of ngram_rows. A history whose last
+ *          note was never followed by another at its level in training is NGRAM_NO_ROW and
+ *          falls back to the hand-typed matrices; every other history has a backed-off row.
+ *          A row is P(note <= i) for i = 0-6 in 1/NGRAM_CDF_ONE steps. 3216 bytes.
+ */
+
+#ifndef ORCHESTRION_NGRAM_TABLES_H
+#define ORCHESTRION_NGRAM_TABLES_H
+
+#define NGRAM_ORDER 3
+#define NGRAM_LEVELS 3
+#define NGRAM_CONTEXTS 512
+#define NGRAM_NUM_ROWS 240
+#define NGRAM_NO_ROW 0xFF
+
+typedef uint8_t ngram_row_t;
+
+static const ngram_row_t ngram_context_row[NGRAM_LEVELS][NGRAM_CONTEXTS] = {
+  {0, 1, 2, 3, 4, 5, 6, 7, 8, 1, 9, 3, 10, 5, 11, 12, 
+   8, 13, 14, 3, 15, 16, 17, 18, 8, 1, 2, 19, 4, 20, 11, 21, 
+   8, 1, 22, 3, 23, 5, 11, 7, 8, 1, 24, 25, 4, 5, 11, 26, 
+   27, 1, 28, 3, 29, 5, 11, 7, 8, 30, 31, 3, 32, 33, 11, 34, 
+   35, 1, 2, 3, 4, 5, 36, 7, 8, 1, 9, 3, 10, 5, 11, 12, 
+   8, 13, 37, 3, 15, 16, 38, 39, 8, 1, 2, 19, 4, 20, 11, 21, 
+   8, 1, 40, 3, 23, 5, 11, 7, 8, 1, 24, 25, 4, 5, 11, 26, 
+   27, 1, 41, 3, 42, 5, 11, 7, 8, 30, 43, 3, 32, 44, 11, 34, 
+   35, 1, 2, 3, 4, 5, 36, 7, 8, 1, 45, 3, 10, 5, 11, 46, 
+   8, 47, 48, 3, 49, 50, 17, 39, 8, 1, 2, 19, 4, 20, 11, 21, 
+   8, 1, 40, 3, 51, 5, 11, 7, 8, 1, 24, 52, 4, 5, 11, 26, 
+   53, 1, 54, 3, 42, 5, 11, 7, 8, 30, 55, 3, 32, 33, 11, 34, 
+   35, 1, 2, 3, 4, 5, 36, 7, 8, 1, 9, 3, 10, 5, 11, 12, 
+   8, 13, 14, 3, 15, 16, 17, 18, 8, 1, 2, 56, 4, 57, 11, 58, 
+   8, 1, 22, 3, 23, 5, 11, 7, 8, 1, 24, 25, 4, 5, 11, 59, 
+   27, 1, 41, 3, 42, 5, 11, 7, 8, 30, 31, 3, 32, 60, 11, 34, 
+   35, 1, 2, 3, 4, 5, 36, 7, 8, 1, 9, 3, 10, 5, 11, 12, 
+   8, 61, 14, 3, 15, 16, 62, 63, 8, 1, 2, 19, 4, 20, 11, 21, 
+   8, 1, 64, 3, 23, 5, 11, 7, 8, 1, 24, 25, 4, 5, 11, 26, 
+   27, 1, 41, 3, 42, 5, 11, 7, 8, 30, 31, 3, 32, 33, 11, 34, 
+   35, 1, 2, 3, 4, 5, 36, 7, 8, 1, 9, 3, 10, 5, 11, 12, 
+   8, 13, 65, 3, 15, 16, 17, 18, 8, 1, 2, 19, 4, 20, 11, 21, 
+   8, 1, 22, 3, 23, 5, 11, 7, 8, 1, 24, 25, 4, 5, 11, 26, 
+   27, 1, 41, 3, 42, 5, 11, 7, 8, 66, 31, 3, 32, 33, 11, 34, 
+   67, 1, 2, 3, 4, 5, 68, 7, 8, 1, 9, 3, 10, 5, 11, 12, 
+   8, 13, 69, 3, 15, 16, 17, 18, 8, 1, 2, 19, 4, 20, 11, 21, 
+   8, 1, 70, 3, 23, 5, 11, 7, 8, 1, 24, 25, 4, 5, 11, 26, 
+   27, 1, 41, 3, 42, 5, 11, 7, 8, 30, 31, 3, 32, 33, 11, 34, 
+   35, 1, 2, 3, 4, 5, 36, 7, 8, 1, 71, 3, 72, 5, 11, 12, 
+   8, 13, 14, 3, 73, 16, 17, 18, 8, 1, 2, 19, 4, 20, 11, 21, 
+   8, 1, 22, 3, 74, 5, 11, 7, 8, 1, 75, 52, 4, 5, 11, 26, 
+   27, 1, 41, 3, 42, 5, 11, 7, 8, 76, 31, 3, 77, 33, 11, 78},
+  {79, 80, 81, 82, 83, 84, 85, 86, 87, 80, 88, 82, 89, 84, 90, 91, 
+   87, 92, 93, 82, 94, 95, 96, 97, 87, 80, 81, 98, 83, 99, 90, 100, 
+   87, 80, 101, 82, 102, 84, 90, 86, 87, 80, 103, 104, 83, 84, 90, 105, 
+   106, 80, 107, 82, 108, 84, 109, 86, 87, 110, 111, 82, 83, 112, 90, 113, 
+   114, 80, 81, 82, 83, 84, 115, 86, 87, 80, 88, 82, 89, 84, 90, 91, 
+   87, 92, 116, 82, 94, 95, 117, 118, 87, 80, 81, 98, 83, 99, 90, 100, 
+   87, 80, 119, 82, 102, 84, 90, 86, 87, 80, 103, 104, 83, 84, 90, 105, 
+   106, 80, 120, 82, 121, 84, 109, 86, 87, 110, 122, 82, 83, 123, 90, 113, 
+   114, 80, 81, 82, 83, 84, 115, 86, 87, 80, 124, 82, 89, 84, 90, 125, 
+   87, 126, 127, 82, 128, 129, 96, 118, 87, 80, 81, 98, 83, 99, 90, 100, 
+   87, 80, 119, 82, 130, 84, 90, 86, 87, 80, 103, 131, 83, 84, 90, 105, 
+   132, 80, 133, 82, 121, 84, 109, 86, 87, 110, 134, 82, 83, 112, 90, 113, 
+   114, 80, 81, 82, 83, 84, 115, 86, 87, 80, 88, 82, 89, 84, 90, 91, 
+   87, 92, 93, 82, 94, 95, 96, 97, 87, 80, 81, 135, 83, 136, 90, 137, 
+   87, 80, 101, 82, 102, 84, 90, 86, 87, 80, 103, 104, 83, 84, 90, 138, 
+   106, 80, 120, 82, 121, 84, 109, 86, 87, 110, 111, 82, 83, 139, 90, 113, 
+   114, 80, 81, 82, 83, 84, 115, 86, 87, 80, 88, 82, 89, 84, 90, 91, 
+   87, 140, 93, 82, 94, 95, 141, 142, 87, 80, 81, 98, 83, 99, 90, 100, 
+   87, 80, 143, 82, 144, 84, 90, 86, 87, 80, 103, 104, 83, 84, 90, 105, 
+   106, 80, 120, 82, 121, 84, 109, 86, 87, 110, 111, 82, 83, 112, 90, 113, 
+   114, 80, 81, 82, 83, 84, 115, 86, 87, 80, 88, 82, 89, 84, 90, 91, 
+   87, 92, 145, 82, 94, 95, 96, 97, 87, 80, 81, 98, 83, 99, 90, 100, 
+   87, 80, 101, 82, 102, 84, 90, 86, 87, 80, 103, 104, 83, 84, 90, 105, 
+   106, 80, 120, 82, 121, 84, 109, 86, 87, 146, 111, 82, 83, 112, 90, 113, 
+   147, 80, 81, 82, 83, 84, 148, 86, 87, 80, 88, 82, 89, 84, 90, 91, 
+   87, 92, 149, 82, 94, 95, 96, 97, 87, 80, 81, 98, 83, 99, 90, 100, 
+   87, 80, 150, 82, 102, 84, 90, 86, 87, 80, 103, 104, 83, 84, 90, 105, 
+   106, 80, 120, 82, 151, 84, 152, 86, 87, 110, 111, 82, 83, 112, 90, 113, 
+   114, 80, 81, 82, 83, 84, 115, 86, 87, 80, 153, 82, 154, 84, 90, 91, 
+   87, 92, 93, 82, 155, 95, 96, 97, 87, 80, 81, 98, 83, 99, 90, 100, 
+   87, 80, 101, 82, 102, 84, 90, 86, 87, 80, 156, 131, 83, 84, 90, 105, 
+   106, 80, 120, 82, 121, 84, 109, 86, 87, 157, 111, 82, 83, 112, 90, 158},
+  {159, 160, 161, 162, 163, 164, 165, 166, 167, 160, 168, 162, 169, 164, 170, 171, 
+   167, 172, 173, 162, 174, 175, 176, 177, 167, 160, 161, 178, 163, 179, 170, 180, 
+   167, 160, 181, 162, 182, 164, 170, 183, 167, 160, 184, 185, 163, 164, 170, 186, 
+   187, 160, 188, 162, 108, 164, 170, 183, 189, 190, 191, 162, 163, 192, 170, 193, 
+   194, 160, 161, 162, 163, 164, 195, 196, 167, 160, 168, 162, 169, 164, 170, 171, 
+   167, 172, 197, 162, 174, 175, 198, 199, 167, 160, 161, 178, 163, 179, 170, 180, 
+   167, 160, 200, 162, 182, 164, 170, 183, 167, 160, 184, 185, 163, 164, 170, 186, 
+   187, 160, 201, 162, 202, 164, 170, 183, 203, 190, 204, 162, 163, 205, 170, 206, 
+   194, 160, 161, 162, 163, 164, 195, 196, 167, 160, 207, 162, 169, 164, 170, 208, 
+   167, 209, 210, 162, 211, 212, 176, 199, 167, 160, 161, 178, 163, 179, 170, 180, 
+   167, 160, 200, 162, 213, 164, 170, 183, 167, 160, 184, 214, 163, 164, 170, 186, 
+   215, 160, 216, 162, 202, 164, 170, 183, 189, 190, 217, 162, 163, 192, 170, 206, 
+   194, 160, 161, 162, 163, 164, 195, 196, 167, 160, 168, 162, 169, 164, 170, 171, 
+   167, 172, 173, 162, 174, 175, 176, 177, 167, 160, 161, 218, 163, 219, 170, 220, 
+   167, 160, 181, 162, 182, 164, 170, 183, 167, 160, 184, 185, 163, 164, 170, 221, 
+   187, 160, 201, 162, 202, 164, 170, 183, 189, 190, 191, 162, 163, 222, 170, 206, 
+   194, 160, 161, 162, 163, 164, 195, 196, 167, 160, 168, 162, 169, 164, 170, 171, 
+   167, 223, 173, 162, 174, 175, 224, 225, 167, 160, 161, 178, 163, 179, 170, 180, 
+   167, 160, 226, 162, 227, 164, 170, 183, 167, 160, 184, 185, 163, 164, 170, 186, 
+   187, 160, 201, 162, 202, 164, 170, 183, 189, 190, 191, 162, 163, 192, 170, 206, 
+   194, 160, 161, 162, 163, 164, 195, 196, 167, 160, 168, 162, 169, 164, 170, 171, 
+   167, 172, 228, 162, 174, 175, 176, 177, 167, 160, 161, 178, 163, 179, 170, 180, 
+   167, 160, 181, 162, 182, 164, 170, 183, 167, 160, 184, 185, 163, 164, 170, 186, 
+   187, 160, 201, 162, 202, 164, 170, 183, 189, 229, 191, 162, 163, 192, 170, 206, 
+   230, 160, 161, 162, 163, 164, 231, 196, 167, 160, 168, 162, 169, 164, 170, 171, 
+   167, 172, 232, 162, 174, 175, 176, 177, 167, 160, 161, 178, 163, 179, 170, 180, 
+   167, 160, 233, 162, 182, 164, 170, 183, 167, 160, 184, 185, 163, 164, 170, 186, 
+   187, 160, 201, 162, 202, 164, 170, 183, 189, 190, 191, 162, 163, 192, 170, 206, 
+   194, 160, 161, 162, 163, 164, 195, 196, 167, 160, 234, 162, 235, 164, 170, 171, 
+   167, 172, 173, 162, 236, 175, 176, 177, 167, 160, 161, 178, 163, 179, 170, 180, 
+   167, 160, 181, 162, 182, 164, 170, 183, 167, 160, 237, 214, 163, 164, 170, 186, 
+   187, 160, 201, 162, 202, 164, 170, 183, 189, 238, 191, 162, 163, 192, 170, 239}
+};
+
+static const uint8_t ngram_rows[NGRAM_NUM_ROWS > 0 ? NGRAM_NUM_ROWS : 1][7] = {
+  {  7,   9,  11,  13,  13,  13, 255},
+  { 13,  26, 115, 128, 153, 153, 153},
+  { 16,  85, 133, 138, 170, 181, 213},
+  { 21,  42,  63,  84,  84, 127, 127},
+  {  9,  18, 191, 200, 255, 255, 255},
+  { 18,  36,  91, 219, 219, 219, 219},
+  {  6,   7,  25,  26, 255, 255, 255},
+  { 29,  98, 167, 177, 196, 255, 255},
+  { 48,  64,  80,  96,  96,  96, 255},
+  {  6,  34, 104, 106, 119, 123, 187},
+  {  6,  12, 212, 218, 255, 255, 255},
+  { 64,  77, 141, 153, 255, 255, 255},
+  { 12,  39, 117, 121, 129, 255, 255},
+  {  4,   8,  70,  73,  80,  80,  80},
+  {  5,  61, 111, 112, 158, 197, 206},
+  {  4,   8, 128, 131, 255, 255, 255},
+  { 12,  24,  61, 231, 231, 231, 231},
+  {128, 133, 209, 214, 255, 255, 255},
+  { 63,  90, 219, 223, 231, 255, 255},
+  { 11,  22,  33,  43,  43, 128, 128},
+  { 12,  24,  61, 146, 146, 146, 146},
+  { 20,  66, 112, 118, 131, 255, 255},
+  {  3, 144, 154, 155, 162, 164, 221},
+  {  4,   8, 230, 233, 255, 255, 255},
+  { 11,  57, 174, 178, 199, 206, 227},
+  { 11,  22,  33,  43,  43,  64,  64},
+  { 20, 151, 197, 203, 216, 255, 255},
+  { 88,  96, 104, 112, 112, 112, 255},
+  {  5,  28, 171, 173, 184, 187, 198},
+  {  1,   2, 248, 249, 255, 255, 255},
+  {  5,  10, 148, 153, 214, 214, 214},
+  { 57,  85, 104, 106, 221, 225, 238},
+  {  6,  12, 127, 133, 255, 255, 255},
+  {  7,  14,  87, 240, 240, 240, 240},
+  { 12, 141, 168, 172, 231, 255, 255},
+  { 16,  22,  27,  32,  32,  32, 255},
+  { 18,  22,  76,  80, 255, 255, 255},
+  {  3,  41, 160, 161, 191, 217, 223},
+  {170, 174, 225, 228, 255, 255, 255},
+  { 42,  60, 231, 234, 239, 255, 255},
+  {  2, 181, 187, 188, 192, 194, 232},
+  {  8,  42, 130, 133, 149, 154, 170},
+  {  3,   6, 234, 237, 255, 255, 255},
+  {123, 141, 154, 155, 232, 235, 244},
+  {  4,   8,  44, 248, 248, 248, 248},
+  {  4,  22,  69,  70,  79,  82, 125},
+  {  5,  16,  98, 100, 103, 255, 255},
+  {  3,   5, 131, 133, 138, 138, 138},
+  {  2,  30,  55,  56, 142, 162, 167},
+  {  3,   5,  85,  87, 255, 255, 255},
+  {  8,  16,  40, 239, 239, 239, 239},
+  {  2,   4, 242, 244, 255, 255, 255},
+  {  7,  14,  21,  28,  28,  42,  42},
+  {108, 112, 116, 120, 120, 120, 255},
+  {  5,  28,  86,  88,  99, 102, 113},
+  { 29,  43,  53,  54, 239, 241, 247},
+  {  6,  11,  16,  21,  21, 127, 127},
+  {  8,  16,  40,  97,  97,  97,  97},
+  { 13,  44,  74,  78,  87, 255, 255},
+  { 13, 185, 216, 220, 229, 255, 255},
+  {  5,  10, 143, 245, 245, 245, 245},
+  {  1,   2,  23,  24,  27,  27,  27},
+  {127, 130, 232, 235, 255, 255, 255},
+  {127, 145, 231, 234, 239, 255, 255},
+  {  1,  72,  77,  78,  81,  82, 238},
+  {  3,  41,  75,  76, 106, 217, 223},
+  {  4,   7,  99, 102, 228, 228, 228},
+  { 11,  15,  18,  21,  21,  21, 255},
+  { 12,  14, 136, 138, 255, 255, 255},
+  {  3, 126, 160, 161, 191, 217, 223},
+  {  1, 175, 178, 179, 181, 182, 201},
+  {  3,  17, 116, 117, 123, 125, 221},
+  {  4,   8, 227, 231, 255, 255, 255},
+  {  2,   4, 128, 130, 255, 255, 255},
+  {  3,   5, 238, 240, 255, 255, 255},
+  {  7,  38, 201, 203, 217, 222, 236},
+  {  3,   6, 202, 204, 235, 235, 235},
+  {  4,   8,  85,  89, 255, 255, 255},
+  {  5, 159, 170, 172, 246, 255, 255},
+  { 10,  13,  16,  18,  19,  20, 254},
+  {  3,  14, 102, 122, 153, 156, 167},
+  { 17,  72, 114, 115, 147, 161, 193},
+  {  4,   9,  13,  30,  34, 106, 123},
+  {  8,  16, 200, 206, 247, 251, 253},
+  {  4,   8,  55, 157, 161, 191, 195},
+  {  9,  10,  35,  36, 252, 253, 254},
+  { 47, 115, 183, 192, 194, 243, 247},
+  { 51,  65,  80,  91,  95, 102, 251},
+  {  7,  29,  97,  98, 110, 116, 179},
+  {  5,  10, 218, 222, 250, 253, 254},
+  { 69,  79, 140, 143, 248, 250, 253},
+  { 24,  58, 156, 160, 161, 249, 251},
+  {  1,   5,  77,  83,  93,  94,  98},
+  {  5,  57, 105, 106, 151, 192, 201},
+  {  3,   6, 131, 133, 251, 253, 254},
+  {  3,   6,  37, 190, 193, 213, 216},
+  {130, 134, 209, 210, 252, 253, 254},
+  {100, 123, 231, 234, 235, 251, 252},
+  {  2,   4,   6,  15,  17, 117, 125},
+  {  3,   6,  37, 105, 108, 128, 131},
+  { 31,  76, 121, 127, 128, 246, 249},
+  {  3, 106, 113, 114, 120, 122, 174},
+  {  3,   6, 233, 235, 251, 253, 254},
+  { 12,  49, 162, 163, 184, 193, 214},
+  {  2,   4,   6,  15,  17,  53,  62},
+  { 31, 161, 206, 212, 213, 246, 249},
+  { 89,  96, 103, 109, 111, 115, 253},
+  {  6,  24, 165, 166, 177, 182, 192},
+  {  1,   2, 246, 247, 252, 253, 254},
+  { 46,  53,  94,  96, 251, 252, 254},
+  {  1,   6, 143, 151, 214, 215, 220},
+  { 58,  80,  97,  98, 212, 218, 230},
+  {  2,   4,  91, 206, 208, 223, 225},
+  { 23, 185, 219, 223, 224, 249, 251},
+  { 20,  26,  32,  36,  38,  41, 254},
+  { 23,  26,  89,  90, 252, 253, 254},
+  {  3,  38, 155, 156, 186, 213, 219},
+  {171, 173, 223, 224, 252, 253, 254},
+  { 67,  82, 238, 240, 241, 252, 253},
+  {  2, 155, 160, 161, 165, 166, 201},
+  {  9,  36, 120, 121, 137, 144, 160},
+  {  3,   5, 236, 238, 252, 253, 254},
+  {124, 139, 150, 151, 227, 231, 239},
+  {  1,   3,  61, 223, 224, 234, 235},
+  {  5,  20,  65,  66,  74,  78, 120},
+  { 12,  29, 141, 143, 144, 252, 253},
+  {  1,   4, 137, 141, 148, 149, 151},
+  {  2,  28,  52,  53, 139, 159, 164},
+  {  2,   4,  87,  88, 252, 253, 254},
+  {  2,   4,  25, 212, 214, 227, 229},
+  {  1,   2, 243, 244, 252, 253, 254},
+  {  1,   3,   4,  10,  11,  35,  41},
+  {108, 111, 115, 118, 119, 121, 254},
+  {  6,  24,  80,  81,  92,  97, 107},
+  { 29,  40,  48,  49, 234, 237, 243},
+  {  1,   2,   3,   7,   8, 122, 126},
+  {  2,   4,  25,  70,  72,  85,  87},
+  { 21,  51,  81,  85,  86, 249, 251},
+  { 21, 193, 223, 227, 228, 249, 251},
+  {  1,   3, 146, 223, 224, 234, 235},
+  {  1,   2,  31,  33,  37,  38,  39},
+  {128, 130, 231, 232, 252, 253, 254},
+  {178, 189, 243, 244, 245, 253, 254},
+  {  1,  42,  45,  46,  48,  49, 172},
+  {  2,   4, 240, 241, 252, 253, 254},
+  {  3,  38,  70,  71, 101, 213, 219},
+  {  1,   4,  95, 100, 227, 228, 231},
+  { 13,  17,  21,  24,  25,  27, 254},
+  { 15,  17, 143, 144, 252, 253, 254},
+  {  3, 123, 155, 156, 186, 213, 219},
+  {  1, 120, 122, 123, 125, 126, 143},
+  {  2,   3, 242, 243, 252, 253, 254},
+  { 31,  36,  63,  64, 252, 253, 254},
+  {  3,  14, 112, 113, 119, 122, 217},
+  {  3,   6, 230, 233, 251, 253, 254},
+  {  1,   2, 128, 129, 252, 253, 254},
+  {  8,  32, 192, 193, 207, 213, 227},
+  {  1,   3, 199, 203, 235, 236, 238},
+  { 12, 220, 237, 239, 240, 252, 253},
+  {  5,   6,   7,   8,   9,  10, 197},
+  {  2,   5,  77,  79, 112, 121, 130},
+  { 11,  73, 115, 116, 151, 165, 200},
+  {  4,   8,  12,  16,  33,  93, 110},
+  {  2,   4, 182, 184, 231, 239, 247},
+  {  4,   8,  48, 161, 175, 190, 204},
+  {  5,   6,  23,  24, 252, 253, 254},
+  { 22,  44,  66,  67,  70,  94, 104},
+  { 53,  56,  58,  61,  71,  81, 219},
+  {  4,  29,  97,  98, 112, 117, 182},
+  {  1,   3, 207, 208, 240, 245, 250},
+  { 54,  57, 110, 113, 225, 235, 245},
+  { 59,  76, 135, 136, 138, 241, 248},
+  {  1,   2,  52,  53,  61,  63,  65},
+  {  3,  57, 105, 106, 152, 193, 203},
+  {  1,   2, 124, 125, 246, 249, 252},
+  {  2,   4,  31, 191, 201, 211, 221},
+  {123, 124, 197, 198, 243, 247, 251},
+  {102, 119, 220, 221, 223, 241, 248},
+  {  2,   4,   6,   8,  17, 111, 119},
+  {  2,   4,  31, 106, 116, 126, 136},
+  { 33,  66,  99, 100, 104, 225, 240},
+  {  2, 129, 137, 138, 144, 146, 199},
+  {  1,   2, 226, 227, 246, 249, 252},
+  { 50, 100, 149, 151, 157, 211, 233},
+  {  7,  48, 161, 162, 185, 195, 218},
+  {  2,   4,   6,   8,  17,  47,  55},
+  { 33, 151, 184, 185, 189, 225, 240},
+  { 91,  92,  93,  94,  99, 104, 237},
+  {  4,  25, 166, 167, 178, 183, 194},
+  {120, 122, 123, 125, 132, 139, 231},
+  {  1,   2, 133, 134, 198, 202, 205},
+  { 55,  80,  97,  98, 214, 219, 233},
+  {  1,   3,  70, 217, 223, 229, 235},
+  { 13,  94, 107, 108, 110, 124, 249},
+  { 15,  16,  17,  18,  21,  24, 209},
+  { 15,  16,  67,  68, 246, 249, 252},
+  { 33,  66,  99, 100, 104, 140, 155},
+  {  2,  38, 155, 156, 187, 214, 220},
+  {167, 168, 216, 217, 247, 250, 252},
+  { 68,  79, 231, 232, 233, 245, 250},
+  {  1, 171, 176, 177, 181, 183, 218},
+  {  6,  37, 122, 123, 140, 147, 164},
+  {  1,   2, 231, 232, 248, 251, 253},
+  {165, 166, 167, 168, 173, 178, 239},
+  {122, 138, 149, 150, 227, 231, 240},
+  {  1,   2,  35, 236, 239, 242, 245},
+  { 20, 142, 162, 163, 165, 186, 246},
+  {  3,  19,  64,  65,  74,  78, 121},
+  { 62,  68, 130, 131, 132, 251, 253},
+  {  1,   2, 120, 121, 126, 127, 128},
+  {  1,  28,  52,  53, 140, 160, 165},
+  {  1,   2,  83,  84, 249, 251, 253},
+  {  2,   4,  22, 214, 220, 226, 232},
+  {  1,   2, 242, 243, 252, 253, 254},
+  {  1,   3,   4,   5,  11,  31,  37},
+  {109, 110, 111, 112, 114, 116, 246},
+  {  4,  25,  81,  82,  93,  98, 109},
+  { 28,  40,  48,  49, 234, 237, 244},
+  {  1,   2,   3,   4,   8, 119, 123},
+  {  2,   4,  22,  72,  78,  85,  91},
+  { 22,  44,  66,  67,  70, 235, 245},
+  { 22, 185, 207, 208, 211, 235, 245},
+  {  1,   2, 132, 230, 234, 238, 242},
+  {  1,   2,  16,  17,  19,  20,  21},
+  {125, 126, 226, 227, 249, 251, 253},
+  {178, 186, 237, 238, 239, 248, 251},
+  {  1,  52,  55,  56,  58,  59, 182},
+  {  1,   2, 236, 237, 249, 251, 253},
+  {  2,  38,  70,  71, 102, 214, 220},
+  {  1,   2,  89,  90, 218, 220, 222},
+  { 10,  11,  12,  13,  14,  16, 224},
+  { 10,  11, 130, 131, 249, 251, 253},
+  {  2, 123, 155, 156, 187, 214, 220},
+  {  1, 171, 173, 174, 176, 177, 194},
+  {  2,  14, 112, 113, 120, 123, 219},
+  {  1,   2, 223, 224, 245, 249, 252},
+  {  1,   2, 127, 128, 252, 253, 254},
+  {  5,  33, 193, 194, 209, 215, 230},
+  {  1,   2, 195, 196, 228, 229, 230},
+  { 10, 198, 208, 209, 210, 221, 251}
+};
+
+#endif
@@ -0,0 +1,202 @@
+/* Filename: orchestrion_perf.h
+ * Author: Liam Warner
+ * Purpose: runtime timing counters for the field. Fixed-bucket histograms in static RAM
+ *          (loop period, note-off lateness, onset error against the beat grid, I2C and SPI
+ *          time, and the MIDI, sensor, scheduler and autonomous mode stages), filled by
+ *          PERF_SCOPE timers and PERF_RECORD calls. Sending 'p' over Serial dumps them one
+ *          compact line per histogram, 'r' clears them (serial_command_poll() in
+ *          midi_autonomous_performance_v4.h takes the commands); the dump is written out
+ *          only as the TX buffer has room, like the log. Build with -DPERF_ENABLED=0 and every PERF_*
+ *          macro compiles to nothing (arguments aren't evaluated) and the tables aren't built.
+ *          Times come from micros(), the SAMD21's M0+ core has no cycle counter.
+ */
+
+#ifndef ORCHESTRION_PERF_H
+#define ORCHESTRION_PERF_H
+
+// Override from the build (-DPERF_ENABLED=0) to compile all instrumentation out
+#ifndef PERF_ENABLED
+#define PERF_ENABLED 1
+#endif
+
+enum PerfHist {
+  PERF_LOOP_PERIOD = 0, // start of one loop() to the next
+  PERF_NOTE_OFF_LATE,   // note-off carried out vs when it was due (get_solenoid_on_delay after the strike)
+  PERF_ONSET_ERROR,     // lick/sequence note struck vs its time on the transport grid
+  PERF_I2C,             // one ADC or RTC read
+  PERF_SPI,             // one TPIC transaction
+  PERF_MIDI_STAGE,      // read_midi()
+  PERF_SENSOR_STAGE,    // read_sensor_vals()
+  PERF_SCHED_STAGE,     // scheduler_run_due()
+  PERF_AUTO_STAGE,      // auto_mode_step()
+  PERF_NUM_HISTS
+};
+
+#if PERF_ENABLED
+
+#define PERF_BUCKETS 16 // bucket 0 is 0 us, bucket k is [2^(k-1), 2^k) us, the last one is open ended
+#define PERF_LINE_MAX 192
+
+struct PerfHistogram {
+  uint32_t count;
+  uint32_t max_us;
+  uint32_t sum_us; // wraps after ~71 minutes of total time, the mean is only for short runs
+  uint32_t buckets[PERF_BUCKETS];
+};
+
+static PerfHistogram perf_hists[PERF_NUM_HISTS];
+static const char* const perf_hist_names[PERF_NUM_HISTS] = {
+  "loop", "off_late", "onset_err", "i2c", "spi", "midi", "sensor", "sched", "auto"
+};
+
+static int8_t perf_dump_next = -1; // histogram to format next, -1 = no dump in progress
+static char perf_line[PERF_LINE_MAX];
+static uint8_t perf_line_len = 0;
+static uint8_t perf_line_pos = 0;
+
+/***********************************************************
+ * Function: void perf_record(uint8_t hist, uint32_t us)
+ * Description: Adds one sample. Finding the bucket is a count
+ * of leading zeros, so this is a handful of instructions.
+ ***********************************************************/
+inline void perf_record(uint8_t hist, uint32_t us){
+  PerfHistogram& h = perf_hists[hist];
+  int bucket = us == 0 ? 0 : 32 - __builtin_clz(us);
+  if(bucket >= PERF_BUCKETS){
+    bucket = PERF_BUCKETS - 1;
+  }
+  h.buckets[bucket]++;
+  h.count++;
+  h.sum_us += us;
+  if(us > h.max_us){
+    h.max_us = us;
+  }
+}
+
+// how late now_us is against due_us, early counts as 0
+inline void perf_record_late(uint8_t hist, uint32_t now_us, uint32_t due_us){
+  int32_t late = static_cast<int32_t>(now_us - due_us);
+  perf_record(hist, late > 0 ? static_cast<uint32_t>(late) : 0);
+}
+
+// Times the enclosing block into a histogram
+class PerfScope {
+public:
+  explicit PerfScope(uint8_t hist) : hist_(hist), start_us_(micros()) {}
+  ~PerfScope(){ perf_record(hist_, micros() - start_us_); }
+private:
+  uint8_t hist_;
+  uint32_t start_us_;
+};
+
+#define PERF_CONCAT_(a, b) a##b
+#define PERF_CONCAT(a, b) PERF_CONCAT_(a, b)
+#define PERF_SCOPE(hist) PerfScope PERF_CONCAT(perf_scope_, __LINE__)(hist)
+#define PERF_RECORD(hist, us) perf_record((hist), (us))
+#define PERF_RECORD_LATE(hist, now_us, due_us) perf_record_late((hist), (now_us), (due_us))
+
+/***********************************************************
+ * Function: void perf_reset()
+ * Description: Clears every histogram.
+ ***********************************************************/
+void perf_reset(){
+  memset(perf_hists, 0, sizeof(perf_hists));
+}
+
+/***********************************************************
+ * Function: bool perf_format_next()
+ * Description: Formats the next histogram of a dump into
+ * perf_line as "#perf name count max_us sum_us: b0 b1 ...",
+ * leaving out trailing empty buckets. False when the dump is
+ * done.
+ ***********************************************************/
+bool perf_format_next(){
+  if(perf_dump_next < 0 || perf_dump_next >= PERF_NUM_HISTS){
+    perf_dump_next = -1;
+    return false;
+  }
+  const PerfHistogram& h = perf_hists[perf_dump_next];
+  int len = snprintf(perf_line, PERF_LINE_MAX, "#perf %s %lu %lu %lu:", perf_hist_names[perf_dump_next],
+                     (unsigned long)h.count, (unsigned long)h.max_us, (unsigned long)h.sum_us);
+  int last = PERF_BUCKETS - 1;
+  while(last > 0 && h.buckets[last] == 0){
+    last--;
+  }
+  for(int b = 0; b <= last && len < PERF_LINE_MAX; b++){
+    len += snprintf(perf_line + len, PERF_LINE_MAX - len, " %lu", (unsigned long)h.buckets[b]);
+  }
+  if(len > PERF_LINE_MAX - 3){ // cut, but keep the line ending
+    len = PERF_LINE_MAX - 3;
+  }
+  perf_line[len++] = '\r';
+  perf_line[len++] = '\n';
+  perf_line_len = static_cast<uint8_t>(len);
+  perf_line_pos = 0;
+  perf_dump_next++;
+  return true;
+}
+
+/***********************************************************
+ * Function: bool perf_command(int c)
+ * Description: 'p' starts a dump (if none is in progress), 'r'
+ * clears the histograms. False for any other command.
+ ***********************************************************/
+bool perf_command(int c){
+  if(c == 'p'){
+    if(perf_dump_next < 0){
+      perf_dump_next = 0;
+    }
+    return true;
+  }
+  if(c == 'r'){
+    perf_reset();
+    return true;
+  }
+  return false;
+}
+
+// a dump line is partway out
+inline bool perf_line_pending(){
+  return perf_line_pos < perf_line_len;
+}
+
+/***********************************************************
+ * Function: void perf_poll()
+ * Description: Call from idle time. Writes any dump in
+ * progress only as far as the TX buffer has room, so it never
+ * blocks. Commands come in through serial_command_poll().
+ ***********************************************************/
+void perf_poll(){
+  while(true){
+    if(perf_line_pos >= perf_line_len && !perf_format_next()){
+      return;
+    }
+    int room = Serial.availableForWrite();
+    if(room <= 0){
+      return;
+    }
+    int n = perf_line_len - perf_line_pos;
+    if(n > room){
+      n = room;
+    }
+    Serial.write(reinterpret_cast<const uint8_t*>(perf_line + perf_line_pos), n);
+    perf_line_pos += n;
+    if(perf_line_pos < perf_line_len){
+      return; // TX buffer is full, pick up here next time
+    }
+  }
+}
+
+#else
+
+#define PERF_SCOPE(hist) do {} while(0)
+#define PERF_RECORD(hist, us) do {} while(0)
+#define PERF_RECORD_LATE(hist, now_us, due_us) do {} while(0)
+inline void perf_poll(){}
+inline void perf_reset(){}
+inline bool perf_command(int){ return false; }
+inline bool perf_line_pending(){ return false; }
+
+#endif
+
+#endif
@@ -0,0 +1,133 @@
+/* Filename: orchestrion_rng.h
+ * Author: Liam Warner
+ * Purpose: the random number engine for autonomous mode, xoshiro128** (Blackman and Vigna).
+ *          Four 32-bit words of state and only 32-bit shifts, rotates and multiplies by 5
+ *          and 9, so it is cheap on the M0+. There is one engine, R, and everything that
+ *          draws takes it by reference, so no draw is ever repeated from a copied state.
+ *          Integer ranges are unbiased (masked rejection) and chances are integer compares.
+ *          setup() seeds it once with rng_seed_from_hardware(), from the RTC time, ADC
+ *          noise and micros(), and logs the seed. Setting rng_fixed_seed before setup()
+ *          seeds with that instead, which replays the same performance in the host
+ *          simulator (orchestrion_sim --rng-seed). The seed also goes into the input trace.
+ */
+
+#ifndef ORCHESTRION_RNG_H
+#define ORCHESTRION_RNG_H
+
+struct Rng {
+  uint32_t s[4];
+};
+
+// any state but all zeros works, this one is rng_seed(R, 1), used until setup() seeds it
+static Rng R = {{0x96A0F96Bu, 0x12BC8390u, 0x971E9964u, 0x79ADC7E7u}};
+
+static uint32_t rng_fixed_seed = 0; // nonzero: setup() seeds with this, not the hardware
+static uint32_t rng_seed_used = 0;  // what the engine was last seeded with
+
+inline uint32_t rng_rotl(uint32_t x, int k){
+  return (x << k) | (x >> (32 - k));
+}
+
+/***********************************************************
+ * Function: uint32_t rng_next(Rng& r)
+ * Description: Next 32 random bits.
+ ***********************************************************/
+inline uint32_t rng_next(Rng& r){
+  uint32_t result = rng_rotl(r.s[1] * 5, 7) * 9;
+  uint32_t t = r.s[1] << 9;
+  r.s[2] ^= r.s[0];
+  r.s[3] ^= r.s[1];
+  r.s[1] ^= r.s[2];
+  r.s[0] ^= r.s[3];
+  r.s[2] ^= t;
+  r.s[3] = rng_rotl(r.s[3], 11);
+  return result;
+}
+
+/***********************************************************
+ * Function: void rng_seed(Rng& r, uint32_t seed)
+ * Description: Fills the state from seed with splitmix32, so
+ * nearby seeds still give unrelated sequences and the state
+ * is never all zeros.
+ ***********************************************************/
+void rng_seed(Rng& r, uint32_t seed){
+  rng_seed_used = seed;
+  for(int i = 0; i < 4; i++){
+    seed += 0x9E3779B9u;
+    uint32_t z = seed;
+    z = (z ^ (z >> 16)) * 0x85EBCA6Bu;
+    z = (z ^ (z >> 13)) * 0xC2B2AE35u;
+    r.s[i] = z ^ (z >> 16);
+  }
+}
+
+/***********************************************************
+ * Function: uint32_t rng_below(Rng& r, uint32_t n)
+ * Description: Uniform in [0, n), 0 if n is 0. Draws with the
+ * bits above n's top bit masked off until one is below n,
+ * under 2 draws on average.
+ ***********************************************************/
+uint32_t rng_below(Rng& r, uint32_t n){
+  if(n <= 1){
+    return 0;
+  }
+  uint32_t mask = n - 1;
+  mask |= mask >> 1;
+  mask |= mask >> 2;
+  mask |= mask >> 4;
+  mask |= mask >> 8;
+  mask |= mask >> 16;
+  uint32_t x;
+  do {
+    x = rng_next(r) & mask;
+  } while(x >= n);
+  return x;
+}
+
+// uniform in [lo, hi], both ends included
+inline int rng_range(Rng& r, int lo, int hi){
+  return hi <= lo ? lo : lo + static_cast<int>(rng_below(r, static_cast<uint32_t>(hi - lo) + 1));
+}
+
+// true with probability num / den
+inline bool rng_chance(Rng& r, uint32_t num, uint32_t den){
+  return rng_below(r, den) < num;
+}
+
+// true with probability p, to 1/2^24
+inline bool rng_chance(Rng& r, float p){
+  if(p <= 0){
+    return false;
+  }
+  if(p >= 1){
+    return true;
+  }
+  return (rng_next(r) >> 8) < static_cast<uint32_t>(p * 16777216.0f);
+}
+
+/***********************************************************
+ * Function: void rng_seed_from_hardware()
+ * Description: Seeds R from the RTC time of day, the low bits
+ * of 32 ADC reads (sensor noise) and micros() since power up,
+ * or from rng_fixed_seed if that is set. Logs the seed, so a
+ * performance can be played again in the simulator, and puts
+ * it in the input trace.
+ ***********************************************************/
+void rng_seed_from_hardware(){
+  //the reads are made even with a fixed seed, so setup() takes as long either way
+  uint32_t seed = static_cast<uint32_t>((hal_rtc_hour() * 60 + hal_rtc_minute()) * 60 + hal_rtc_second());
+  for(int i = 0; i < 32; i++){
+    seed = rng_rotl(seed, 5) ^ (hal_adc_read(static_cast<uint8_t>(i & 7)) & 0x03);
+  }
+  seed ^= micros() * 0x9E3779B9u;
+  seed &= 0x7FFFFFFF; //logs as a positive number
+  seed = seed == 0 ? 1 : seed;
+  if(rng_fixed_seed != 0){
+    seed = rng_fixed_seed;
+  }
+  rng_seed(R, seed);
+  TRACE_SEED_USED(seed); //micros() differs on every board, a replay needs the seed itself
+  LOG_INFO("Random seed", static_cast<int32_t>(seed));
+}
+
+#endif
@@ -0,0 +1,122 @@
+/* Filename: orchestrion_schedule.h
+ * Author: Liam Warner
+ * Purpose: the drum's daily schedule as a table instead of hour if-chains spread over the
+ *          lick functions. Time of day comes from a copy of the DS3231 time extrapolated
+ *          with millis() and re-read from the RTC every SCHEDULE_RESYNC_MS, and the table
+ *          is only evaluated when the minute changes. Everything else reads the cached
+ *          schedule_now, so the lick loop does no RTC bus traffic in between.
+ */
+
+#ifndef ORCHESTRION_SCHEDULE_H
+#define ORCHESTRION_SCHEDULE_H
+
+#define SCHEDULE_CHIME_MINUTE 55     // hourly chime plays at hh:55
+#define SCHEDULE_RESYNC_MS 600000UL  // re-read the RTC every 10 minutes to correct millis() drift
+
+// One band of the day, in effect from start_hour until the next band's start_hour
+struct ScheduleBand {
+  uint8_t start_hour;
+  uint8_t quiet;         // 1 = no licks (chimes still play)
+  uint8_t bpm_percent;   // lick bpm as a percentage of the base bpm
+  uint8_t energy_level;  // energy level of the licks picked
+  uint8_t wait_measures; // measures between licks with nobody near the drum
+};
+
+// on 4/14 quiet time was changed to last until 10pm -> supports interaction around showtimes
+const ScheduleBand schedule_bands[] = {
+  { 0, 1,  80, 1, 16},
+  { 9, 0,  80, 1, 16},
+  {10, 0, 110, 2,  8},
+  {14, 0, 120, 3,  4},
+  {18, 0, 120, 1, 16},
+  {20, 1, 120, 1, 16},
+  {22, 1, 100, 1, 16},
+};
+const int NUM_SCHEDULE_BANDS = sizeof(schedule_bands) / sizeof(schedule_bands[0]);
+
+struct ScheduleState {
+  ScheduleBand band;      // band in effect now
+  uint16_t minute_of_day; // 0-1439, when the table was last evaluated
+  bool chime_pending;     // set on reaching SCHEDULE_CHIME_MINUTE, cleared by whoever plays it
+};
+static ScheduleState schedule_now = {schedule_bands[0], 0, false};
+
+static uint32_t schedule_sync_ms = 0;      // millis() when the RTC was last read
+static uint32_t schedule_sync_seconds = 0; // RTC time of day (s) at schedule_sync_ms
+static uint32_t schedule_next_eval_ms = 0; // millis() of the next minute boundary
+static bool schedule_synced = false;
+static bool schedule_evaluated = false;
+static uint32_t schedule_rtc_syncs = 0;
+
+/***********************************************************
+ * Function: void schedule_sync_clock()
+ * Description: Reads the time of day from the RTC. Seconds
+ * are read before and after hour/minute; if they wrapped in
+ * between, the minute may have rolled over, so it reads again.
+ ***********************************************************/
+void schedule_sync_clock(){
+  int second, minute, hour;
+  do {
+    second = hal_rtc_second();
+    minute = hal_rtc_minute();
+    hour = hal_rtc_hour();
+  } while(hal_rtc_second() < second);
+
+  schedule_sync_ms = millis();
+  schedule_sync_seconds = static_cast<uint32_t>(hour) * 3600 + minute * 60 + second;
+  schedule_synced = true;
+  schedule_rtc_syncs++;
+}
+
+/***********************************************************
+ * Function: uint32_t schedule_seconds_of_day()
+ * Description: Current time of day in seconds from the cached
+ * RTC time, re-syncing first if it is due.
+ ***********************************************************/
+uint32_t schedule_seconds_of_day(){
+  if(!schedule_synced || millis() - schedule_sync_ms >= SCHEDULE_RESYNC_MS){
+    schedule_sync_clock();
+  }
+  return (schedule_sync_seconds + (millis() - schedule_sync_ms) / 1000) % 86400UL;
+}
+
+/***********************************************************
+ * Function: const ScheduleBand& schedule_band_at(int hour)
+ * Description: The band in effect at an hour of the day.
+ ***********************************************************/
+const ScheduleBand& schedule_band_at(int hour){
+  int b = 0;
+  while(b + 1 < NUM_SCHEDULE_BANDS && schedule_bands[b + 1].start_hour <= hour){
+    b++;
+  }
+  return schedule_bands[b];
+}
+
+/***********************************************************
+ * Function: bool schedule_poll()
+ * Description: Cheap to call every pass. Only when a minute
+ * boundary has passed does it look at the time and the table
+ * and update schedule_now (and raise chime_pending at the
+ * chime minute). Returns true if it re-evaluated.
+ ***********************************************************/
+bool schedule_poll(){
+  if(schedule_evaluated && static_cast<int32_t>(millis() - schedule_next_eval_ms) < 0){
+    return false;
+  }
+
+  uint32_t seconds = schedule_seconds_of_day();
+  uint16_t minute_of_day = static_cast<uint16_t>(seconds / 60);
+  if(!schedule_evaluated || minute_of_day != schedule_now.minute_of_day){
+    schedule_now.band = schedule_band_at(minute_of_day / 60);
+    //only on reaching the chime minute, powering up during it doesn't chime
+    if(schedule_evaluated && minute_of_day % 60 == SCHEDULE_CHIME_MINUTE){
+      schedule_now.chime_pending = true;
+    }
+    schedule_now.minute_of_day = minute_of_day;
+    schedule_evaluated = true;
+  }
+  schedule_next_eval_ms = millis() + (60 - seconds % 60) * 1000UL;
+  return true;
+}
+
+#endif
@@ -0,0 +1,120 @@
+/* Filename: orchestrion_scheduler.h
+ * Author: Liam Warner
+ * Purpose: fixed-capacity priority queue of timed events (note-on, note-off, ...) keyed on
+ *          micros(). The performance code pushes an event for every deadline it cares
+ *          about and the main loop only does work when the earliest one is due, instead of
+ *          every mode scanning all 8 note timers on each pass. Handling of the events
+ *          lives with the note functions in midi_autonomous_performance_v4.h.
+ */
+
+#ifndef ORCHESTRION_SCHEDULER_H
+#define ORCHESTRION_SCHEDULER_H
+
+#define SCHED_CAPACITY 32
+
+enum SchedEventType {
+  EVENT_NOTE_ON = 0,  // strike note_index at velocity
+  EVENT_NOTE_OFF = 1, // release note_index if strike_id still matches its current strike
+  EVENT_RETRIGGER = 2, // strike the oldest held-back repeat of note_index (live MIDI)
+};
+
+struct SchedEvent {
+  uint32_t due_us;
+  uint8_t type;
+  int8_t note_index;
+  uint8_t velocity;
+  uint8_t strike_id; // lets a stale note-off be ignored after the note was re-struck or released
+};
+
+// binary min-heap on due_us
+static SchedEvent sched_heap[SCHED_CAPACITY];
+static uint8_t sched_count = 0;
+static uint32_t sched_overflows = 0;
+
+/***********************************************************
+ * Function: bool sched_before(uint32_t a, uint32_t b)
+ * Description: True if time a comes before time b. Works
+ * across the 71 minute micros() wraparound as long as the
+ * two are less than 35 minutes apart.
+ ***********************************************************/
+inline bool sched_before(uint32_t a, uint32_t b){
+  return static_cast<int32_t>(a - b) < 0;
+}
+
+/***********************************************************
+ * Function: bool sched_push(SchedEvent ev)
+ * Description: Queues an event. Returns false (and counts an
+ * overflow) if the queue is full.
+ ***********************************************************/
+bool sched_push(SchedEvent ev){
+  if(sched_count >= SCHED_CAPACITY){
+    sched_overflows++;
+    return false;
+  }
+  uint8_t i = sched_count++;
+  while(i > 0){
+    uint8_t parent = (i - 1) / 2;
+    if(!sched_before(ev.due_us, sched_heap[parent].due_us)){
+      break;
+    }
+    sched_heap[i] = sched_heap[parent];
+    i = parent;
+  }
+  sched_heap[i] = ev;
+  return true;
+}
+
+/***********************************************************
+ * Function: bool sched_pop_due(uint32_t now_us, SchedEvent &ev)
+ * Description: Removes the earliest event into ev if it is
+ * due at now_us. Returns false if nothing is due yet.
+ ***********************************************************/
+bool sched_pop_due(uint32_t now_us, SchedEvent &ev){
+  if(sched_count == 0 || sched_before(now_us, sched_heap[0].due_us)){
+    return false;
+  }
+  ev = sched_heap[0];
+  SchedEvent last = sched_heap[--sched_count];
+  uint8_t i = 0;
+  while(true){
+    uint8_t child = 2 * i + 1;
+    if(child >= sched_count){
+      break;
+    }
+    if(child + 1 < sched_count && sched_before(sched_heap[child + 1].due_us, sched_heap[child].due_us)){
+      child++;
+    }
+    if(!sched_before(sched_heap[child].due_us, last.due_us)){
+      break;
+    }
+    sched_heap[i] = sched_heap[child];
+    i = child;
+  }
+  if(sched_count > 0){
+    sched_heap[i] = last;
+  }
+  return true;
+}
+
+/***********************************************************
+ * Function: bool sched_next_due(uint32_t &due_us)
+ * Description: Earliest pending deadline, false if the
+ * queue is empty.
+ ***********************************************************/
+bool sched_next_due(uint32_t &due_us){
+  if(sched_count == 0){
+    return false;
+  }
+  due_us = sched_heap[0].due_us;
+  return true;
+}
+
+/***********************************************************
+ * Function: void sched_clear()
+ * Description: Drops every pending event.
+ ***********************************************************/
+void sched_clear(){
+  sched_count = 0;
+}
+
+#endif
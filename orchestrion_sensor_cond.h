@@ -0,0 +1,103 @@
+/* Filename: orchestrion_sensor_cond.h
+ * Author: Liam Warner
+ * Purpose: conditioning between the sensor scan and the code that reacts to hands. Each
+ *          published frame goes through sensor_cond_update(): a per-channel exponential
+ *          moving average in 8.8 fixed point, hysteresis bands (a channel has to rise past
+ *          "on" to count and fall below "off" to stop counting, so noise around a single
+ *          threshold can't chatter) and a rate of change measured against the frame
+ *          timestamps rather than loop timing. A hand approaching fast strikes one
+ *          velocity level harder (sensor_rate_velocity). Integer math only.
+ */
+
+#ifndef ORCHESTRION_SENSOR_COND_H
+#define ORCHESTRION_SENSOR_COND_H
+
+#define SENSOR_EMA_SHIFT 2            // new sample weight 1/4, ~16 ms time constant at 4 ms frames
+#define SENSOR_RATE_WINDOW_US 100000  // rate of change is measured over at least this long
+#define SENSOR_RATE_STALE_US 1000000  // a reference older than this (scan paused) starts the rate over at 0
+#define SENSOR_FAST_APPROACH 400      // counts/s, a hand closing in this fast strikes one level harder
+
+// Hysteresis band, bit i of mask is set while channel i is "in" the band
+struct SensorBand {
+  uint8_t on;  // level at or above which a channel enters
+  uint8_t off; // level below which it leaves
+  uint8_t mask;
+};
+
+static uint16_t sensor_ema_q8[SENSOR_CHANNELS] = {0};
+static uint8_t sensor_levels[SENSOR_CHANNELS] = {0}; // smoothed, 0-255
+static int16_t sensor_rate[SENSOR_CHANNELS] = {0};   // smoothed counts per second, + is approaching
+static uint8_t sensor_rate_ref[SENSOR_CHANNELS] = {0};
+static uint32_t sensor_rate_ref_us = 0;
+static bool sensor_cond_primed = false;
+
+/***********************************************************
+ * Function: void sensor_band_update(SensorBand& band, const uint8_t* levels)
+ * Description: Moves each channel in or out of the band.
+ ***********************************************************/
+void sensor_band_update(SensorBand& band, const uint8_t* levels){
+  for(int i = 0; i < SENSOR_CHANNELS; i++){
+    uint8_t bit = 1 << i;
+    if(levels[i] >= band.on){
+      band.mask |= bit;
+    }else if(levels[i] < band.off){
+      band.mask &= ~bit;
+    }
+  }
+}
+
+inline bool sensor_in_band(const SensorBand& band, int channel){
+  return (band.mask >> channel) & 1;
+}
+
+/***********************************************************
+ * Function: void sensor_cond_update(const SensorFrame& frame)
+ * Description: Folds a new frame into the smoothed levels and,
+ * once SENSOR_RATE_WINDOW_US has passed since the last
+ * reference, updates the rate of change from the level
+ * difference and the real time between the two (0 if the
+ * reference is stale, the scan was paused). The first
+ * frame seeds the averages so they don't ramp up from 0.
+ ***********************************************************/
+void sensor_cond_update(const SensorFrame& frame){
+  for(int i = 0; i < SENSOR_CHANNELS; i++){
+    if(!sensor_cond_primed){
+      sensor_ema_q8[i] = static_cast<uint16_t>(frame.values[i]) << 8;
+    }else{
+      int32_t delta = (static_cast<int32_t>(frame.values[i]) << 8) - sensor_ema_q8[i];
+      sensor_ema_q8[i] = static_cast<uint16_t>(sensor_ema_q8[i] + (delta >> SENSOR_EMA_SHIFT));
+    }
+    sensor_levels[i] = static_cast<uint8_t>((sensor_ema_q8[i] + 0x80) >> 8); // at most 255 << 8, can't overflow
+  }
+
+  if(!sensor_cond_primed){
+    sensor_cond_primed = true;
+    sensor_rate_ref_us = frame.time_us;
+    for(int i = 0; i < SENSOR_CHANNELS; i++){
+      sensor_rate_ref[i] = sensor_levels[i];
+    }
+    return;
+  }
+
+  uint32_t dt_us = frame.time_us - sensor_rate_ref_us; // unsigned, fine across the micros() wrap
+  if(dt_us >= SENSOR_RATE_WINDOW_US){
+    for(int i = 0; i < SENSOR_CHANNELS; i++){
+      int32_t diff = static_cast<int32_t>(sensor_levels[i]) - sensor_rate_ref[i];
+      if(dt_us > SENSOR_RATE_STALE_US){
+        sensor_rate[i] = 0;
+      }else{
+        //|diff| <= 255 and dt_us <= 1 s, so this fits 32 bits and the result 16
+        sensor_rate[i] = static_cast<int16_t>(diff * 1000000L / static_cast<int32_t>(dt_us));
+      }
+      sensor_rate_ref[i] = sensor_levels[i];
+    }
+    sensor_rate_ref_us = frame.time_us;
+  }
+}
+
+// velocity one level harder (at most 3) while channel's hand is closing in fast
+inline int sensor_rate_velocity(int channel, int velocity){
+  return (sensor_rate[channel] >= SENSOR_FAST_APPROACH && velocity < 3) ? velocity + 1 : velocity;
+}
+
+#endif
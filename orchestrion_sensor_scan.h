@@ -0,0 +1,63 @@
+/* Filename: orchestrion_sensor_scan.h
+ * Author: Liam Warner
+ * Purpose: background acquisition of the 8 ADS7830 proximity channels. sensor_scan_step()
+ *          reads one channel (a single short I2C transaction) and returns, and is paced so
+ *          calling it from every idle moment never turns into back to back bus traffic.
+ *          Channels are collected into a back frame; when all 8 are in, the frame gets a
+ *          sequence number and timestamp and is swapped to the front. Readers only ever
+ *          see the front frame, which is complete and doesn't change until the next swap.
+ */
+
+#ifndef ORCHESTRION_SENSOR_SCAN_H
+#define ORCHESTRION_SENSOR_SCAN_H
+
+#define SENSOR_CHANNELS 8
+#define SENSOR_SCAN_STEP_US 500 // one channel per step, a full frame every 4 ms
+
+struct SensorFrame {
+  uint8_t values[SENSOR_CHANNELS];
+  uint32_t seq;     // frames published since power up, 0 until the first one
+  uint32_t time_us; // micros() when the last channel of the frame was read
+};
+
+static SensorFrame sensor_frames[2];
+static uint8_t sensor_front = 0;        // index of the published frame
+static uint8_t sensor_scan_channel = 0; // next channel to read into the back frame
+static uint32_t sensor_scan_next_us = 0;
+static uint32_t sensor_scan_seq = 0;
+
+/***********************************************************
+ * Function: const SensorFrame& sensor_frame()
+ * Description: The latest complete frame. Never blocks.
+ ***********************************************************/
+inline const SensorFrame& sensor_frame(){
+  return sensor_frames[sensor_front];
+}
+
+/***********************************************************
+ * Function: bool sensor_scan_step()
+ * Description: Reads the next channel into the back frame if
+ * the scan is due, otherwise returns straight away. Returns
+ * true when the read finished a frame and it was published.
+ ***********************************************************/
+bool sensor_scan_step(){
+  uint32_t now = micros();
+  if(static_cast<int32_t>(now - sensor_scan_next_us) < 0){
+    return false;
+  }
+  sensor_scan_next_us = now + SENSOR_SCAN_STEP_US;
+
+  SensorFrame& back = sensor_frames[sensor_front ^ 1];
+  back.values[sensor_scan_channel] = hal_adc_read(sensor_scan_channel);
+  if(++sensor_scan_channel < SENSOR_CHANNELS){
+    return false;
+  }
+
+  sensor_scan_channel = 0;
+  back.seq = ++sensor_scan_seq;
+  back.time_us = micros();
+  sensor_front ^= 1;
+  return true;
+}
+
+#endif
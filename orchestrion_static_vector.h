@@ -0,0 +1,91 @@
+/* Filename: orchestrion_static_vector.h
+ * Author: Liam Warner
+ * Purpose: fixed-capacity vector stored inline, used for the notes of a Lick instead of
+ *          std::vector. Never touches the heap, copies are plain memberwise copies, and
+ *          insert/erase/push_back return false instead of growing when there is no room,
+ *          so the bank of licks can be edited for weeks without fragmenting memory.
+ */
+
+#ifndef ORCHESTRION_STATIC_VECTOR_H
+#define ORCHESTRION_STATIC_VECTOR_H
+
+#include <initializer_list>
+
+template<class T, int N>
+class StaticVector {
+public:
+  StaticVector() : count(0) {}
+
+  // so banks can still be written as {{...}, {...}}, anything past N is left out
+  StaticVector(std::initializer_list<T> init) : count(0) {
+    for(const T* it = init.begin(); it != init.end() && count < N; ++it){
+      items[count++] = *it;
+    }
+  }
+
+  int size() const { return count; }
+  int capacity() const { return N; }
+  bool empty() const { return count == 0; }
+  bool full() const { return count >= N; }
+
+  T& operator[](int i){ return items[i]; }
+  const T& operator[](int i) const { return items[i]; }
+
+  T* begin(){ return items; }
+  T* end(){ return items + count; }
+  const T* begin() const { return items; }
+  const T* end() const { return items + count; }
+
+  void clear(){ count = 0; }
+
+  /***********************************************************
+   * Function: bool push_back(const T& value)
+   * Description: Appends value, false if already full.
+   ***********************************************************/
+  bool push_back(const T& value){
+    if(full()){
+      return false;
+    }
+    items[count++] = value;
+    return true;
+  }
+
+  /***********************************************************
+   * Function: bool insert(int pos, const T& value)
+   * Description: Inserts value before index pos (pos == size()
+   * appends). False, with nothing changed, if full or pos is
+   * out of range.
+   ***********************************************************/
+  bool insert(int pos, const T& value){
+    if(full() || pos < 0 || pos > count){
+      return false;
+    }
+    for(int i = count; i > pos; i--){
+      items[i] = items[i - 1];
+    }
+    items[pos] = value;
+    count++;
+    return true;
+  }
+
+  /***********************************************************
+   * Function: bool erase(int pos)
+   * Description: Removes index pos, false if out of range.
+   ***********************************************************/
+  bool erase(int pos){
+    if(pos < 0 || pos >= count){
+      return false;
+    }
+    for(int i = pos; i < count - 1; i++){
+      items[i] = items[i + 1];
+    }
+    count--;
+    return true;
+  }
+
+private:
+  T items[N];
+  int count;
+};
+
+#endif
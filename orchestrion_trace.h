@@ -0,0 +1,333 @@
+/* Filename: orchestrion_trace.h
+ * Author: Liam Warner
+ * Purpose: input trace recorder, a flight recorder for field problems. The HAL records
+ *          every input the firmware acts on into a byte ring in static RAM: ADC readings
+ *          that moved more than TRACE_ADC_DEADBAND from the last one recorded on that
+ *          channel, RTC fields that changed, every USB MIDI packet read, switch/fault pin
+ *          levels that changed and the random seed. It also records every TPIC byte sent,
+ *          so a replay can be checked against what the board did. The firmware itself
+ *          always gets the raw readings; only the recorder drops ADC noise, so a replay
+ *          sees each channel to within the dead band.
+ *          Each record is a header byte, the microseconds since the previous record
+ *          (7 bits a byte, high bit = more) and 0-4 payload bytes; an ADC reading within
+ *          +-7 of the last recorded one is just the header and time. When the ring is full
+ *          the oldest records are dropped. Sending 't' over Serial stops recording, dumps
+ *          the ring as text lines ("#trace ..." around "#t <hex>" lines, written whole and
+ *          only when the log and perf dumps aren't partway through a line), then clears it
+ *          and records again. host/trace_replay feeds a dump back through loop() on the
+ *          simulated board and compares the TPIC bytes. Build with -DTRACE_ENABLED=0 and
+ *          the TRACE_* macros compile to nothing and the ring isn't built.
+ */
+
+#ifndef ORCHESTRION_TRACE_H
+#define ORCHESTRION_TRACE_H
+
+#include "orchestrion_log.h" //a dump line only goes out between log lines
+#include "orchestrion_perf.h" //and between perf lines
+
+// Override from the build (-DTRACE_ENABLED=0) to compile the recorder out
+#ifndef TRACE_ENABLED
+#define TRACE_ENABLED 1
+#endif
+
+// Record headers. The low bits carry a channel, field, level or small value.
+#define TRACE_ADC_DELTA 0x80 // 1ccc dddd: ADC channel c changed by d (-8..7, 4-bit two's complement)
+#define TRACE_ADC 0x00       // 0000 0ccc, value: ADC channel c reading
+#define TRACE_MIDI 0x10      // 0001 kkkk, 3 bytes: USB MIDI packet, code index k (cable 0)
+#define TRACE_RTC 0x20       // 0010 00ff, value: RTC field f (0 hour, 1 minute, 2 second)
+#define TRACE_PIN 0x30       // 0011 000l, pin: pin read level l
+#define TRACE_TPIC 0x40      // 0100 0ccc, value: byte sent to TPIC c
+#define TRACE_POWER_UP 0x50  // 0101 0000: setup() started, the trace begins at power up
+#define TRACE_SEED 0x60      // 0110 0000, 4 bytes: random seed, least significant byte first
+#define TRACE_VERSION 1
+
+// Override from the build (-DTRACE_ADC_DEADBAND=N). An ADC reading within this many counts
+// of the last one recorded on its channel is noise and isn't recorded: idle sensors then
+// cost nothing and a hand over them a few hundred bytes a second instead of ~5 KB/s. 0
+// records every change and makes sensor-mode replays exact, for as long as the ring lasts.
+#ifndef TRACE_ADC_DEADBAND
+#define TRACE_ADC_DEADBAND 5
+#endif
+
+// payload bytes after the time, the host replay decodes with this too
+inline uint8_t trace_payload_len(uint8_t header){
+  if(header & TRACE_ADC_DELTA){
+    return 0;
+  }
+  switch(header & 0xF0){
+    case TRACE_MIDI: return 3;
+    case TRACE_POWER_UP: return 0;
+    case TRACE_SEED: return 4;
+    default: return 1;
+  }
+}
+
+#if TRACE_ENABLED
+
+#ifndef TRACE_BUFFER_SIZE
+#define TRACE_BUFFER_SIZE 4096 // bytes, a power of two up to 32768
+#endif
+#define TRACE_RECORD_MAX 10    // header, 5 time bytes, 4 payload bytes
+#define TRACE_LINE_BYTES 24    // trace bytes per "#t" line, 53 characters with the line ending
+
+static uint8_t trace_buffer[TRACE_BUFFER_SIZE];
+static uint16_t trace_head = 0;      // next byte to write
+static uint16_t trace_tail = 0;      // first byte of the oldest record
+static uint32_t trace_base_us = 0;   // time the oldest record's delta counts from
+static uint32_t trace_last_us = 0;   // time of the newest record
+static bool trace_started = false;   // trace_base_us and trace_last_us are set
+static bool trace_wrapped = false;   // records were dropped to make room
+static uint32_t trace_skipped = 0;   // records not taken while a dump was in progress
+static int16_t trace_adc_last[8] = {-1, -1, -1, -1, -1, -1, -1, -1}; // last recorded reading per channel, -1 = none yet
+static int16_t trace_rtc_last[3] = {-1, -1, -1};
+static uint64_t trace_pin_known = 0; // pins with a recorded level
+static uint64_t trace_pin_level = 0;
+
+// dump state: -1 idle, 0 header line next, 1 data lines, 2 end line next
+static int8_t trace_dump_state = -1;
+static uint16_t trace_dump_pos = 0;
+static uint16_t trace_dump_sum_a = 0; // Fletcher-16 of the dumped bytes
+static uint16_t trace_dump_sum_b = 0;
+
+inline uint16_t trace_used(){
+  return static_cast<uint16_t>((trace_head - trace_tail) & (TRACE_BUFFER_SIZE - 1));
+}
+
+/***********************************************************
+ * Function: void trace_reset()
+ * Description: Empties the ring and forgets the last values,
+ * so the next record of each input is a full one.
+ ***********************************************************/
+void trace_reset(){
+  trace_head = 0;
+  trace_tail = 0;
+  trace_started = false;
+  trace_wrapped = false;
+  trace_skipped = 0;
+  for(int i = 0; i < 8; i++){
+    trace_adc_last[i] = -1;
+  }
+  for(int i = 0; i < 3; i++){
+    trace_rtc_last[i] = -1;
+  }
+  trace_pin_known = 0;
+  trace_pin_level = 0;
+}
+
+// drops the oldest record, moving the base time on by its delta
+void trace_drop_oldest(){
+  uint8_t header = trace_buffer[trace_tail];
+  uint16_t pos = (trace_tail + 1) & (TRACE_BUFFER_SIZE - 1);
+  uint32_t delta = 0;
+  int shift = 0;
+  uint8_t b;
+  do {
+    b = trace_buffer[pos];
+    pos = (pos + 1) & (TRACE_BUFFER_SIZE - 1);
+    delta |= static_cast<uint32_t>(b & 0x7F) << shift;
+    shift += 7;
+  } while(b & 0x80);
+  trace_base_us += delta;
+  trace_tail = (pos + trace_payload_len(header)) & (TRACE_BUFFER_SIZE - 1);
+  trace_wrapped = true;
+}
+
+/***********************************************************
+ * Function: void trace_record(uint8_t header, uint32_t now_us,
+ *                             const uint8_t* payload)
+ * Description: Appends one record, dropping the oldest ones
+ * if there isn't room. Main context only, never from an ISR.
+ ***********************************************************/
+void trace_record(uint8_t header, uint32_t now_us, const uint8_t* payload){
+  if(trace_dump_state >= 0){
+    trace_skipped++;
+    return;
+  }
+  if(!trace_started){
+    trace_base_us = now_us;
+    trace_last_us = now_us;
+    trace_started = true;
+  }
+  uint8_t rec[TRACE_RECORD_MAX];
+  uint8_t len = 0;
+  rec[len++] = header;
+  uint32_t delta = now_us - trace_last_us;
+  trace_last_us = now_us;
+  do {
+    rec[len] = static_cast<uint8_t>(delta & 0x7F);
+    delta >>= 7;
+    rec[len++] |= delta ? 0x80 : 0;
+  } while(delta);
+  for(uint8_t i = 0; i < trace_payload_len(header); i++){
+    rec[len++] = payload[i];
+  }
+  while(TRACE_BUFFER_SIZE - 1 - trace_used() < len){
+    trace_drop_oldest();
+  }
+  for(uint8_t i = 0; i < len; i++){
+    trace_buffer[trace_head] = rec[i];
+    trace_head = (trace_head + 1) & (TRACE_BUFFER_SIZE - 1);
+  }
+}
+
+inline void trace_adc(uint8_t channel, uint8_t value){
+  channel &= 7;
+  int delta = value - trace_adc_last[channel];
+  if(trace_adc_last[channel] >= 0 && abs(delta) <= TRACE_ADC_DEADBAND){
+    return; //noise, or no change at all
+  }
+  if(trace_adc_last[channel] >= 0 && delta >= -8 && delta <= 7){
+    trace_record(static_cast<uint8_t>(TRACE_ADC_DELTA | (channel << 4) | (delta & 0x0F)), micros(), NULL);
+  }else{
+    trace_record(static_cast<uint8_t>(TRACE_ADC | channel), micros(), &value);
+  }
+  trace_adc_last[channel] = value;
+}
+
+inline void trace_rtc(uint8_t field, int value){
+  if(trace_rtc_last[field] == value){
+    return;
+  }
+  uint8_t v = static_cast<uint8_t>(value);
+  trace_record(static_cast<uint8_t>(TRACE_RTC | field), micros(), &v);
+  trace_rtc_last[field] = static_cast<int16_t>(value);
+}
+
+inline void trace_midi(const midiEventPacket_t& rx){
+  if(rx.header == 0){
+    return; //nothing arrived
+  }
+  uint8_t bytes[3] = {rx.byte1, rx.byte2, rx.byte3};
+  trace_record(static_cast<uint8_t>(TRACE_MIDI | (rx.header & 0x0F)), micros(), bytes);
+}
+
+inline void trace_pin(int pin, int level){
+  uint64_t bit = 1ULL << (pin & 63);
+  if((trace_pin_known & bit) && ((trace_pin_level & bit) != 0) == (level != 0)){
+    return;
+  }
+  trace_pin_known |= bit;
+  trace_pin_level = level ? (trace_pin_level | bit) : (trace_pin_level & ~bit);
+  uint8_t p = static_cast<uint8_t>(pin);
+  trace_record(static_cast<uint8_t>(TRACE_PIN | (level ? 1 : 0)), micros(), &p);
+}
+
+// every byte of one SPI transaction, chip numbered from CS_PIN0, with one timestamp
+inline void trace_tpic_frames(const int cs_pins[], const byte messages[], int count){
+  uint32_t now_us = micros();
+  for(int k = 0; k < count; k++){
+    trace_record(static_cast<uint8_t>(TRACE_TPIC | ((cs_pins[k] - CS_PIN0) & 7)), now_us, &messages[k]);
+  }
+}
+
+inline void trace_seed(uint32_t seed){
+  uint8_t bytes[4] = {static_cast<uint8_t>(seed), static_cast<uint8_t>(seed >> 8),
+                      static_cast<uint8_t>(seed >> 16), static_cast<uint8_t>(seed >> 24)};
+  trace_record(TRACE_SEED, micros(), bytes);
+}
+
+inline void trace_power_up(){
+  trace_reset();
+  trace_record(TRACE_POWER_UP, micros(), NULL);
+}
+
+#define TRACE_ADC_READ(channel, value) trace_adc((channel), (value))
+#define TRACE_RTC_READ(field, value) trace_rtc((field), (value))
+#define TRACE_MIDI_READ(rx) trace_midi(rx)
+#define TRACE_PIN_READ(pin, level) trace_pin((pin), (level))
+#define TRACE_TPIC_FRAMES(cs_pins, messages, count) trace_tpic_frames((cs_pins), (messages), (count))
+#define TRACE_SEED_USED(seed) trace_seed(seed)
+#define TRACE_POWER_UP_MARK() trace_power_up()
+
+/***********************************************************
+ * Function: bool trace_command(int c)
+ * Description: 't' starts a dump, if none is in progress.
+ * False for any other command.
+ ***********************************************************/
+bool trace_command(int c){
+  if(c != 't'){
+    return false;
+  }
+  if(trace_dump_state < 0){
+    trace_dump_state = 0;
+    trace_dump_pos = trace_tail;
+    trace_dump_sum_a = 0;
+    trace_dump_sum_b = 0;
+  }
+  return true;
+}
+
+/***********************************************************
+ * Function: void trace_poll()
+ * Description: Call from idle time. Writes the next line of a
+ * dump in progress if the whole line fits in the TX buffer
+ * and no log or perf line is partway out, never blocks. The
+ * ring is cleared once the end line is out.
+ *   #trace <version> <base_us> <bytes> <wrapped> <skipped> <adc deadband>
+ *   #t <hex>...
+ *   #trace end <fletcher16 of the bytes>
+ ***********************************************************/
+void trace_poll(){
+  if(trace_dump_state < 0 || log_line_pending() || perf_line_pending()){
+    return;
+  }
+  char line[2 * TRACE_LINE_BYTES + 8];
+  int len = 0;
+  uint16_t pos = trace_dump_pos;
+  uint16_t sum_a = trace_dump_sum_a;
+  uint16_t sum_b = trace_dump_sum_b;
+  if(trace_dump_state == 0){
+    len = snprintf(line, sizeof(line), "#trace %d %lu %u %d %lu %d\r\n", TRACE_VERSION, (unsigned long)trace_base_us,
+                   (unsigned)trace_used(), trace_wrapped ? 1 : 0, (unsigned long)trace_skipped, TRACE_ADC_DEADBAND);
+  }else if(trace_dump_state == 1){
+    static const char hex[] = "0123456789abcdef";
+    line[len++] = '#';
+    line[len++] = 't';
+    line[len++] = ' ';
+    for(int i = 0; i < TRACE_LINE_BYTES && pos != trace_head; i++){
+      uint8_t b = trace_buffer[pos];
+      line[len++] = hex[b >> 4];
+      line[len++] = hex[b & 0x0F];
+      sum_a = (sum_a + b) % 255;
+      sum_b = (sum_b + sum_a) % 255;
+      pos = (pos + 1) & (TRACE_BUFFER_SIZE - 1);
+    }
+    line[len++] = '\r';
+    line[len++] = '\n';
+  }else{
+    len = snprintf(line, sizeof(line), "#trace end %u\r\n", (unsigned)((trace_dump_sum_b << 8) | trace_dump_sum_a));
+  }
+  if(Serial.availableForWrite() < len){
+    return; //nothing written, the same line is built again next time
+  }
+  Serial.write(reinterpret_cast<const uint8_t*>(line), len);
+  trace_dump_pos = pos;
+  trace_dump_sum_a = sum_a;
+  trace_dump_sum_b = sum_b;
+  if(trace_dump_state == 0){
+    trace_dump_state = trace_used() > 0 ? 1 : 2;
+  }else if(trace_dump_state == 1){
+    if(trace_dump_pos == trace_head){
+      trace_dump_state = 2;
+    }
+  }else{
+    trace_dump_state = -1;
+    trace_reset();
+  }
+}
+
+#else
+
+#define TRACE_ADC_READ(channel, value) do {} while(0)
+#define TRACE_RTC_READ(field, value) do {} while(0)
+#define TRACE_MIDI_READ(rx) do {} while(0)
+#define TRACE_PIN_READ(pin, level) do {} while(0)
+#define TRACE_TPIC_FRAMES(cs_pins, messages, count) do {} while(0)
+#define TRACE_SEED_USED(seed) do {} while(0)
+#define TRACE_POWER_UP_MARK() do {} while(0)
+inline bool trace_command(int){ return false; }
+inline void trace_poll(){}
+
+#endif
+
+#endif
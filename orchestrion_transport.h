@@ -0,0 +1,112 @@
+/* Filename: orchestrion_transport.h
+ * Author: Liam Warner
+ * Purpose: musical transport for lick, chime and sequence playback. Keeps the position in
+ *          ticks (TICKS_PER_QUARTER to the quarter) and the micros() time at which tick 0 of
+ *          the current tempo was due, so every onset is due at origin + ticks * tick period
+ *          instead of "duration after the previous note actually fired". A late note (loop
+ *          overrun, Serial stall, held tongue) is played late on its own, the notes after it
+ *          are still due on the grid. Tempo changes are held until the next beat boundary,
+ *          where the origin moves to that beat.
+ */
+
+#ifndef ORCHESTRION_TRANSPORT_H
+#define ORCHESTRION_TRANSPORT_H
+
+#define TRANSPORT_US_PER_MINUTE_TICK (60000000UL / TICKS_PER_QUARTER) // tick period (us) at 1 bpm
+#define TRANSPORT_MAX_LATE_US 250000UL // further behind than this, drop the lost time instead of rushing to catch up
+
+struct Transport {
+  uint32_t origin_us;   // micros() when origin_tick was due
+  uint32_t origin_tick; // tick at which the current tempo took effect
+  uint32_t tick;        // position of the next onset
+  uint16_t bpm;         // tempo in effect
+  uint16_t pending_bpm; // tempo to switch to at the next beat boundary
+  uint32_t resyncs;     // times the transport fell too far behind and was moved up to now
+};
+
+/***********************************************************
+ * Function: void transport_start(Transport& t, int bpm)
+ * Description: Puts tick 0 at now.
+ ***********************************************************/
+void transport_start(Transport& t, int bpm){
+  t.origin_us = micros();
+  t.origin_tick = 0;
+  t.tick = 0;
+  t.bpm = static_cast<uint16_t>(bpm);
+  t.pending_bpm = t.bpm;
+  t.resyncs = 0;
+}
+
+/***********************************************************
+ * Function: uint32_t transport_time_of(const Transport& t, uint32_t tick)
+ * Description: micros() time at which tick is due under the
+ * current tempo. 64 bit product so nothing is rounded per
+ * note; the sum wraps with micros().
+ ***********************************************************/
+uint32_t transport_time_of(const Transport& t, uint32_t tick){
+  uint64_t elapsed_us = static_cast<uint64_t>(tick - t.origin_tick) * TRANSPORT_US_PER_MINUTE_TICK / t.bpm;
+  return t.origin_us + static_cast<uint32_t>(elapsed_us);
+}
+
+/***********************************************************
+ * Function: uint32_t transport_due_us(const Transport& t)
+ * Description: When the next onset is due.
+ ***********************************************************/
+inline uint32_t transport_due_us(const Transport& t){
+  return transport_time_of(t, t.tick);
+}
+
+/***********************************************************
+ * Function: void transport_set_bpm(Transport& t, int bpm)
+ * Description: Requests a tempo change, it takes effect at
+ * the next beat boundary the transport crosses.
+ ***********************************************************/
+void transport_set_bpm(Transport& t, int bpm){
+  if(bpm > 0){
+    t.pending_bpm = static_cast<uint16_t>(bpm);
+  }
+}
+
+/***********************************************************
+ * Function: void transport_advance(Transport& t, uint32_t ticks)
+ * Description: Moves the position on by ticks (the duration
+ * of the note just played). If a beat boundary was crossed
+ * and a tempo change is pending, the origin moves to that
+ * boundary and the rest of the way runs at the new tempo.
+ ***********************************************************/
+void transport_advance(Transport& t, uint32_t ticks){
+  uint32_t target = t.tick + ticks;
+  if(t.pending_bpm != t.bpm){
+    uint32_t next_beat = (t.tick / TICKS_PER_QUARTER + 1) * TICKS_PER_QUARTER;
+    if(t.tick % TICKS_PER_QUARTER == 0){
+      next_beat = t.tick; // already sitting on a beat
+    }
+    if(next_beat <= target){
+      t.origin_us = transport_time_of(t, next_beat);
+      t.origin_tick = next_beat;
+      t.bpm = t.pending_bpm;
+    }
+  }
+  t.tick = target;
+}
+
+/***********************************************************
+ * Function: bool transport_resync_if_late(Transport& t)
+ * Description: If the next onset is more than
+ * TRANSPORT_MAX_LATE_US in the past (the drum was stopped,
+ * a long blocking call), moves the grid so it is due now.
+ * Small lateness is left alone so later notes catch up.
+ ***********************************************************/
+bool transport_resync_if_late(Transport& t){
+  uint32_t now = micros();
+  uint32_t due = transport_due_us(t);
+  if(static_cast<int32_t>(now - due) <= static_cast<int32_t>(TRANSPORT_MAX_LATE_US)){
+    return false;
+  }
+  t.origin_us = now;
+  t.origin_tick = t.tick;
+  t.resyncs++;
+  return true;
+}
+
+#endif